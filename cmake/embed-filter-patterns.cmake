@@ -0,0 +1,49 @@
+#-----------------------------------------------------------------------------
+#
+#  Turn the files in the filter-patterns directory into a C++ header with
+#  one constexpr table of expressions per file. Comments and empty lines
+#  are removed.
+#
+#  Call with:
+#    cmake -DPATTERN_DIR=<dir> -DOUTPUT=<header> -P embed-filter-patterns.cmake
+#
+#-----------------------------------------------------------------------------
+
+file(GLOB _files RELATIVE "${PATTERN_DIR}" "${PATTERN_DIR}/*")
+list(SORT _files)
+
+set(_content "// Generated from the files in filter-patterns. Do not edit.\n\n")
+string(APPEND _content "#pragma once\n\n")
+string(APPEND _content "struct default_pattern_set\n{\n")
+string(APPEND _content "    char const *name;\n")
+string(APPEND _content "    char const *const *expressions; // ends with nullptr\n")
+string(APPEND _content "};\n")
+
+set(_sets "")
+
+foreach(_file ${_files})
+    string(MAKE_C_IDENTIFIER "default_patterns_${_file}" _var)
+    string(APPEND _content "\nstatic constexpr char const *const ${_var}[] = {\n")
+
+    file(STRINGS "${PATTERN_DIR}/${_file}" _lines)
+    foreach(_line ${_lines})
+        string(REGEX REPLACE "#.*$" "" _line "${_line}")
+        string(REGEX REPLACE "\r$" "" _line "${_line}")
+        if(NOT _line STREQUAL "")
+            string(REPLACE "\\" "\\\\" _line "${_line}")
+            string(REPLACE "\"" "\\\"" _line "${_line}")
+            string(APPEND _content "    \"${_line}\",\n")
+        endif()
+    endforeach()
+
+    string(APPEND _content "    nullptr};\n")
+    string(APPEND _sets "    {\"${_file}\", ${_var}},\n")
+endforeach()
+
+string(APPEND _content "\nstatic constexpr default_pattern_set const default_pattern_sets[] = {\n")
+string(APPEND _content "${_sets}")
+string(APPEND _content "    {nullptr, nullptr}};\n")
+
+file(WRITE "${OUTPUT}" "${_content}")
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,211 @@
+/*
+
+OSM Data Model Tools
+
+all
+
+Copyright (C) 2018-2022  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "characters-analysis.hpp"
+#include "input-reader.hpp"
+#include "limits-analysis.hpp"
+#include "line-or-polygon-analysis.hpp"
+#include "output-pool.hpp"
+#include "run-stats.hpp"
+#include "tag-stats-analysis.hpp"
+#include "way-nodes-analysis.hpp"
+
+#include <osmium/io/any_input.hpp>
+#include <osmium/util/string.hpp>
+#include <osmium/util/verbose_output.hpp>
+
+#include <lyra.hpp>
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static char const *const all_analyses =
+    "characters,limits,tag-stats,line-or-polygon,way-nodes";
+
+/**
+ * Open a file for the report of an analysis that the single tool would
+ * write to stdout.
+ */
+static std::unique_ptr<std::ofstream> open_report(std::string const &dir,
+                                                  std::string const &name,
+                                                  RunStats *stats)
+{
+    auto file_name = dir + "/" + name + ".txt";
+    stats->add_output_file(file_name);
+    auto out = std::make_unique<std::ofstream>(file_name);
+    if (!out->is_open()) {
+        throw std::runtime_error{"Could not open file '" + file_name + "'"};
+    }
+    return out;
+}
+
+int main(int argc, char *argv[])
+{
+    try {
+        std::string input_filename;
+        std::string stats_filename;
+        input_options input;
+        output_options output;
+        std::string output_directory{"."};
+        std::string analyses{all_analyses};
+        line_or_polygon_options lp_options;
+        bool help = false;
+
+        // clang-format off
+        auto const cli
+            = lyra::opt(output_directory, "DIR")
+                ["-o"]["--output-dir"]
+                ("output directory (default: cwd)")
+            | lyra::opt(analyses, "LIST")
+                ["-a"]["--analyses"]
+                ("comma-separated list of analyses (default: all)")
+            | lyra::opt(lp_options.expressions_directory, "DIR")
+                ["-e"]["--expressions-dir"]
+                ("directory with expression files (default: built-in)")
+            | lyra::opt(input.format, "FORMAT")
+                ["--input-format"]
+                ("format of input file (needed for STDIN)")
+            | lyra::opt(input.mmap)
+                ["--mmap"]
+                ("memory map PBF input file")
+            | lyra::opt(output.compression, "COMPRESSION")
+                ["--output-compression"]
+                ("compression of PBF output files (none, lz4, zlib[:LEVEL])")
+            | lyra::opt(output.threads, "N")
+                ["--output-threads"]
+                ("number of threads encoding output (default: all cores)")
+            | lyra::opt(output.memory, "MB")
+                ["--output-memory"]
+                ("memory for output not yet encoded (default: 256)")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
+            | lyra::help(help)
+            | lyra::arg(input_filename, "FILENAME")
+                ("input file");
+        // clang-format on
+
+        auto const result = cli.parse(lyra::args(argc, argv));
+        if (!result) {
+            std::cerr << "Error in command line: " << result.message() << '\n';
+            return 1;
+        }
+
+        if (help) {
+            std::cout << cli
+                      << "\nRun several analyses in one pass over the input."
+                      << "\nAvailable analyses: " << all_analyses << '\n';
+            return 0;
+        }
+
+        if (input_filename.empty()) {
+            std::cerr << "Missing input filename. Try '-h'.\n";
+            return 1;
+        }
+
+        RunStats stats{"odmt-all"};
+        stats.add_input_file(input_filename);
+
+        // All analyses share the output pool, it must outlive them.
+        OutputPool output_pool{output};
+        std::vector<std::unique_ptr<std::ofstream>> reports;
+        std::vector<std::unique_ptr<Analysis>> enabled;
+
+        for (auto const &name : osmium::split_string(analyses, ',', true)) {
+            if (name == "characters") {
+                enabled.push_back(std::make_unique<CharactersAnalysis>(
+                    output_directory, &output_pool));
+            } else if (name == "limits") {
+                enabled.push_back(std::make_unique<LimitsAnalysis>(
+                    output_directory, limits_options{}, &output_pool));
+            } else if (name == "tag-stats") {
+                reports.push_back(open_report(output_directory, name, &stats));
+                enabled.push_back(std::make_unique<TagStatsAnalysis>(
+                    tag_stats_options{}, reports.back().get()));
+            } else if (name == "line-or-polygon") {
+                reports.push_back(open_report(output_directory, name, &stats));
+                enabled.push_back(std::make_unique<LineOrPolygonAnalysis>(
+                    output_directory, lp_options, &output_pool,
+                    reports.back().get()));
+            } else if (name == "way-nodes") {
+                reports.push_back(open_report(output_directory, name, &stats));
+                enabled.push_back(
+                    std::make_unique<WayNodesAnalysis>(reports.back().get()));
+            } else {
+                std::cerr << "Unknown analysis '" << name << "'. Try '-h'.\n";
+                return 1;
+            }
+        }
+
+        if (enabled.empty()) {
+            std::cerr << "No analyses enabled. Try '-h'.\n";
+            return 1;
+        }
+
+        osmium::osm_entity_bits::type entities =
+            osmium::osm_entity_bits::nothing;
+        for (auto const &analysis : enabled) {
+            entities |= analysis->entities();
+        }
+
+        osmium::VerboseOutput vout{true};
+
+        auto const input_file = make_input_file(input_filename, input);
+        InputReader reader{input_file, entities, input};
+
+        vout << "Reading input...\n";
+        stats.phase("process");
+        while (auto const buffer = stats.read(&reader)) {
+            for (auto const &object : buffer.select<osmium::OSMObject>()) {
+                auto const bit = osmium::osm_entity_bits::from_item_type(
+                    object.type());
+                for (auto const &analysis : enabled) {
+                    if (analysis->entities() & bit) {
+                        analysis->object(object);
+                    }
+                }
+            }
+        }
+        reader.close();
+
+        vout << "Writing results...\n";
+        stats.phase("write");
+        for (auto const &analysis : enabled) {
+            analysis->finish();
+            stats.add_output_files(analysis->output_files());
+        }
+        reports.clear();
+        stats.write_json(stats_filename);
+
+        vout << "Done.\n";
+    } catch (std::exception const &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
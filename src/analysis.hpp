@@ -0,0 +1,80 @@
+#pragma once
+
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/object.hpp>
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * The per-object logic of one of the analysis tools. The tools feed all
+ * objects from their input into an analysis, odmt-all feeds them into
+ * several analyses in one pass. After the last object finish() is called,
+ * which closes all output files.
+ */
+class Analysis
+{
+
+    std::vector<std::string> m_output_files;
+
+    std::size_t m_block = 0;
+    double m_sample_rate = 1.0;
+
+protected:
+    /// Remember the name of an output file and return it.
+    std::string output_file(std::string file_name)
+    {
+        m_output_files.push_back(file_name);
+        return file_name;
+    }
+
+    /// The number of the block (buffer) the current object comes from.
+    [[nodiscard]] std::size_t block() const noexcept { return m_block; }
+
+    /**
+     * The fraction of blocks of the input read if only a sample of the
+     * blocks is read (1 if all blocks are read).
+     */
+    [[nodiscard]] double sample_rate() const noexcept { return m_sample_rate; }
+
+public:
+    Analysis() = default;
+
+    Analysis(Analysis const &) = delete;
+    Analysis &operator=(Analysis const &) = delete;
+
+    Analysis(Analysis &&) = delete;
+    Analysis &operator=(Analysis &&) = delete;
+
+    virtual ~Analysis() noexcept = default;
+
+    /// The types of objects this analysis needs to see.
+    [[nodiscard]] virtual osmium::osm_entity_bits::type
+    entities() const noexcept = 0;
+
+    virtual void object(osmium::OSMObject const &object) = 0;
+
+    virtual void finish() = 0;
+
+    /**
+     * Called after all objects of a buffer are done. When only a sample of
+     * the input is read, the analyses use the blocks to estimate how good
+     * their estimates are.
+     */
+    void next_block() noexcept { ++m_block; }
+
+    /**
+     * Tell the analysis that only a random sample of the blocks was read.
+     * Counts will then be scaled up accordingly.
+     */
+    void set_sample_rate(double rate) noexcept { m_sample_rate = rate; }
+
+    /// The names of all files written by this analysis.
+    [[nodiscard]] std::vector<std::string> const &output_files() const noexcept
+    {
+        return m_output_files;
+    }
+
+}; // class Analysis
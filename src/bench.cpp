@@ -0,0 +1,649 @@
+/*
+
+OSM Data Model Tools
+
+bench
+
+Copyright (C) 2018-2022  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "characters-analysis.hpp"
+#include "filter.hpp"
+#include "limits-analysis.hpp"
+#include "line-or-polygon-analysis.hpp"
+#include "output-options.hpp"
+#include "output-pool.hpp"
+#include "radix-sort.hpp"
+#include "ranked-id-set.hpp"
+#include "synthetic-data.hpp"
+
+#include <osmium/index/id_set.hpp>
+#include <osmium/io/any_input.hpp>
+#include <osmium/io/any_output.hpp>
+#include <osmium/osm/way.hpp>
+#include <osmium/util/file.hpp>
+
+#include <lyra.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct bench_result
+{
+    std::uint64_t objects = 0;
+    std::uint64_t bytes = 0;
+    double seconds = 0.0;
+    long peak_rss_kb = 0; // 0 if unknown
+};
+
+static void print_header()
+{
+    std::cout << std::left << std::setw(28) << "benchmark" << std::right
+              << std::setw(14) << "objects/s" << std::setw(10) << "MB/s"
+              << std::setw(12) << "seconds" << std::setw(14)
+              << "peak RSS MB" << '\n';
+}
+
+static void print_result(std::string const &name, bench_result const &r)
+{
+    auto const seconds = std::max(r.seconds, 1e-9);
+    std::cout << std::left << std::setw(28) << name << std::right
+              << std::fixed << std::setprecision(0) << std::setw(14)
+              << (static_cast<double>(r.objects) / seconds)
+              << std::setprecision(1) << std::setw(10)
+              << (static_cast<double>(r.bytes) / seconds / 1024 / 1024)
+              << std::setprecision(3) << std::setw(12) << r.seconds;
+    if (r.peak_rss_kb > 0) {
+        std::cout << std::setprecision(1) << std::setw(14)
+                  << (static_cast<double>(r.peak_rss_kb) / 1024);
+    } else {
+        std::cout << std::setw(14) << '-';
+    }
+    std::cout << '\n';
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+/**
+ * Run func the specified number of times and return the fastest run.
+ */
+static double best_of(unsigned int iterations,
+                      std::function<void()> const &func)
+{
+    double best = std::numeric_limits<double>::max();
+    for (unsigned int i = 0; i < iterations; ++i) {
+        auto const start = std::chrono::steady_clock::now();
+        func();
+        best = std::min(best, seconds_since(start));
+    }
+    return best;
+}
+
+static long self_peak_rss_kb() noexcept
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/**
+ * Generate synthetic data. The buffers are kept in memory for the
+ * microbenchmarks and written to a PBF file for the end-to-end runs.
+ */
+static std::vector<osmium::memory::Buffer>
+generate(synthetic_options const &options, std::string const &file_name)
+{
+    std::vector<osmium::memory::Buffer> buffers;
+
+    osmium::io::Header header;
+    header.set("generator", "odmt-bench");
+    osmium::io::Writer writer{file_name, header, osmium::io::overwrite::allow};
+
+    generate_synthetic_data(options, [&](osmium::memory::Buffer &&buffer) {
+        osmium::memory::Buffer copy{buffer.committed()};
+        copy.add_buffer(buffer);
+        copy.commit();
+        writer(std::move(copy));
+        buffers.push_back(std::move(buffer));
+    });
+
+    writer.close();
+    return buffers;
+}
+
+/**
+ * Call func for each object in the buffers, return the number of objects
+ * and the number of bytes in the buffers.
+ */
+template <typename TFunc>
+static bench_result
+for_each_object(std::vector<osmium::memory::Buffer> const &buffers,
+                TFunc &&func)
+{
+    bench_result result;
+    for (auto const &buffer : buffers) {
+        result.bytes += buffer.committed();
+        for (auto const &object : buffer.select<osmium::OSMObject>()) {
+            ++result.objects;
+            func(object);
+        }
+    }
+    return result;
+}
+
+static void run_micro(std::vector<osmium::memory::Buffer> const &buffers,
+                      std::string const &output_directory,
+                      unsigned int iterations)
+{
+    // Results are added up here so the compiler can't optimize the
+    // benchmarked code away.
+    std::uint64_t sink = 0;
+
+    auto const measure = [&](std::string const &name, auto &&func) {
+        bench_result result;
+        auto const seconds = best_of(iterations, [&]() {
+            result = for_each_object(buffers, func);
+        });
+        result.seconds = seconds;
+        print_result(name, result);
+    };
+
+    measure("check_chars", [&](osmium::OSMObject const &object) {
+        sink += static_cast<std::uint64_t>(check_chars(object));
+    });
+
+    OutputPool output_pool{output_options{}};
+
+    {
+        LimitsAnalysis analysis{output_directory, limits_options{},
+                                &output_pool};
+        measure("check_limits", [&](osmium::OSMObject const &object) {
+            sink += std::get<3>(analysis.check_limits(object));
+        });
+        analysis.finish();
+    }
+
+    {
+        LineOrPolygonClassifier classifier{line_or_polygon_options{}};
+        std::vector<std::string> unknown_keys;
+        measure("get_type", [&](osmium::OSMObject const &object) {
+            if (object.type() == osmium::item_type::way) {
+                unknown_keys.clear();
+                sink += static_cast<std::uint64_t>(
+                    classifier.get_type(object.tags(), &unknown_keys));
+            }
+        });
+    }
+
+    // Writing all objects to a PBF file with the different compressions.
+    // This includes the encoding in the writer threads of libosmium.
+    std::vector<std::string> compressions{"none", "zlib:1", "zlib"};
+#ifdef OSMIUM_WITH_LZ4
+    compressions.emplace_back("lz4");
+#endif
+    auto const write_file_name = output_directory + "/bench-write.osm.pbf";
+    for (auto const &compression : compressions) {
+        output_options options;
+        options.compression = compression;
+        auto const file = make_output_file(write_file_name, options);
+        bench_result result;
+        auto const seconds = best_of(iterations, [&]() {
+            osmium::io::Writer writer{file, osmium::io::overwrite::allow};
+            result = for_each_object(
+                buffers,
+                [&](osmium::OSMObject const &object) { writer(object); });
+            writer.close();
+        });
+        result.seconds = seconds;
+        print_result("write PBF (" + compression + ")", result);
+    }
+
+    // Spreading the objects over several output files like odmt-limits
+    // and odmt-line-or-polygon do, with a writer for each file and with
+    // the writers sharing an output pool.
+    constexpr std::size_t const num_outputs = 6;
+    auto const multi_file_name = [&](std::size_t n) {
+        return output_directory + "/bench-write-" + std::to_string(n) +
+               ".osm.pbf";
+    };
+    {
+        bench_result result;
+        auto const seconds = best_of(iterations, [&]() {
+            std::vector<std::unique_ptr<osmium::io::Writer>> writers;
+            for (std::size_t n = 0; n < num_outputs; ++n) {
+                writers.push_back(std::make_unique<osmium::io::Writer>(
+                    multi_file_name(n), osmium::io::overwrite::allow));
+            }
+            result = for_each_object(
+                buffers, [&](osmium::OSMObject const &object) {
+                    (*writers[object.positive_id() % num_outputs])(object);
+                });
+            for (auto &writer : writers) {
+                writer->close();
+            }
+        });
+        result.seconds = seconds;
+        print_result("write 6 PBF (writers)", result);
+    }
+    {
+        bench_result result;
+        auto const seconds = best_of(iterations, [&]() {
+            std::vector<std::unique_ptr<PooledWriter>> writers;
+            for (std::size_t n = 0; n < num_outputs; ++n) {
+                writers.push_back(std::make_unique<PooledWriter>(
+                    &output_pool, multi_file_name(n)));
+            }
+            result = for_each_object(
+                buffers, [&](osmium::OSMObject const &object) {
+                    (*writers[object.positive_id() % num_outputs])(object);
+                });
+            for (auto &writer : writers) {
+                writer->close();
+            }
+        });
+        result.seconds = seconds;
+        print_result("write 6 PBF (output pool)", result);
+    }
+
+    std::vector<filter_rule> rules;
+    for (auto const *name : {"meta-tags", "neutral-tags", "import-tags"}) {
+        auto r = default_filter_rules(name);
+        rules.insert(rules.end(), r.begin(), r.end());
+    }
+
+    auto const tags_filter = make_tags_filter(rules);
+    measure("filter (TagsFilter)", [&](osmium::OSMObject const &object) {
+        for (auto const &tag : object.tags()) {
+            sink += tags_filter(tag) ? 1 : 0;
+        }
+    });
+
+    CompiledTagsFilter const compiled_filter{rules};
+    measure("filter (compiled)", [&](osmium::OSMObject const &object) {
+        for (auto const &tag : object.tags()) {
+            sink += compiled_filter(tag) ? 1 : 0;
+        }
+    });
+
+    // Segment keys like odmt-duplicate-segments creates them: only segments
+    // between nodes in multiple ways, keyed by the ranks of the nodes.
+    osmium::index::IdSetDense<osmium::unsigned_object_id_type> in_way;
+    RankedIdSet in_multiple_ways;
+    for_each_object(buffers, [&](osmium::OSMObject const &object) {
+        if (object.type() != osmium::item_type::way) {
+            return;
+        }
+        auto const &way = static_cast<osmium::Way const &>(object);
+        if (way.nodes().empty()) {
+            return;
+        }
+        auto const *it = way.nodes().begin();
+        if (way.is_closed()) {
+            ++it;
+        }
+        for (; it != way.nodes().end(); ++it) {
+            if (in_way.get(it->positive_ref())) {
+                in_multiple_ways.set(it->positive_ref());
+            } else {
+                in_way.set(it->positive_ref());
+            }
+        }
+    });
+    in_way.clear();
+    in_multiple_ways.freeze();
+
+    std::vector<std::uint64_t> segments;
+    for_each_object(buffers, [&](osmium::OSMObject const &object) {
+        if (object.type() != osmium::item_type::way) {
+            return;
+        }
+        auto const &nodes = static_cast<osmium::Way const &>(object).nodes();
+        for (std::size_t i = 1; i < nodes.size(); ++i) {
+            auto const a = nodes[i - 1].positive_ref();
+            auto const b = nodes[i].positive_ref();
+            if (in_multiple_ways.get(a) && in_multiple_ways.get(b)) {
+                segments.push_back(segment_key(in_multiple_ways.rank(a),
+                                               in_multiple_ways.rank(b)));
+            }
+        }
+    });
+
+    auto const measure_sort = [&](std::string const &name, auto &&sort) {
+        bench_result result;
+        result.objects = segments.size();
+        result.bytes = segments.size() * sizeof(std::uint64_t);
+        result.seconds = std::numeric_limits<double>::max();
+        for (unsigned int i = 0; i < iterations; ++i) {
+            auto data = segments;
+            auto const start = std::chrono::steady_clock::now();
+            sort(&data);
+            result.seconds = std::min(result.seconds, seconds_since(start));
+            sink += data.front();
+        }
+        print_result(name, result);
+    };
+
+    if (!segments.empty()) {
+        measure_sort("segment sort (std::sort)",
+                     [](std::vector<std::uint64_t> *data) {
+                         std::sort(data->begin(), data->end());
+                     });
+        measure_sort("segment sort (radix)",
+                     [](std::vector<std::uint64_t> *data) {
+                         radix_sort(data->data(),
+                                    data->data() + data->size(), 1);
+                     });
+        auto const num_threads = std::thread::hardware_concurrency();
+        measure_sort("segment sort (radix, " + std::to_string(num_threads) +
+                         "t)",
+                     [&](std::vector<std::uint64_t> *data) {
+                         radix_sort(data->data(),
+                                    data->data() + data->size(), num_threads);
+                     });
+    }
+
+    std::cout << "(checksum " << sink << ", peak RSS of odmt-bench "
+              << (self_peak_rss_kb() / 1024) << " MB)\n";
+}
+
+/**
+ * Run a program with stdout and stderr going to /dev/null. Returns the
+ * wall clock time and the peak RSS of the program.
+ */
+static bench_result run_program(std::vector<std::string> const &args)
+{
+    std::vector<char *> argv;
+    for (auto const &arg : args) {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    auto const start = std::chrono::steady_clock::now();
+
+    pid_t const pid = ::fork();
+    if (pid < 0) {
+        throw std::runtime_error{"Could not fork"};
+    }
+    if (pid == 0) {
+        int const fd = ::open("/dev/null", O_WRONLY);
+        if (fd >= 0) {
+            ::dup2(fd, 1);
+            ::dup2(fd, 2);
+        }
+        ::execv(argv[0], argv.data());
+        std::_Exit(127);
+    }
+
+    int status = 0;
+    rusage usage{};
+    if (::wait4(pid, &status, 0, &usage) < 0) {
+        throw std::runtime_error{"Error waiting for '" + args[0] + "'"};
+    }
+
+    bench_result result;
+    result.seconds = seconds_since(start);
+    result.peak_rss_kb = usage.ru_maxrss;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error{"Program '" + args[0] + "' failed"};
+    }
+
+    return result;
+}
+
+static void run_tools(std::string const &bin_directory,
+                      std::string const &input, std::uint64_t num_objects,
+                      std::string const &output_directory,
+                      output_options const &output)
+{
+    // Add the output compression to the options of programs writing PBF.
+    auto const pbf_output = [&](std::vector<std::string> args) {
+        if (!output.compression.empty()) {
+            args.emplace_back("--output-compression");
+            args.push_back(output.compression);
+        }
+        return args;
+    };
+
+    auto const filter_file = output_directory + "/remove-tags.filter";
+    {
+        std::ofstream out{filter_file};
+        out << "source\nnote\nnote:*\n";
+    }
+
+    std::vector<std::pair<std::string, std::vector<std::string>>> const
+        tools = {
+            {"characters", pbf_output({"-o", output_directory})},
+            {"duplicate-segments", pbf_output({"-o", output_directory})},
+            {"limits", pbf_output({"-o", output_directory})},
+            {"line-or-polygon", pbf_output({"-o", output_directory})},
+            {"mark-topo-nodes", pbf_output({"-o", output_directory})},
+            {"remove-tags",
+             pbf_output({"-e", filter_file, "-o",
+                         output_directory + "/remove-tags.osm.pbf"})},
+            {"tag-stats", {}},
+            {"way-nodes", {}},
+            {"all", pbf_output({"-o", output_directory})},
+        };
+
+    auto const size = osmium::file_size(input);
+
+    for (auto const &tool : tools) {
+        std::vector<std::string> args;
+        args.push_back(bin_directory + "/odmt-" + tool.first);
+        args.insert(args.end(), tool.second.begin(), tool.second.end());
+        args.push_back(input);
+
+        auto result = run_program(args);
+        result.objects = num_objects;
+        result.bytes = size;
+        print_result("odmt-" + tool.first, result);
+    }
+}
+
+/**
+ * Match all tags of the objects in the input file against the filter rules
+ * with the osmium::TagsFilter and with the compiled filter. Prints the tags
+ * on which they disagree and a summary. Returns the number of those tags.
+ */
+static std::uint64_t check_filter(std::string const &rules_filename,
+                                  std::string const &input_filename)
+{
+    auto const rules = read_filter_rules(rules_filename);
+    auto const tags_filter = make_tags_filter(rules);
+    CompiledTagsFilter const compiled_filter{rules};
+
+    std::uint64_t count = 0;
+    std::uint64_t matches = 0;
+    std::uint64_t differences = 0;
+
+    osmium::io::Reader reader{osmium::io::File{input_filename},
+                              osmium::osm_entity_bits::nwr};
+    while (auto const buffer = reader.read()) {
+        for (auto const &object : buffer.select<osmium::OSMObject>()) {
+            for (auto const &tag : object.tags()) {
+                bool const expected = tags_filter(tag);
+                bool const got = compiled_filter(tag);
+                ++count;
+                if (expected) {
+                    ++matches;
+                }
+                if (expected != got) {
+                    ++differences;
+                    std::cout << "'" << tag.key() << "'='" << tag.value()
+                              << "': TagsFilter " << expected
+                              << ", compiled " << got << '\n';
+                }
+            }
+        }
+    }
+    reader.close();
+
+    std::cout << count << " tags, " << matches << " matching, "
+              << differences << " differences\n";
+    return differences;
+}
+
+static std::string directory_of(std::string const &path)
+{
+    auto const pos = path.find_last_of('/');
+    if (pos == std::string::npos) {
+        return ".";
+    }
+    return path.substr(0, pos);
+}
+
+int main(int argc, char *argv[])
+{
+    try {
+        std::string work_directory{"."};
+        std::string bin_directory{directory_of(argv[0])};
+        synthetic_options options;
+        output_options output;
+        unsigned int iterations = 3;
+        bool generate_only = false;
+        bool no_micro = false;
+        bool no_tools = false;
+        std::string check_rules_filename;
+        std::string check_tags_filename;
+        bool help = false;
+
+        // clang-format off
+        auto const cli
+            = lyra::opt(work_directory, "DIR")
+                ["-d"]["--work-dir"]
+                ("directory for generated data and outputs (default: cwd)")
+            | lyra::opt(bin_directory, "DIR")
+                ["-b"]["--bin-dir"]
+                ("directory with the odmt-* programs (default: same as odmt-bench)")
+            | lyra::opt(options.num_nodes, "N")
+                ["-s"]["--scale"]
+                ("number of nodes generated (default: 1000000)")
+            | lyra::opt(options.seed, "N")
+                ["--seed"]
+                ("seed for random number generator (default: 1)")
+            | lyra::opt(iterations, "N")
+                ["-i"]["--iterations"]
+                ("run microbenchmarks this many times, report best (default: 3)")
+            | lyra::opt(generate_only)
+                ["-g"]["--generate-only"]
+                ("only generate synthetic data")
+            | lyra::opt(no_micro)
+                ["--no-micro"]
+                ("do not run microbenchmarks")
+            | lyra::opt(no_tools)
+                ["--no-tools"]
+                ("do not run the programs")
+            | lyra::opt(output.compression, "COMPRESSION")
+                ["--output-compression"]
+                ("run the programs with this PBF output compression")
+            | lyra::opt(check_rules_filename, "FILE")
+                ["--check-filter"]
+                ("check that both filter implementations agree on the rules in FILE")
+            | lyra::opt(check_tags_filename, "FILE")
+                ["--check-tags"]
+                ("OSM file with the tags for --check-filter")
+            | lyra::help(help);
+        // clang-format on
+
+        auto const result = cli.parse(lyra::args(argc, argv));
+        if (!result) {
+            std::cerr << "Error in command line: " << result.message() << '\n';
+            return 1;
+        }
+
+        if (help) {
+            std::cout << cli << "\nRun benchmarks on synthetic data.\n";
+            return 0;
+        }
+
+        if (!check_rules_filename.empty() || !check_tags_filename.empty()) {
+            if (check_rules_filename.empty() || check_tags_filename.empty()) {
+                std::cerr << "Options --check-filter and --check-tags must "
+                             "be used together.\n";
+                return 1;
+            }
+            return check_filter(check_rules_filename, check_tags_filename) ==
+                           0
+                       ? 0
+                       : 1;
+        }
+
+        if (options.num_nodes == 0 || iterations == 0) {
+            std::cerr << "Scale and iterations must be at least 1.\n";
+            return 1;
+        }
+
+        auto const output_directory = work_directory + "/bench-output";
+        ::mkdir(output_directory.c_str(), 0777);
+
+        auto const input = work_directory + "/synthetic-" +
+                           std::to_string(options.num_nodes) + "-" +
+                           std::to_string(options.seed) + ".osm.pbf";
+
+        auto const start = std::chrono::steady_clock::now();
+        auto const buffers = generate(options, input);
+        bench_result gen_result = for_each_object(buffers, [](auto const &) {});
+        gen_result.seconds = seconds_since(start);
+
+        print_header();
+        print_result("generate", gen_result);
+
+        if (generate_only) {
+            return 0;
+        }
+
+        if (!no_micro) {
+            run_micro(buffers, output_directory, iterations);
+        }
+
+        if (!no_tools) {
+            run_tools(bin_directory, input, gen_result.objects,
+                      output_directory, output);
+        }
+    } catch (std::exception const &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
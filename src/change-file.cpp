@@ -0,0 +1,46 @@
+#include "change-file.hpp"
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/object_comparisons.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+void read_change_file(
+    std::string const &file_name, osmium::osm_entity_bits::type entities,
+    input_options const &input, RunStats *stats,
+    std::function<void(osmium::OSMObject const &)> const &func)
+{
+    // The objects stay where they are in the buffers, which don't move
+    // their data when they are moved into the vector.
+    std::vector<osmium::memory::Buffer> buffers;
+    std::vector<osmium::OSMObject const *> objects;
+
+    InputReader reader{make_input_file(file_name, input), entities, input};
+    while (auto buffer = stats->read(&reader)) {
+        for (auto const &object : buffer.select<osmium::OSMObject>()) {
+            objects.push_back(&object);
+        }
+        buffers.push_back(std::move(buffer));
+    }
+    reader.close();
+
+    // Stable, so that of two objects with the same version the one later
+    // in the file wins.
+    std::stable_sort(objects.begin(), objects.end(),
+                     [](osmium::OSMObject const *a,
+                        osmium::OSMObject const *b) {
+                         return osmium::object_order_type_id_version{}(*a,
+                                                                        *b);
+                     });
+
+    for (auto it = objects.cbegin(); it != objects.cend(); ++it) {
+        auto const next = std::next(it);
+        if (next == objects.cend() || (*next)->type() != (*it)->type() ||
+            (*next)->id() != (*it)->id()) {
+            func(**it);
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "input-reader.hpp"
+#include "run-stats.hpp"
+
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/object.hpp>
+
+#include <functional>
+#include <string>
+
+/**
+ * Read an OsmChange file and call func with the objects in the order they
+ * have to be applied to a state: Sorted by type and ID and only the last
+ * version of each object, like "osmium apply-changes" does it. A change
+ * file can contain several versions of an object in any order, in file
+ * order an older version could win.
+ *
+ * The whole file is kept in memory.
+ */
+void read_change_file(
+    std::string const &file_name, osmium::osm_entity_bits::type entities,
+    input_options const &input, RunStats *stats,
+    std::function<void(osmium::OSMObject const &)> const &func);
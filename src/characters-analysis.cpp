@@ -0,0 +1,72 @@
+#include "characters-analysis.hpp"
+
+#include <osmium/io/any_output.hpp>
+#include <osmium/osm/relation.hpp>
+
+#include <cctype>
+#include <cstring>
+
+static char const *const bad_chars = "=+/&<>;'\"?%#@\\, \t\r\n\f";
+
+static bool chars_are_good(const char *str)
+{
+    for (; *str; ++str) {
+        if (!std::isalnum(*str) && *str != ':' && *str != '_' && *str != '-') {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int check_chars(osmium::OSMObject const &object)
+{
+    bool undecided = false;
+
+    for (auto const &tag : object.tags()) {
+        if (std::strpbrk(tag.key(), bad_chars)) {
+            return 2;
+        }
+        if (!chars_are_good(tag.key())) {
+            undecided = true;
+        }
+    }
+
+    if (object.type() == osmium::item_type::relation) {
+        for (auto const &member :
+             static_cast<osmium::Relation const &>(object).members()) {
+            if (std::strpbrk(member.role(), bad_chars)) {
+                return 2;
+            }
+            if (!chars_are_good(member.role())) {
+                undecided = true;
+            }
+        }
+    }
+
+    return undecided ? 1 : 0;
+}
+
+CharactersAnalysis::CharactersAnalysis(std::string const &output_directory,
+                                       OutputPool *output)
+: m_writer_bad(output, output_file(output_directory + "/bad-chars.osm.pbf")),
+  m_writer_undecided(output,
+                     output_file(output_directory + "/undecided-chars.osm.pbf"))
+{
+}
+
+void CharactersAnalysis::object(osmium::OSMObject const &object)
+{
+    int const level = check_chars(object);
+    if (level == 1) {
+        m_writer_undecided(object);
+    } else if (level == 2) {
+        m_writer_bad(object);
+    }
+}
+
+void CharactersAnalysis::finish()
+{
+    m_writer_undecided.close();
+    m_writer_bad.close();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "output-pool.hpp"
+
+
+#include <string>
+
+/**
+ * Check the characters in all tag keys and member roles. Returns 0 if they
+ * only contain characters known to be good, 2 if there is a character from
+ * a list of possibly problematic characters, 1 otherwise.
+ */
+int check_chars(osmium::OSMObject const &object);
+
+/**
+ * Writes objects with undecided or bad characters to undecided-chars.osm.pbf
+ * or bad-chars.osm.pbf in the output directory.
+ */
+class CharactersAnalysis : public Analysis
+{
+
+    PooledWriter m_writer_bad;
+    PooledWriter m_writer_undecided;
+
+public:
+    CharactersAnalysis(std::string const &output_directory,
+                       OutputPool *output);
+
+    [[nodiscard]] osmium::osm_entity_bits::type
+    entities() const noexcept override
+    {
+        return osmium::osm_entity_bits::nwr;
+    }
+
+    void object(osmium::OSMObject const &object) override;
+
+    void finish() override;
+
+}; // class CharactersAnalysis
@@ -21,63 +21,27 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
 
+#include "characters-analysis.hpp"
+#include "input-reader.hpp"
+#include "output-pool.hpp"
+#include "run-stats.hpp"
+
 #include <osmium/io/any_input.hpp>
-#include <osmium/io/any_output.hpp>
 #include <osmium/util/verbose_output.hpp>
 
 #include <lyra.hpp>
 
-#include <cctype>
-#include <cstdlib>
-#include <cstring>
+#include <exception>
+#include <iostream>
 #include <string>
-#include <utility>
-
-static char const *const bad_chars = "=+/&<>;'\"?%#@\\, \t\r\n\f";
-
-bool chars_are_good(const char *str)
-{
-    for (; *str; ++str) {
-        if (!std::isalnum(*str) && *str != ':' && *str != '_' && *str != '-') {
-            return false;
-        }
-    }
-
-    return true;
-}
-
-int check_chars(osmium::OSMObject const &object)
-{
-    bool undecided = false;
-
-    for (auto const &tag : object.tags()) {
-        if (std::strpbrk(tag.key(), bad_chars)) {
-            return 2;
-        }
-        if (!chars_are_good(tag.key())) {
-            undecided = true;
-        }
-    }
-
-    if (object.type() == osmium::item_type::relation) {
-        for (auto const &member :
-             static_cast<osmium::Relation const &>(object).members()) {
-            if (std::strpbrk(member.role(), bad_chars)) {
-                return 2;
-            }
-            if (!chars_are_good(member.role())) {
-                undecided = true;
-            }
-        }
-    }
-
-    return undecided ? 1 : 0;
-}
 
 int main(int argc, char *argv[])
 {
     try {
         std::string input_filename;
+        std::string stats_filename;
+        input_options input;
+        output_options output;
         std::string output_directory;
         bool help = false;
 
@@ -86,6 +50,24 @@ int main(int argc, char *argv[])
             = lyra::opt(output_directory, "DIR")
                 ["-o"]["--output-dir"]
                 ("output directory")
+            | lyra::opt(input.format, "FORMAT")
+                ["--input-format"]
+                ("format of input file (needed for STDIN)")
+            | lyra::opt(input.mmap)
+                ["--mmap"]
+                ("memory map PBF input file")
+            | lyra::opt(output.compression, "COMPRESSION")
+                ["--output-compression"]
+                ("compression of PBF output files (none, lz4, zlib[:LEVEL])")
+            | lyra::opt(output.threads, "N")
+                ["--output-threads"]
+                ("number of threads encoding output (default: all cores)")
+            | lyra::opt(output.memory, "MB")
+                ["--output-memory"]
+                ("memory for output not yet encoded (default: 256)")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
             | lyra::help(help)
             | lyra::arg(input_filename, "FILENAME")
                 ("input file");
@@ -109,31 +91,29 @@ int main(int argc, char *argv[])
             return 1;
         }
 
-        osmium::io::File input_file{input_filename};
+        RunStats stats{"odmt-characters"};
+        stats.add_input_file(input_filename);
+
+        auto const input_file = make_input_file(input_filename, input);
 
         osmium::VerboseOutput vout{true};
 
-        osmium::io::Reader reader{input_file};
-        osmium::io::Writer writer_bad{output_directory + "/bad-chars.osm.pbf",
-                                      osmium::io::overwrite::allow};
-        osmium::io::Writer writer_undecided{output_directory +
-                                                "/undecided-chars.osm.pbf",
-                                            osmium::io::overwrite::allow};
+        OutputPool output_pool{output};
+        CharactersAnalysis analysis{output_directory, &output_pool};
+        InputReader reader{input_file, analysis.entities(), input};
 
-        while (auto const buffer = reader.read()) {
+        stats.phase("process");
+        while (auto const buffer = stats.read(&reader)) {
             for (auto const &object : buffer.select<osmium::OSMObject>()) {
-                int level = check_chars(object);
-                if (level == 1) {
-                    writer_undecided(object);
-                } else if (level == 2) {
-                    writer_bad(object);
-                }
+                analysis.object(object);
             }
         }
         reader.close();
 
-        writer_undecided.close();
-        writer_bad.close();
+        stats.phase("write");
+        analysis.finish();
+        stats.add_output_files(analysis.output_files());
+        stats.write_json(stats_filename);
 
         vout << "Done.\n";
     } catch (std::exception const &e) {
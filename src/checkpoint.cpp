@@ -0,0 +1,151 @@
+#include "checkpoint.hpp"
+
+#include "serialize.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+static constexpr char const *const checkpoint_magic = "odmt-checkpoint";
+static constexpr std::uint64_t const checkpoint_version = 2;
+
+/**
+ * Describe the input file by name, size, and modification time, so that
+ * a checkpoint isn't used with a changed input file.
+ */
+static std::string input_file_description(std::string const &file_name)
+{
+    struct stat s = {};
+    if (::stat(file_name.c_str(), &s) != 0) {
+        throw std::runtime_error{"Could not stat file '" + file_name + "'"};
+    }
+    return file_name + ' ' + std::to_string(s.st_size) + ' ' +
+           std::to_string(s.st_mtime);
+}
+
+Checkpoint::Checkpoint(std::string directory, std::string run,
+                       std::string const &input_filename,
+                       unsigned int interval)
+: m_directory(std::move(directory)), m_run(std::move(run)),
+  m_interval(std::chrono::seconds{interval}),
+  m_last_save(std::chrono::steady_clock::now())
+{
+    if (!enabled()) {
+        return;
+    }
+
+    m_run += '\n' + input_file_description(input_filename);
+
+    if (::mkdir(m_directory.c_str(), 0777) != 0 && errno != EEXIST) {
+        throw std::runtime_error{"Could not create directory '" +
+                                 m_directory + "'"};
+    }
+
+    // Without a checkpoint file any other files in the directory are left
+    // over from a run killed before its first checkpoint.
+    std::ifstream in{checkpoint_file_name(), std::ios::binary};
+    if (!in.is_open()) {
+        remove();
+        return;
+    }
+
+    if (read_string(in) != checkpoint_magic ||
+        read_varint(in) != checkpoint_version) {
+        throw std::runtime_error{"File '" + checkpoint_file_name() +
+                                 "' is not a checkpoint file"};
+    }
+
+    if (read_string(in) != m_run) {
+        throw std::runtime_error{
+            "Checkpoint in '" + m_directory +
+            "' is from a different run (remove it to start from scratch)"};
+    }
+
+    m_step = static_cast<unsigned int>(read_varint(in));
+    m_offset = read_varint(in);
+    m_state_start = in.tellg();
+    m_resume = true;
+}
+
+std::string Checkpoint::checkpoint_file_name() const
+{
+    return m_directory + '/' + file_prefix;
+}
+
+bool Checkpoint::due() const
+{
+    return enabled() &&
+           std::chrono::steady_clock::now() - m_last_save >= m_interval;
+}
+
+std::string Checkpoint::file_name(std::string const &name) const
+{
+    return checkpoint_file_name() + '-' + name;
+}
+
+void Checkpoint::load(std::function<void(std::istream &)> const &func) const
+{
+    if (!m_resume) {
+        return;
+    }
+
+    std::ifstream in{checkpoint_file_name(), std::ios::binary};
+    if (!in.is_open()) {
+        throw std::runtime_error{"Could not open file '" +
+                                 checkpoint_file_name() + "'"};
+    }
+    in.seekg(m_state_start);
+    func(in);
+    if (!in) {
+        throw std::runtime_error{"Error reading file '" +
+                                 checkpoint_file_name() + "'"};
+    }
+}
+
+void Checkpoint::save(unsigned int step, std::uint64_t offset,
+                      std::function<void(std::ostream &)> const &func)
+{
+    if (!enabled()) {
+        return;
+    }
+
+    write_file_atomically(checkpoint_file_name(), [&](std::ostream &out) {
+        write_string(out, checkpoint_magic);
+        write_varint(out, checkpoint_version);
+        write_string(out, m_run);
+        write_varint(out, step);
+        write_varint(out, offset);
+        func(out);
+    });
+
+    m_last_save = std::chrono::steady_clock::now();
+}
+
+void Checkpoint::remove()
+{
+    if (!enabled()) {
+        return;
+    }
+
+    // The checkpoint file goes first, so a run interrupted here starts
+    // from scratch.
+    std::remove(checkpoint_file_name().c_str());
+
+    DIR *dir = ::opendir(m_directory.c_str());
+    if (!dir) {
+        return;
+    }
+    std::string const prefix{file_prefix};
+    while (auto const *entry = ::readdir(dir)) {
+        std::string const name{entry->d_name};
+        if (name.compare(0, prefix.size(), prefix) == 0) {
+            std::remove((m_directory + '/' + name).c_str());
+        }
+    }
+    ::closedir(dir);
+}
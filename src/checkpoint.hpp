@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+
+/**
+ * Lets long running programs save their state from time to time so that
+ * they can continue from there when they are restarted after being killed.
+ *
+ * A run is divided into steps, usually one for each pass over the input.
+ * Within a step the program can save its state together with the offset in
+ * the input file where reading has to continue. Each checkpoint replaces
+ * the last one. The checkpoint file is written with write_file_atomically(),
+ * so there is always a complete checkpoint.
+ *
+ * A checkpoint belongs to one program run with certain options on a
+ * certain input file. If the program is started with a checkpoint from a
+ * different run, it fails instead of producing wrong results.
+ *
+ * If no directory is set, checkpoints are disabled. Then save() and
+ * remove() do nothing and there is never anything to resume.
+ */
+class Checkpoint
+{
+
+    std::string m_directory;
+    std::string m_run;
+    std::chrono::steady_clock::duration m_interval;
+    std::chrono::steady_clock::time_point m_last_save;
+
+    unsigned int m_step = 0;
+    std::uint64_t m_offset = 0;
+    bool m_resume = false;
+
+    // Where the state of the program starts in the checkpoint file.
+    std::streamoff m_state_start = 0;
+
+    [[nodiscard]] std::string checkpoint_file_name() const;
+
+public:
+    /// The names of all files of a checkpoint start with this.
+    static constexpr char const *const file_prefix = "odmt-checkpoint";
+
+    /**
+     * Look for a checkpoint in the directory.
+     *
+     * @param directory The checkpoint directory (empty to disable).
+     * @param run Program name and all options that change its state.
+     * @param input_filename The input file, must not change between runs.
+     * @param interval Minimum number of seconds between checkpoints.
+     *
+     * @throws std::runtime_error if there is a checkpoint for another run.
+     */
+    Checkpoint(std::string directory, std::string run,
+               std::string const &input_filename, unsigned int interval);
+
+    [[nodiscard]] bool enabled() const noexcept
+    {
+        return !m_directory.empty();
+    }
+
+    /// Was a checkpoint found to resume from?
+    [[nodiscard]] bool resume() const noexcept { return m_resume; }
+
+    /// The step to continue with (0 if not resuming).
+    [[nodiscard]] unsigned int step() const noexcept { return m_step; }
+
+    /// The input file offset to continue the step at.
+    [[nodiscard]] std::uint64_t offset() const noexcept { return m_offset; }
+
+    /// Is it time for the next checkpoint?
+    [[nodiscard]] bool due() const;
+
+    /**
+     * The name of a file in the checkpoint directory which can be used by
+     * the program for state that doesn't go into the checkpoint file. It
+     * is removed by remove(). So is any other file in the directory with a
+     * name starting with file_prefix.
+     */
+    [[nodiscard]] std::string file_name(std::string const &name) const;
+
+    /// Call func to read the state saved with the checkpoint.
+    void load(std::function<void(std::istream &)> const &func) const;
+
+    /**
+     * Write a checkpoint. Func is called to write the state of the program.
+     *
+     * @param step The step the program is in.
+     * @param offset The input file offset where the step has to continue.
+     */
+    void save(unsigned int step, std::uint64_t offset,
+              std::function<void(std::ostream &)> const &func);
+
+    /// Remove the checkpoint and all other files of it after a complete run.
+    void remove();
+
+}; // class Checkpoint
@@ -21,7 +21,16 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
 
+#include "checkpoint.hpp"
+#include "external-sort.hpp"
+#include "input-reader.hpp"
+#include "output-options.hpp"
+#include "ranked-id-set.hpp"
+#include "run-stats.hpp"
+#include "serialize.hpp"
+
 #include <osmium/index/id_set.hpp>
+#include <osmium/index/map/dense_file_array.hpp>
 #include <osmium/io/any_input.hpp>
 #include <osmium/io/any_output.hpp>
 #include <osmium/util/verbose_output.hpp>
@@ -29,23 +38,52 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <lyra.hpp>
 
 #include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <cstdlib>
 #include <exception>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * A segment stored as the IDs of its two nodes (or the keys of their
+ * locations), independent of the direction of the segment.
+ */
 struct node_pair
-: public std::pair<osmium::object_id_type, osmium::object_id_type>
 {
+    osmium::unsigned_object_id_type first = 0;
+    osmium::unsigned_object_id_type second = 0;
 
-    node_pair(osmium::object_id_type a, osmium::object_id_type b)
-    : pair(std::min(a, b), std::max(a, b))
+    node_pair() = default;
+
+    node_pair(osmium::unsigned_object_id_type a,
+              osmium::unsigned_object_id_type b) noexcept
+    : first(std::min(a, b)), second(std::max(a, b))
     {}
 
+    friend bool operator==(node_pair const &lhs, node_pair const &rhs) noexcept
+    {
+        return lhs.first == rhs.first && lhs.second == rhs.second;
+    }
+
+    friend bool operator<(node_pair const &lhs, node_pair const &rhs) noexcept
+    {
+        return std::tie(lhs.first, lhs.second) <
+               std::tie(rhs.first, rhs.second);
+    }
+
 }; // struct node_pair
 
 class counter
@@ -73,11 +111,690 @@ public:
 
 }; // class counter
 
+/**
+ * Writes out the node and way IDs of segments that are used in many ways.
+ * The IDs of all those ways are also remembered.
+ */
+class duplicate_ways
+{
+
+    std::ofstream m_csv;
+    osmium::index::IdSetDense<osmium::unsigned_object_id_type> m_way_ids;
+    std::size_t m_min_count;
+
+public:
+    duplicate_ways(std::string const &file_name, std::size_t min_count)
+    : m_csv(file_name), m_min_count(min_count)
+    {}
+
+    [[nodiscard]] std::size_t min_count() const noexcept
+    {
+        return m_min_count;
+    }
+
+    void add(std::string const &segment,
+             std::vector<osmium::unsigned_object_id_type> *way_ids)
+    {
+        std::sort(way_ids->begin(), way_ids->end());
+        m_csv << segment;
+        for (auto const id : *way_ids) {
+            m_csv << ',' << id;
+            m_way_ids.set(id);
+        }
+        m_csv << '\n';
+    }
+
+    [[nodiscard]] osmium::index::IdSetDense<
+        osmium::unsigned_object_id_type> const &
+    way_ids() const noexcept
+    {
+        return m_way_ids;
+    }
+
+}; // class duplicate_ways
+
+/**
+ * Counts runs of identical segments in a sorted stream of segments. The
+ * format function is used to turn a segment back into the IDs of its
+ * nodes (or its coordinates) separated by the specified character. If the
+ * segments come with the IDs of their ways, those are handed to the
+ * duplicate_ways object.
+ */
+template <typename TKey>
+class duplicate_counter
+{
+
+    // Segments used at least this many times are written to the ids file
+    static constexpr std::size_t const min_count_for_output = 10;
+
+    using format_func = std::function<std::string(TKey const &, char)>;
+
+    format_func m_format;
+    std::ofstream &m_ids;
+    duplicate_ways *m_ways;
+    counter m_counts;
+    TKey m_last_key{};
+    std::size_t m_count = 0;
+    std::vector<osmium::unsigned_object_id_type> m_way_ids;
+
+    void flush()
+    {
+        if (m_count < 2) {
+            return;
+        }
+
+        m_counts.increment(m_count - 1);
+
+        if (m_count >= min_count_for_output) {
+            m_ids << m_count << ' ' << m_format(m_last_key, ' ') << '\n';
+        }
+
+        if (m_ways && m_count >= m_ways->min_count()) {
+            m_ways->add(m_format(m_last_key, ','), &m_way_ids);
+        }
+    }
+
+public:
+    duplicate_counter(format_func format, std::ofstream &ids,
+                      duplicate_ways *ways)
+    : m_format(std::move(format)), m_ids(ids), m_ways(ways)
+    {}
+
+    void operator()(TKey const &key)
+    {
+        if (m_count > 0 && key == m_last_key) {
+            ++m_count;
+            return;
+        }
+        flush();
+        m_last_key = key;
+        m_count = 1;
+        m_way_ids.clear();
+    }
+
+    void operator()(TKey const &key, osmium::unsigned_object_id_type way_id)
+    {
+        (*this)(key);
+        m_way_ids.push_back(way_id);
+    }
+
+    counter const &finish()
+    {
+        flush();
+        m_count = 0;
+        return m_counts;
+    }
+
+}; // class duplicate_counter
+
+static std::string format_ids(osmium::unsigned_object_id_type id1,
+                              osmium::unsigned_object_id_type id2,
+                              char separator)
+{
+    return std::to_string(id1) + separator + std::to_string(id2);
+}
+
+static std::string format_location(osmium::Location location, char separator)
+{
+    std::string out;
+    location.as_string(std::back_inserter(out), separator);
+    return out;
+}
+
+/**
+ * Maps locations to 64 bit keys. Coordinates are quantized to a grid with
+ * the specified cell size (in units of 1/10,000,000 degree), so locations
+ * in the same grid cell get the same key. Keys are ordered by x, then y.
+ */
+class location_quantizer
+{
+
+    static constexpr std::int64_t const x_offset = 180L * 10000000L;
+    static constexpr std::int64_t const y_offset = 90L * 10000000L;
+
+    std::int64_t m_grid;
+
+public:
+    explicit location_quantizer(std::uint32_t grid) : m_grid(grid)
+    {
+        if (grid == 0) {
+            throw std::invalid_argument{"Grid size must be at least 1"};
+        }
+    }
+
+    [[nodiscard]] std::uint64_t key(osmium::Location location) const noexcept
+    {
+        assert(location.valid());
+        auto const x = static_cast<std::uint64_t>(
+            (location.x() + x_offset) / m_grid);
+        auto const y = static_cast<std::uint64_t>(
+            (location.y() + y_offset) / m_grid);
+        return (x << 32U) | y;
+    }
+
+    [[nodiscard]] osmium::Location location(std::uint64_t key) const noexcept
+    {
+        auto const x =
+            static_cast<std::int64_t>(key >> 32U) * m_grid - x_offset;
+        auto const y =
+            static_cast<std::int64_t>(key & 0xffffffffU) * m_grid - y_offset;
+        return osmium::Location{static_cast<std::int32_t>(x),
+                                static_cast<std::int32_t>(y)};
+    }
+
+}; // class location_quantizer
+
+/**
+ * Node location index in a memory mapped file in the scratch directory.
+ * The file is removed right after it is created, so it goes away when
+ * the program ends. Memory use is bounded by the page cache, not the
+ * heap.
+ *
+ * If the index is part of a checkpoint, an existing file is opened and
+ * the file is kept, so that a restarted program can continue with it.
+ */
+class location_index
+{
+
+    int m_fd;
+    osmium::index::map::DenseFileArray<osmium::unsigned_object_id_type,
+                                       osmium::Location>
+        m_index;
+
+    static int create_file(std::string const &file_name, bool keep)
+    {
+        // NOLINTNEXTLINE(hicpp-signed-bitwise)
+        int const flags = keep ? O_RDWR | O_CREAT : O_RDWR | O_CREAT | O_TRUNC;
+        int const fd = ::open(file_name.c_str(), flags, 0644);
+        if (fd < 0) {
+            throw std::runtime_error{"Could not open file '" + file_name +
+                                     "'"};
+        }
+        if (!keep) {
+            ::unlink(file_name.c_str());
+        }
+        return fd;
+    }
+
+public:
+    location_index(std::string const &file_name, bool keep)
+    : m_fd(create_file(file_name, keep)), m_index(m_fd)
+    {}
+
+    location_index(location_index const &) = delete;
+    location_index &operator=(location_index const &) = delete;
+
+    location_index(location_index &&) = delete;
+    location_index &operator=(location_index &&) = delete;
+
+    ~location_index() noexcept { ::close(m_fd); }
+
+    /// Make sure the index is on disk (for checkpoints).
+    void sync() const
+    {
+        if (::fsync(m_fd) != 0) {
+            throw std::runtime_error{"Error writing location index"};
+        }
+    }
+
+    void set(osmium::unsigned_object_id_type id, osmium::Location location)
+    {
+        m_index.set(id, location);
+    }
+
+    [[nodiscard]] osmium::Location
+    get(osmium::unsigned_object_id_type id) const noexcept
+    {
+        return m_index.get_noexcept(id);
+    }
+
+}; // class location_index
+
+struct sort_options
+{
+    std::string scratch_directory;
+    std::string run_name;     // names of run files start with this
+    std::size_t memory_limit; // in bytes, 0 for no limit
+    unsigned int num_threads;
+    std::size_t run_size = 0; // records per run, overrides memory_limit
+
+    template <typename TSorter>
+    [[nodiscard]] std::size_t max_records() const noexcept
+    {
+        if (run_size > 0) {
+            return run_size;
+        }
+        return memory_limit / TSorter::record_size();
+    }
+}; // struct sort_options
+
+/**
+ * Remember all nodes of the way in in_way. Nodes that were already in
+ * in_way are added to in_multiple_ways. The last node of a closed way
+ * is only counted once.
+ */
+void mark_way_nodes(osmium::Way const &way, RankedIdSet *in_way,
+                    RankedIdSet *in_multiple_ways)
+{
+    if (way.nodes().empty()) {
+        return;
+    }
+    auto const *it = way.nodes().begin();
+    if (way.is_closed()) {
+        ++it;
+    }
+    for (; it != way.nodes().end(); ++it) {
+        if (in_way->get(it->positive_ref())) {
+            in_multiple_ways->set(it->positive_ref());
+        } else {
+            in_way->set(it->positive_ref());
+        }
+    }
+}
+
+/**
+ * Call func with the IDs of the nodes of each segment of the way.
+ */
+template <typename TFunc>
+void for_each_segment(osmium::Way const &way, TFunc &&func)
+{
+    if (way.nodes().size() < 2) {
+        return;
+    }
+    auto const *it = way.nodes().begin();
+    for (++it; it != way.nodes().end(); ++it) {
+        func((it - 1)->positive_ref(), it->positive_ref());
+    }
+}
+
+/**
+ * Add a segment to the sorter. If the sorter has a payload, the way ID is
+ * added as payload.
+ */
+template <typename TKey, typename TPayload>
+void add_segment(ExternalSorter<TKey, TPayload> *segments, TKey const &key,
+                 osmium::Way const &way)
+{
+    if constexpr (std::is_same<TPayload, no_payload>::value) {
+        segments->add(key);
+    } else {
+        segments->add(key, way.positive_id());
+    }
+}
+
+/**
+ * Read the ways twice: First to find all nodes in multiple ways and then
+ * to collect all segments between such nodes.
+ *
+ * Checkpoint steps: 0 = first pass, 1 = second pass, 2 = sorting. The node
+ * sets only change in step 0. At the end of it the nodes in multiple ways
+ * are saved once to their own file in the checkpoint directory, so later
+ * checkpoints only contain the state of the sorter.
+ */
+template <typename TPayload>
+counter count_two_pass(osmium::io::File const &input_file,
+                       input_options const &input,
+                       sort_options const &options, std::ofstream &ids,
+                       duplicate_ways *ways, RunStats *stats,
+                       Checkpoint *checkpoint, osmium::VerboseOutput &vout)
+{
+    RankedIdSet in_way;
+    RankedIdSet in_multiple_ways;
+
+    using sorter_type = ExternalSorter<std::uint64_t, TPayload>;
+    sorter_type segments{options.scratch_directory, options.run_name,
+                         options.max_records<sorter_type>(),
+                         options.memory_limit, options.num_threads};
+
+    auto const nodes_file_name = checkpoint->file_name("nodes");
+    auto const save_first_pass = [&](std::ostream &out) {
+        in_way.save(out);
+        in_multiple_ways.save(out);
+    };
+    auto const save_state = [&](std::ostream &out) { segments.save(out); };
+    checkpoint->load([&](std::istream &in) {
+        if (checkpoint->step() == 0) {
+            in_way.load(in);
+            in_multiple_ways.load(in);
+        } else {
+            read_file(nodes_file_name, [&](std::istream &nodes) {
+                in_multiple_ways.load(nodes);
+            });
+            segments.load(in);
+        }
+    });
+    if (segments.num_runs() > 0) {
+        vout << "Loaded " << segments.num_runs()
+             << " sorted runs from checkpoint\n";
+    }
+
+    stats->phase("process");
+
+    if (checkpoint->step() == 0) {
+        vout << "Reading nodes in ways...\n";
+        auto reader_options = input;
+        reader_options.start_offset = checkpoint->offset();
+        InputReader reader1{input_file, osmium::osm_entity_bits::way,
+                            reader_options};
+        while (auto const buffer = stats->read(&reader1)) {
+            for (auto const &way : buffer.select<osmium::Way>()) {
+                mark_way_nodes(way, &in_way, &in_multiple_ways);
+            }
+            if (checkpoint->due() && reader1.direct()) {
+                checkpoint->save(0, reader1.offset(), save_first_pass);
+            }
+        }
+        reader1.close();
+    }
+
+    in_way.clear();
+    if (checkpoint->step() == 0 && checkpoint->enabled()) {
+        write_file_atomically(nodes_file_name, [&](std::ostream &out) {
+            in_multiple_ways.save(out);
+        });
+        checkpoint->save(1, 0, save_state);
+    }
+    in_multiple_ways.freeze();
+    vout << "Got " << in_multiple_ways.size() << " nodes in multiple ways\n";
+
+    if (checkpoint->step() <= 1) {
+        vout << "Reading segments...\n";
+        auto reader_options = input;
+        if (checkpoint->step() == 1) {
+            reader_options.start_offset = checkpoint->offset();
+        }
+        InputReader reader2{input_file, osmium::osm_entity_bits::way,
+                            reader_options};
+        while (auto const buffer = stats->read(&reader2)) {
+            for (auto const &way : buffer.select<osmium::Way>()) {
+                for_each_segment(way, [&](auto id1, auto id2) {
+                    if (in_multiple_ways.get(id1) &&
+                        in_multiple_ways.get(id2)) {
+                        add_segment(&segments,
+                                    segment_key(in_multiple_ways.rank(id1),
+                                                in_multiple_ways.rank(id2)),
+                                    way);
+                    }
+                });
+            }
+            if (checkpoint->due() && reader2.direct()) {
+                checkpoint->save(1, reader2.offset(), save_state);
+            }
+        }
+        reader2.close();
+        checkpoint->save(2, 0, save_state);
+    }
+
+    vout << "Got " << segments.size() << " segments\n";
+
+    if (segments.num_runs() > 0) {
+        vout << "Wrote " << segments.num_runs() << " sorted runs\n";
+    }
+
+    stats->phase("sort");
+    vout << "Sorting and counting segments...\n";
+    duplicate_counter<std::uint64_t> dc{
+        [&](std::uint64_t key, char separator) {
+            return format_ids(
+                in_multiple_ways.select(static_cast<std::uint32_t>(key >> 32U)),
+                in_multiple_ways.select(
+                    static_cast<std::uint32_t>(key & 0xffffffffU)),
+                separator);
+        },
+        ids, ways};
+    segments.merge(dc);
+
+    return dc.finish();
+}
+
+/**
+ * Read the ways only once collecting all segments. Because we don't know
+ * which nodes are in multiple ways until the end, segments have to be
+ * stored with their full node IDs and filtered while merging.
+ *
+ * Checkpoint steps: 0 = reading, 1 = sorting.
+ */
+template <typename TPayload>
+counter count_one_pass(osmium::io::File const &input_file,
+                       input_options const &input,
+                       sort_options const &options, std::ofstream &ids,
+                       duplicate_ways *ways, RunStats *stats,
+                       Checkpoint *checkpoint, osmium::VerboseOutput &vout)
+{
+    RankedIdSet in_way;
+    RankedIdSet in_multiple_ways;
+
+    using sorter_type = ExternalSorter<node_pair, TPayload>;
+    sorter_type segments{options.scratch_directory, options.run_name,
+                         options.max_records<sorter_type>(),
+                         options.memory_limit, options.num_threads};
+
+    auto const save_state = [&](std::ostream &out) {
+        in_way.save(out);
+        in_multiple_ways.save(out);
+        segments.save(out);
+    };
+    checkpoint->load([&](std::istream &in) {
+        in_way.load(in);
+        in_multiple_ways.load(in);
+        segments.load(in);
+    });
+    if (segments.num_runs() > 0) {
+        vout << "Loaded " << segments.num_runs()
+             << " sorted runs from checkpoint\n";
+    }
+
+    stats->phase("process");
+
+    if (checkpoint->step() == 0) {
+        vout << "Reading nodes in ways and segments...\n";
+        auto reader_options = input;
+        reader_options.start_offset = checkpoint->offset();
+        InputReader reader{input_file, osmium::osm_entity_bits::way,
+                           reader_options};
+        while (auto const buffer = stats->read(&reader)) {
+            for (auto const &way : buffer.select<osmium::Way>()) {
+                mark_way_nodes(way, &in_way, &in_multiple_ways);
+                for_each_segment(way, [&](auto id1, auto id2) {
+                    add_segment(&segments, node_pair{id1, id2}, way);
+                });
+            }
+            if (checkpoint->due() && reader.direct()) {
+                checkpoint->save(0, reader.offset(), save_state);
+            }
+        }
+        reader.close();
+        in_way.clear();
+        checkpoint->save(1, 0, save_state);
+    }
+
+    vout << "Got " << in_multiple_ways.size() << " nodes in multiple ways\n";
+    vout << "Got " << segments.size() << " segments (unfiltered)\n";
+
+    if (segments.num_runs() > 0) {
+        vout << "Wrote " << segments.num_runs() << " sorted runs\n";
+    }
+
+    stats->phase("sort");
+    vout << "Sorting, filtering, and counting segments...\n";
+    duplicate_counter<node_pair> dc{
+        [](node_pair const &segment, char separator) {
+            return format_ids(segment.first, segment.second, separator);
+        },
+        ids, ways};
+    segments.merge([&](node_pair const &segment, auto const &...way_id) {
+        if (in_multiple_ways.get(segment.first) &&
+            in_multiple_ways.get(segment.second)) {
+            dc(segment, way_id...);
+        }
+    });
+
+    return dc.finish();
+}
+
+/**
+ * Read the node locations into an index and then collect all segments
+ * keyed by the (quantized) locations of their nodes. This finds segments
+ * of different ways that overlap even if they don't share nodes.
+ *
+ * Checkpoint steps: 0 = reading nodes, 1 = reading ways, 2 = sorting. The
+ * location index is kept in the checkpoint directory and not saved with
+ * each checkpoint.
+ */
+template <typename TPayload>
+counter count_locations(osmium::io::File const &input_file,
+                        input_options const &input,
+                        sort_options const &options, std::uint32_t grid,
+                        std::ofstream &ids, duplicate_ways *ways,
+                        RunStats *stats, Checkpoint *checkpoint,
+                        osmium::VerboseOutput &vout)
+{
+    location_quantizer const quantizer{grid};
+    location_index index{checkpoint->enabled()
+                             ? checkpoint->file_name("locations")
+                             : options.scratch_directory + "/locations-" +
+                                   std::to_string(::getpid()),
+                         checkpoint->enabled()};
+
+    using sorter_type = ExternalSorter<node_pair, TPayload>;
+    sorter_type segments{options.scratch_directory, options.run_name,
+                         options.max_records<sorter_type>(),
+                         options.memory_limit, options.num_threads};
+
+    std::uint64_t missing_locations = 0;
+
+    auto const save_state = [&](std::ostream &out) {
+        index.sync();
+        write_varint(out, missing_locations);
+        segments.save(out);
+    };
+    checkpoint->load([&](std::istream &in) {
+        missing_locations = read_varint(in);
+        segments.load(in);
+    });
+    if (segments.num_runs() > 0) {
+        vout << "Loaded " << segments.num_runs()
+             << " sorted runs from checkpoint\n";
+    }
+
+    stats->phase("process");
+
+    if (checkpoint->step() == 0) {
+        vout << "Reading node locations...\n";
+        auto reader_options = input;
+        reader_options.start_offset = checkpoint->offset();
+        InputReader reader1{input_file, osmium::osm_entity_bits::node,
+                            reader_options};
+        while (auto const buffer = stats->read(&reader1)) {
+            for (auto const &node : buffer.select<osmium::Node>()) {
+                index.set(node.positive_id(), node.location());
+            }
+            if (checkpoint->due() && reader1.direct()) {
+                checkpoint->save(0, reader1.offset(), save_state);
+            }
+        }
+        reader1.close();
+        checkpoint->save(1, 0, save_state);
+    }
+
+    if (checkpoint->step() <= 1) {
+        vout << "Reading segments...\n";
+        auto reader_options = input;
+        if (checkpoint->step() == 1) {
+            reader_options.start_offset = checkpoint->offset();
+        }
+        InputReader reader2{input_file, osmium::osm_entity_bits::way,
+                            reader_options};
+        while (auto const buffer = stats->read(&reader2)) {
+            for (auto const &way : buffer.select<osmium::Way>()) {
+                for_each_segment(way, [&](auto id1, auto id2) {
+                    auto const location1 = index.get(id1);
+                    auto const location2 = index.get(id2);
+                    if (location1.valid() && location2.valid()) {
+                        add_segment(&segments,
+                                    node_pair{quantizer.key(location1),
+                                              quantizer.key(location2)},
+                                    way);
+                    } else {
+                        ++missing_locations;
+                    }
+                });
+            }
+            if (checkpoint->due() && reader2.direct()) {
+                checkpoint->save(1, reader2.offset(), save_state);
+            }
+        }
+        reader2.close();
+        checkpoint->save(2, 0, save_state);
+    }
+
+    vout << "Got " << segments.size() << " segments\n";
+    vout << "Ignored " << missing_locations
+         << " segments with missing or invalid locations\n";
+
+    if (segments.num_runs() > 0) {
+        vout << "Wrote " << segments.num_runs() << " sorted runs\n";
+    }
+
+    stats->phase("sort");
+    vout << "Sorting and counting segments...\n";
+    duplicate_counter<node_pair> dc{
+        [&](node_pair const &segment, char separator) {
+            return format_location(quantizer.location(segment.first),
+                                   separator) +
+                   separator +
+                   format_location(quantizer.location(segment.second),
+                                   separator);
+        },
+        ids, ways};
+    segments.merge(dc);
+
+    return dc.finish();
+}
+
+/**
+ * Copy all ways with the specified IDs from the input to the output file.
+ */
+static void
+write_ways(osmium::io::File const &input_file, input_options const &input,
+           osmium::index::IdSetDense<osmium::unsigned_object_id_type> const
+               &way_ids,
+           std::string const &output_filename, output_options const &output,
+           RunStats *stats)
+{
+    stats->add_output_file(output_filename);
+    InputReader reader{input_file, osmium::osm_entity_bits::way, input};
+    osmium::io::Writer writer{make_output_file(output_filename, output),
+                              osmium::io::overwrite::allow};
+    while (auto const buffer = stats->read(&reader)) {
+        for (auto const &way : buffer.select<osmium::Way>()) {
+            if (way_ids.get(way.positive_id())) {
+                writer(way);
+            }
+        }
+    }
+    writer.close();
+    reader.close();
+}
+
 int main(int argc, char *argv[])
 {
     try {
         std::string input_filename;
+        std::string stats_filename;
+        input_options input;
+        output_options output;
         std::string output_directory{"."};
+        std::string scratch_directory;
+        std::size_t memory_limit = 0;
+        std::size_t run_size = 0;
+        unsigned int num_threads = std::thread::hardware_concurrency();
+        std::size_t way_ids_min_count = 0;
+        std::uint32_t grid = 1;
+        std::string checkpoint_directory;
+        unsigned int checkpoint_interval = 600;
+        bool one_pass = false;
+        bool locations = false;
         bool help = false;
 
         // clang-format off
@@ -85,6 +802,48 @@ int main(int argc, char *argv[])
             = lyra::opt(output_directory, "DIR")
                 ["-o"]["--output-dir"]
                 ("output directory")
+            | lyra::opt(num_threads, "N")
+                ["-t"]["--threads"]
+                ("number of threads used for sorting (default: all cores)")
+            | lyra::opt(memory_limit, "MB")
+                ["-m"]["--memory-limit"]
+                ("max memory used for segments (default: no limit)")
+            | lyra::opt(run_size, "N")
+                ["--run-size"]
+                ("max number of segments in a sorted run, overrides --memory-limit (for testing)")
+            | lyra::opt(scratch_directory, "DIR")
+                ["-s"]["--scratch-dir"]
+                ("directory for temporary files (default: output directory)")
+            | lyra::opt(way_ids_min_count, "COUNT")
+                ["-w"]["--way-ids"]
+                ("write way IDs of segments used at least COUNT times")
+            | lyra::opt(one_pass)
+                ["--one-pass"]
+                ("read ways only once (needs more scratch space)")
+            | lyra::opt(locations)
+                ["-l"]["--locations"]
+                ("find segments with same locations instead of same nodes")
+            | lyra::opt(grid, "SIZE")
+                ["-g"]["--grid"]
+                ("grid size for locations in 1/10^7 degrees (default: 1)")
+            | lyra::opt(checkpoint_directory, "DIR")
+                ["--checkpoint-dir"]
+                ("save progress in DIR and resume from there when restarted")
+            | lyra::opt(checkpoint_interval, "SECONDS")
+                ["--checkpoint-interval"]
+                ("time between checkpoints (default: 600)")
+            | lyra::opt(input.format, "FORMAT")
+                ["--input-format"]
+                ("format of input file (needed for STDIN)")
+            | lyra::opt(input.mmap)
+                ["--mmap"]
+                ("memory map PBF input file")
+            | lyra::opt(output.compression, "COMPRESSION")
+                ["--output-compression"]
+                ("compression of PBF output files (none, lz4, zlib[:LEVEL])")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
             | lyra::help(help)
             | lyra::arg(input_filename, "FILENAME")
                 ("input file");
@@ -106,100 +865,118 @@ int main(int argc, char *argv[])
             return 1;
         }
 
-        osmium::io::File input_file{input_filename};
-
-        osmium::VerboseOutput vout{true};
+        if (locations && one_pass) {
+            std::cerr << "Can not use --locations together with --one-pass.\n";
+            return 1;
+        }
 
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type>
-            in_multiple_ways;
+        if (is_stdin(input_filename) &&
+            (!one_pass || way_ids_min_count > 0 ||
+             !checkpoint_directory.empty())) {
+            std::cerr << "Reading from STDIN only works with --one-pass and "
+                         "without --way-ids and --checkpoint-dir.\n";
+            return 1;
+        }
 
-        vout << "Reading nodes in ways...\n";
+        if (grid == 0) {
+            std::cerr << "Grid size must be at least 1.\n";
+            return 1;
+        }
 
-        {
-            osmium::index::IdSetDense<osmium::unsigned_object_id_type> in_way;
-            osmium::io::Reader reader1{input_file,
-                                       osmium::osm_entity_bits::way};
-            while (auto const buffer = reader1.read()) {
-                for (auto const &way : buffer.select<osmium::Way>()) {
-                    if (way.nodes().empty()) {
-                        continue;
-                    }
-                    auto const *it = way.nodes().begin();
-                    if (way.is_closed()) {
-                        ++it;
-                    }
-                    for (; it != way.nodes().end(); ++it) {
-                        if (in_way.get(it->positive_ref())) {
-                            in_multiple_ways.set(it->positive_ref());
-                        } else {
-                            in_way.set(it->positive_ref());
-                        }
-                    }
-                }
-            }
-            reader1.close();
+        if (scratch_directory.empty()) {
+            scratch_directory = output_directory;
         }
 
-        vout << "Reading segments...\n";
+        RunStats stats{"odmt-duplicate-segments"};
+        stats.add_input_file(input_filename);
 
-        std::vector<node_pair> segments;
+        auto const input_file = make_input_file(input_filename, input);
 
-        osmium::io::Reader reader2{input_file, osmium::osm_entity_bits::way};
-        while (auto const buffer = reader2.read()) {
-            for (auto const &way : buffer.select<osmium::Way>()) {
-                if (way.nodes().size() > 1) {
-                    auto const *it = way.nodes().begin();
-                    for (++it; it != way.nodes().end(); ++it) {
-                        auto const id1 = (it - 1)->ref();
-                        auto const id2 = it->ref();
-                        if (in_multiple_ways.get(id1) &&
-                            in_multiple_ways.get(id2)) {
-                            segments.emplace_back(id1, id2);
-                        }
-                    }
-                }
-            }
-        }
-        reader2.close();
+        osmium::VerboseOutput vout{true};
 
-        vout << "Got " << segments.size() << " segments\n";
+        constexpr std::size_t const mbyte = 1024UL * 1024UL;
+        sort_options options{scratch_directory, "segments",
+                             memory_limit * mbyte, std::max(num_threads, 1U)};
+        options.run_size = run_size;
+
+        // Everything that changes what is in a checkpoint.
+        std::string run{"odmt-duplicate-segments"};
+        if (locations) {
+            run += " --locations --grid " + std::to_string(grid);
+        } else if (one_pass) {
+            run += " --one-pass";
+        }
+        if (way_ids_min_count > 0) {
+            run += " --way-ids";
+        }
 
-        vout << "Sorting segments...\n";
-        std::sort(segments.begin(), segments.end());
+        Checkpoint checkpoint{checkpoint_directory, run, input_filename,
+                              checkpoint_interval};
+        if (checkpoint.enabled()) {
+            // Runs are part of the checkpoint, so they are written to the
+            // checkpoint directory and removed with the checkpoint.
+            options.scratch_directory = checkpoint_directory;
+            options.run_name = std::string{Checkpoint::file_prefix} +
+                               "-segments";
+            input.resumable = true;
+        }
+        if (checkpoint.resume()) {
+            vout << "Resuming from checkpoint in step " << checkpoint.step()
+                 << " at offset " << checkpoint.offset() << "...\n";
+        }
 
-        vout << "Counting segments...\n";
         std::ofstream ids{output_directory + "/ids"};
+        stats.add_output_file(output_directory + "/ids");
         counter counts;
-
-        constexpr std::size_t const min_count_for_output = 10;
-        for (auto it = segments.begin(); it != segments.end();) {
-            auto const a = std::adjacent_find(it, segments.end());
-            if (a == segments.end()) {
-                break;
+        if (way_ids_min_count > 0) {
+            using way_id_type = osmium::unsigned_object_id_type;
+            duplicate_ways ways{output_directory + "/way-ids.csv",
+                                std::max(way_ids_min_count, std::size_t{2})};
+            stats.add_output_file(output_directory + "/way-ids.csv");
+            if (locations) {
+                counts = count_locations<way_id_type>(
+                    input_file, input, options, grid, ids, &ways, &stats,
+                    &checkpoint, vout);
+            } else if (one_pass) {
+                counts = count_one_pass<way_id_type>(input_file, input,
+                                                     options, ids, &ways,
+                                                     &stats, &checkpoint, vout);
+            } else {
+                counts = count_two_pass<way_id_type>(input_file, input,
+                                                     options, ids, &ways,
+                                                     &stats, &checkpoint, vout);
             }
-            std::size_t count = 0;
-            it = a;
-            while (*a == *it) {
-                ++count;
-                ++it;
-                if (it == segments.end()) {
-                    break;
-                }
-            }
-            counts.increment(count - 1);
 
-            if (count >= min_count_for_output) {
-                ids << count << ' ' << it->first << ' ' << it->second << '\n';
+            stats.phase("write");
+            vout << "Writing ways with duplicate segments...\n";
+            write_ways(input_file, input, ways.way_ids(),
+                       output_directory + "/duplicate-ways.osm.pbf", output,
+                       &stats);
+        } else {
+            if (locations) {
+                counts = count_locations<no_payload>(
+                    input_file, input, options, grid, ids, nullptr, &stats,
+                    &checkpoint, vout);
+            } else if (one_pass) {
+                counts = count_one_pass<no_payload>(input_file, input, options,
+                                                    ids, nullptr, &stats,
+                                                    &checkpoint, vout);
+            } else {
+                counts = count_two_pass<no_payload>(input_file, input, options,
+                                                    ids, nullptr, &stats,
+                                                    &checkpoint, vout);
             }
-
-            it = a + count;
         }
+        ids.close();
+        checkpoint.remove();
 
         int n = 0;
         for (auto cc : counts) {
             std::cout << ++n << ' ' << cc << '\n';
         }
 
+        stats.write_json(stats_filename);
+
         vout << "Done.\n";
     } catch (std::exception const &e) {
         std::cerr << "ERROR: " << e.what() << "\n";
@@ -0,0 +1,637 @@
+#pragma once
+
+#include "radix-sort.hpp"
+#include "serialize.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <istream>
+#include <memory>
+#include <numeric>
+#include <ostream>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+template <typename TKey>
+void sort_records(TKey *first, TKey *last, no_payload * /*payload*/,
+                  unsigned int /*num_threads*/)
+{
+    std::sort(first, last);
+}
+
+/**
+ * Sort keys and move the payload along. This sorts a permutation and then
+ * applies it to both arrays in place. The permutation needs an extra
+ * std::size_t for each record (see ExternalSorter::record_size()).
+ */
+template <typename TKey, typename TPayload>
+void sort_records(TKey *first, TKey *last, TPayload *payload,
+                  unsigned int /*num_threads*/)
+{
+    std::vector<std::size_t> perm(static_cast<std::size_t>(last - first));
+    std::iota(perm.begin(), perm.end(), 0);
+    std::sort(perm.begin(), perm.end(), [&](std::size_t a, std::size_t b) {
+        return first[a] < first[b];
+    });
+
+    for (std::size_t i = 0; i < perm.size(); ++i) {
+        if (perm[i] == i) {
+            continue;
+        }
+        auto key = first[i];
+        auto value = payload[i];
+        auto j = i;
+        while (perm[j] != i) {
+            auto const k = perm[j];
+            first[j] = first[k];
+            payload[j] = payload[k];
+            perm[j] = j;
+            j = k;
+        }
+        first[j] = key;
+        payload[j] = value;
+        perm[j] = j;
+    }
+}
+
+inline void sort_records(std::uint64_t *first, std::uint64_t *last,
+                         no_payload * /*payload*/, unsigned int num_threads)
+{
+    radix_sort(first, last, num_threads);
+}
+
+inline void sort_records(std::uint64_t *first, std::uint64_t *last,
+                         std::uint64_t *payload, unsigned int num_threads)
+{
+    radix_sort(first, last, payload, num_threads);
+}
+
+/**
+ * Reads a range of records from a run file written by the ExternalSorter.
+ * While the records of one block are consumed, the next block is read in
+ * the background.
+ */
+template <typename T>
+class RunReader
+{
+
+    std::FILE *m_file;
+    std::size_t m_block_size;
+    std::size_t m_remaining;
+    std::vector<T> m_data;
+    std::size_t m_pos = 0;
+    std::future<std::vector<T>> m_prefetch;
+
+    std::vector<T> read_block()
+    {
+        std::vector<T> data(std::min(m_block_size, m_remaining));
+        auto const n = std::fread(data.data(), sizeof(T), data.size(), m_file);
+        if (n != data.size()) {
+            throw std::runtime_error{"Error reading run file"};
+        }
+        m_remaining -= n;
+        return data;
+    }
+
+    void start_prefetch()
+    {
+        m_prefetch = std::async(std::launch::async,
+                                [this]() { return read_block(); });
+    }
+
+public:
+    /**
+     * Read count records starting at byte offset from the file.
+     */
+    RunReader(std::string const &file_name, long offset, std::size_t count,
+              std::size_t block_size)
+    : m_file(std::fopen(file_name.c_str(), "rb")), m_block_size(block_size),
+      m_remaining(count)
+    {
+        if (!m_file) {
+            throw std::runtime_error{"Could not open file '" + file_name +
+                                     "'"};
+        }
+        if (std::fseek(m_file, offset, SEEK_SET) != 0) {
+            std::fclose(m_file);
+            throw std::runtime_error{"Could not seek in file '" + file_name +
+                                     "'"};
+        }
+        m_data = read_block();
+        if (m_remaining > 0) {
+            start_prefetch();
+        }
+    }
+
+    RunReader(RunReader const &) = delete;
+    RunReader &operator=(RunReader const &) = delete;
+
+    RunReader(RunReader &&) = delete;
+    RunReader &operator=(RunReader &&) = delete;
+
+    ~RunReader() noexcept
+    {
+        if (m_prefetch.valid()) {
+            m_prefetch.wait();
+        }
+        std::fclose(m_file);
+    }
+
+    [[nodiscard]] bool empty() const noexcept { return m_pos == m_data.size(); }
+
+    [[nodiscard]] T const &front() const noexcept
+    {
+        assert(!empty());
+        return m_data[m_pos];
+    }
+
+    void pop()
+    {
+        assert(!empty());
+        if (++m_pos == m_data.size() && m_prefetch.valid()) {
+            m_data = m_prefetch.get();
+            m_pos = 0;
+            if (m_remaining > 0) {
+                start_prefetch();
+            }
+        }
+    }
+
+}; // class RunReader
+
+/**
+ * Writes records to a run file starting at a byte offset. Used when runs
+ * are merged into a larger run.
+ */
+template <typename T>
+class RunWriter
+{
+
+    std::FILE *m_file;
+    std::string m_file_name;
+
+public:
+    /**
+     * Open the file with the mode given (as in std::fopen) and start
+     * writing at byte offset.
+     */
+    RunWriter(std::string file_name, char const *mode, long offset)
+    : m_file(std::fopen(file_name.c_str(), mode)),
+      m_file_name(std::move(file_name))
+    {
+        if (!m_file) {
+            throw std::runtime_error{"Could not open file '" + m_file_name +
+                                     "'"};
+        }
+        if (std::fseek(m_file, offset, SEEK_SET) != 0) {
+            std::fclose(m_file);
+            throw std::runtime_error{"Could not seek in file '" +
+                                     m_file_name + "'"};
+        }
+    }
+
+    RunWriter(RunWriter const &) = delete;
+    RunWriter &operator=(RunWriter const &) = delete;
+
+    RunWriter(RunWriter &&) = delete;
+    RunWriter &operator=(RunWriter &&) = delete;
+
+    ~RunWriter() noexcept
+    {
+        if (m_file) {
+            std::fclose(m_file);
+        }
+    }
+
+    void write(T const &value)
+    {
+        if (std::fwrite(&value, sizeof(T), 1, m_file) != 1) {
+            throw std::runtime_error{"Error writing file '" + m_file_name +
+                                     "'"};
+        }
+    }
+
+    void close()
+    {
+        auto *file = m_file;
+        m_file = nullptr;
+        if (std::fclose(file) != 0) {
+            throw std::runtime_error{"Error writing file '" + m_file_name +
+                                     "'"};
+        }
+    }
+
+}; // class RunWriter
+
+/**
+ * Sort any number of records using a fixed amount of memory. Records are
+ * collected in memory. When the buffer is full, it is sorted and written
+ * out to a "run" file in the scratch directory. At the end all runs are
+ * merged.
+ *
+ * Records consist of a key and an optional payload. Keys and payloads are
+ * stored in separate arrays, so the (radix) sort works on compact keys.
+ * In the run files all keys are followed by all payloads.
+ *
+ * If max_records is 0, everything is kept in memory and no files are
+ * written (unless the sorter is saved).
+ *
+ * When merging, each run needs a block of keys (and payloads) being merged
+ * and a block being read in the background. All those blocks together use
+ * at most merge_memory bytes. If there are too many runs to give each of
+ * them blocks of a reasonable size, groups of runs are merged into larger
+ * runs first, until few enough runs are left.
+ */
+template <typename TKey, typename TPayload = no_payload>
+class ExternalSorter
+{
+
+    static_assert(std::is_trivially_copyable<TKey>::value,
+                  "Keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<TPayload>::value,
+                  "Payloads must be trivially copyable");
+
+    static constexpr bool const has_payload =
+        !std::is_same<TPayload, no_payload>::value;
+
+    // Sorting keys with payload needs a permutation, unless both are
+    // 64 bit integers, those are radix sorted in place.
+    static constexpr bool const sort_needs_permutation =
+        has_payload && !(std::is_same<TKey, std::uint64_t>::value &&
+                         std::is_same<TPayload, std::uint64_t>::value);
+
+    // Number of bytes read from each run file in one go.
+    static constexpr std::size_t const read_block_bytes = 1024UL * 1024UL;
+
+    // Runs are merged in several passes if their blocks would get smaller
+    // than this.
+    static constexpr std::size_t const min_read_block_bytes = 64UL * 1024UL;
+
+    // Number of arrays read from each run: keys and maybe payloads.
+    static constexpr std::size_t const streams_per_run = has_payload ? 2 : 1;
+
+    struct run
+    {
+        std::string file_name;
+        std::size_t size;
+        bool saved; // part of a saved state, don't remove
+    };
+
+    std::string m_file_prefix;
+    std::vector<run> m_runs;
+    std::vector<TKey> m_keys;
+    std::vector<TPayload> m_payloads;
+    std::size_t m_max_records;
+    std::size_t m_merge_memory;
+    std::uint64_t m_size = 0;
+    std::size_t m_num_run_files = 0;
+    unsigned int m_num_threads;
+
+    // The runs before this one are known to be on disk.
+    std::size_t m_synced_runs = 0;
+
+    void sort_buffer()
+    {
+        sort_records(m_keys.data(), m_keys.data() + m_keys.size(),
+                     has_payload ? m_payloads.data() : nullptr,
+                     m_num_threads);
+    }
+
+    template <typename T>
+    static void write(std::FILE *file, std::vector<T> const &data,
+                      std::string const &file_name)
+    {
+        auto const n = std::fwrite(data.data(), sizeof(T), data.size(), file);
+        if (n != data.size()) {
+            std::fclose(file);
+            throw std::runtime_error{"Error writing file '" + file_name + "'"};
+        }
+    }
+
+    void write_run()
+    {
+        sort_buffer();
+
+        auto file_name = new_run_file_name();
+        std::FILE *file = std::fopen(file_name.c_str(), "wb");
+        if (!file) {
+            throw std::runtime_error{"Could not open file '" + file_name +
+                                     "'"};
+        }
+        m_runs.push_back({file_name, m_keys.size(), false});
+
+        write(file, m_keys, file_name);
+        if constexpr (has_payload) {
+            write(file, m_payloads, file_name);
+        }
+        if (std::fclose(file) != 0) {
+            throw std::runtime_error{"Error writing file '" + file_name + "'"};
+        }
+
+        m_keys.clear();
+        m_payloads.clear();
+    }
+
+    std::string new_run_file_name()
+    {
+        return m_file_prefix + std::to_string(m_num_run_files++);
+    }
+
+    /**
+     * The number of bytes in each block read from a run when merging
+     * num_runs runs at once.
+     */
+    [[nodiscard]] std::size_t block_bytes(std::size_t num_runs) const noexcept
+    {
+        if (m_merge_memory == 0) {
+            return read_block_bytes;
+        }
+        return std::min(read_block_bytes,
+                        m_merge_memory / (2 * streams_per_run * num_runs));
+    }
+
+    /// The max number of runs merged at once.
+    [[nodiscard]] std::size_t max_fan_in() const noexcept
+    {
+        if (m_merge_memory == 0) {
+            return m_runs.size();
+        }
+        return std::max<std::size_t>(
+            2, m_merge_memory / (2 * streams_per_run * min_read_block_bytes));
+    }
+
+    template <typename T>
+    static std::size_t block_records(std::size_t bytes) noexcept
+    {
+        return std::max<std::size_t>(1, bytes / sizeof(T));
+    }
+
+    /**
+     * Call func with each key (and payload if there is one) of the runs in
+     * sorted order.
+     */
+    template <typename TFunc>
+    void merge_runs(std::vector<run> const &runs, TFunc &&func) const
+    {
+        auto const bytes = block_bytes(runs.size());
+
+        std::vector<std::unique_ptr<RunReader<TKey>>> keys;
+        std::vector<std::unique_ptr<RunReader<TPayload>>> payloads;
+        keys.reserve(runs.size());
+        for (auto const &r : runs) {
+            keys.push_back(std::make_unique<RunReader<TKey>>(
+                r.file_name, 0, r.size, block_records<TKey>(bytes)));
+            if constexpr (has_payload) {
+                payloads.push_back(std::make_unique<RunReader<TPayload>>(
+                    r.file_name, static_cast<long>(r.size * sizeof(TKey)),
+                    r.size, block_records<TPayload>(bytes)));
+            }
+        }
+
+        using entry = std::pair<TKey, std::size_t>;
+        auto const greater = [](entry const &a, entry const &b) {
+            return b.first < a.first;
+        };
+        std::priority_queue<entry, std::vector<entry>, decltype(greater)>
+            queue{greater};
+
+        for (std::size_t n = 0; n < keys.size(); ++n) {
+            if (!keys[n]->empty()) {
+                queue.emplace(keys[n]->front(), n);
+            }
+        }
+
+        while (!queue.empty()) {
+            auto const [key, n] = queue.top();
+            queue.pop();
+            if constexpr (has_payload) {
+                func(key, payloads[n]->front());
+                payloads[n]->pop();
+            } else {
+                func(key);
+            }
+            auto &reader = *keys[n];
+            reader.pop();
+            if (!reader.empty()) {
+                queue.emplace(reader.front(), n);
+            }
+        }
+    }
+
+    /// Merge the runs into a new run.
+    run merge_into_run(std::vector<run> const &runs)
+    {
+        std::size_t size = 0;
+        for (auto const &r : runs) {
+            size += r.size;
+        }
+
+        auto file_name = new_run_file_name();
+        RunWriter<TKey> keys{file_name, "wb", 0};
+        if constexpr (has_payload) {
+            RunWriter<TPayload> payloads{
+                file_name, "r+b", static_cast<long>(size * sizeof(TKey))};
+            merge_runs(runs, [&](TKey const &key, TPayload const &payload) {
+                keys.write(key);
+                payloads.write(payload);
+            });
+            payloads.close();
+        } else {
+            merge_runs(runs, [&](TKey const &key) { keys.write(key); });
+        }
+        keys.close();
+
+        return {std::move(file_name), size, false};
+    }
+
+    /**
+     * Merge groups of runs into larger runs until they can all be merged
+     * at once. Runs that are part of a saved state are kept, because a
+     * resumed program needs them.
+     */
+    void reduce_runs()
+    {
+        auto const fan_in = max_fan_in();
+        while (m_runs.size() > fan_in) {
+            std::vector<run> runs;
+            for (std::size_t first = 0; first < m_runs.size();
+                 first += fan_in) {
+                auto const last = std::min(first + fan_in, m_runs.size());
+                std::vector<run> group(
+                    m_runs.begin() + static_cast<std::ptrdiff_t>(first),
+                    m_runs.begin() + static_cast<std::ptrdiff_t>(last));
+                if (group.size() == 1) {
+                    runs.push_back(std::move(group.front()));
+                    continue;
+                }
+                runs.push_back(merge_into_run(group));
+                for (auto const &r : group) {
+                    if (!r.saved) {
+                        std::remove(r.file_name.c_str());
+                    }
+                }
+            }
+            m_runs = std::move(runs);
+        }
+    }
+
+    void make_room()
+    {
+        if (m_max_records > 0 && m_keys.size() == m_max_records) {
+            write_run();
+        }
+        ++m_size;
+    }
+
+public:
+    /**
+     * Run files are written to the specified directory with names
+     * starting with the name prefix followed by the process ID. Use
+     * merge_memory bytes for reading runs when merging (0 for 1 MB blocks
+     * from all runs).
+     */
+    ExternalSorter(std::string const &directory, std::string const &name,
+                   std::size_t max_records, std::size_t merge_memory,
+                   unsigned int num_threads)
+    : m_file_prefix(directory + "/" + name + "-" + std::to_string(::getpid()) +
+                    "-run-"),
+      m_max_records(max_records), m_merge_memory(merge_memory),
+      m_num_threads(num_threads)
+    {
+        m_keys.reserve(max_records);
+        if constexpr (has_payload) {
+            m_payloads.reserve(max_records);
+        }
+    }
+
+    ExternalSorter(ExternalSorter const &) = delete;
+    ExternalSorter &operator=(ExternalSorter const &) = delete;
+
+    ExternalSorter(ExternalSorter &&) = delete;
+    ExternalSorter &operator=(ExternalSorter &&) = delete;
+
+    ~ExternalSorter() noexcept
+    {
+        for (auto const &r : m_runs) {
+            if (!r.saved) {
+                std::remove(r.file_name.c_str());
+            }
+        }
+    }
+
+    /// The number of bytes needed for each record in memory when sorting.
+    static constexpr std::size_t record_size() noexcept
+    {
+        return sizeof(TKey) + (has_payload ? sizeof(TPayload) : 0) +
+               (sort_needs_permutation ? sizeof(std::size_t) : 0);
+    }
+
+    void add(TKey const &key)
+    {
+        static_assert(!has_payload, "Payload needed");
+        make_room();
+        m_keys.push_back(key);
+    }
+
+    void add(TKey const &key, TPayload const &payload)
+    {
+        static_assert(has_payload, "No payload allowed");
+        make_room();
+        m_keys.push_back(key);
+        m_payloads.push_back(payload);
+    }
+
+    /// The number of records added.
+    [[nodiscard]] std::uint64_t size() const noexcept { return m_size; }
+
+    /// The number of run files written so far.
+    [[nodiscard]] std::size_t num_runs() const noexcept
+    {
+        return m_runs.size();
+    }
+
+    /**
+     * Write the state of the sorter to out, so that it can be restored
+     * with load(), possibly in another process. The records in memory are
+     * written out as a run first. All run files are synced to disk, so that
+     * the saved state never refers to incomplete runs after a crash. From
+     * then on, the run files are not removed by the destructor, because
+     * they belong to the saved state.
+     */
+    void save(std::ostream &out)
+    {
+        if (!m_keys.empty()) {
+            write_run();
+        }
+
+        for (; m_synced_runs < m_runs.size(); ++m_synced_runs) {
+            sync_file(m_runs[m_synced_runs].file_name);
+        }
+        for (auto &r : m_runs) {
+            r.saved = true;
+        }
+
+        write_varint(out, m_size);
+        write_varint(out, m_runs.size());
+        for (auto const &r : m_runs) {
+            write_string(out, r.file_name);
+            write_varint(out, r.size);
+        }
+    }
+
+    /// Restore the state written by save() into an empty sorter.
+    void load(std::istream &in)
+    {
+        assert(m_runs.empty() && m_keys.empty());
+
+        m_size = read_varint(in);
+        auto const num_runs = read_varint(in);
+        for (std::uint64_t n = 0; n < num_runs; ++n) {
+            auto file_name = read_string(in);
+            auto const size = static_cast<std::size_t>(read_varint(in));
+            m_runs.push_back({std::move(file_name), size, true});
+        }
+        m_synced_runs = m_runs.size();
+    }
+
+    /**
+     * Call func with each key (and payload if there is one) in sorted
+     * order. This can only be called once.
+     */
+    template <typename TFunc>
+    void merge(TFunc &&func)
+    {
+        if (m_runs.empty()) {
+            sort_buffer();
+            for (std::size_t i = 0; i < m_keys.size(); ++i) {
+                if constexpr (has_payload) {
+                    func(m_keys[i], m_payloads[i]);
+                } else {
+                    func(m_keys[i]);
+                }
+            }
+            return;
+        }
+
+        if (!m_keys.empty()) {
+            write_run();
+        }
+        m_keys.shrink_to_fit();
+        m_payloads.shrink_to_fit();
+
+        reduce_runs();
+        merge_runs(m_runs, std::forward<TFunc>(func));
+    }
+
+}; // class ExternalSorter
@@ -1,8 +1,12 @@
-
 #include "filter.hpp"
 
+#include "default-filter-patterns.hpp"
+
 #include <osmium/util/string.hpp>
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <fstream>
 #include <stdexcept>
 #include <string>
@@ -21,30 +25,30 @@ static void strip_whitespace(std::string *string)
     }
 }
 
-static osmium::StringMatcher get_string_matcher(std::string string)
+static string_pattern get_string_pattern(std::string string)
 {
     strip_whitespace(&string);
 
     if (string.size() == 1 && string.front() == '*') {
-        return osmium::StringMatcher::always_true{};
+        return {string_pattern::kind::any, {}};
     }
 
     if (string.empty() || (string.back() != '*' && string.front() != '*')) {
         if (string.find(',') == std::string::npos) {
-            return osmium::StringMatcher::equal{string};
+            return {string_pattern::kind::equal, {string}};
         }
         auto sstrings = osmium::split_string(string, ',');
         for (auto &s : sstrings) {
             strip_whitespace(&s);
         }
-        return osmium::StringMatcher::list{sstrings};
+        return {string_pattern::kind::equal, sstrings};
     }
 
     auto s = string;
 
     if (s.back() == '*' && s.front() != '*') {
         s.pop_back();
-        return osmium::StringMatcher::prefix{s};
+        return {string_pattern::kind::prefix, {s}};
     }
 
     if (s.front() == '*') {
@@ -55,14 +59,14 @@ static osmium::StringMatcher get_string_matcher(std::string string)
         s.pop_back();
     }
 
-    return osmium::StringMatcher::substring{s};
+    return {string_pattern::kind::substring, {s}};
 }
 
-static osmium::TagMatcher get_tag_matcher(std::string const &expression)
+static filter_rule get_filter_rule(std::string const &expression)
 {
     auto const op_pos = expression.find('=');
     if (op_pos == std::string::npos) {
-        return osmium::TagMatcher{get_string_matcher(expression)};
+        return {get_string_pattern(expression), {}, false};
     }
 
     auto key = expression.substr(0, op_pos);
@@ -74,18 +78,17 @@ static osmium::TagMatcher get_tag_matcher(std::string const &expression)
         invert = true;
     }
 
-    return osmium::TagMatcher{get_string_matcher(key),
-                              get_string_matcher(value), invert};
+    return {get_string_pattern(key), get_string_pattern(value), invert};
 }
 
-osmium::TagsFilter load_filter_patterns(std::string const &file_name)
+std::vector<filter_rule> read_filter_rules(std::string const &file_name)
 {
     std::ifstream file{file_name};
     if (!file.is_open()) {
         throw std::runtime_error{"Could not open file '" + file_name + "'"};
     }
 
-    osmium::TagsFilter filter{false};
+    std::vector<filter_rule> rules;
 
     for (std::string line; std::getline(file, line);) {
         auto const pos = line.find_first_of('#');
@@ -96,9 +99,280 @@ osmium::TagsFilter load_filter_patterns(std::string const &file_name)
             if (line.back() == '\r') {
                 line.resize(line.size() - 1);
             }
-            filter.add_rule(true, get_tag_matcher(line));
+            rules.push_back(get_filter_rule(line));
+        }
+    }
+
+    return rules;
+}
+
+std::vector<filter_rule> default_filter_rules(std::string const &name)
+{
+    for (auto const *set = default_pattern_sets; set->name; ++set) {
+        if (name == set->name) {
+            std::vector<filter_rule> rules;
+            for (auto const *e = set->expressions; *e; ++e) {
+                rules.push_back(get_filter_rule(*e));
+            }
+            return rules;
         }
     }
 
+    throw std::runtime_error{"Unknown default filter patterns '" + name + "'"};
+}
+
+static osmium::StringMatcher get_string_matcher(string_pattern const &pattern)
+{
+    switch (pattern.type) {
+    case string_pattern::kind::any:
+        return osmium::StringMatcher::always_true{};
+    case string_pattern::kind::equal:
+        if (pattern.strings.size() == 1) {
+            return osmium::StringMatcher::equal{pattern.strings.front()};
+        }
+        return osmium::StringMatcher::list{pattern.strings};
+    case string_pattern::kind::prefix:
+        return osmium::StringMatcher::prefix{pattern.strings.front()};
+    case string_pattern::kind::substring:
+        break;
+    }
+    return osmium::StringMatcher::substring{pattern.strings.front()};
+}
+
+osmium::TagsFilter make_tags_filter(std::vector<filter_rule> const &rules)
+{
+    osmium::TagsFilter filter{false};
+
+    for (auto const &rule : rules) {
+        filter.add_rule(true,
+                        osmium::TagMatcher{get_string_matcher(rule.key),
+                                           get_string_matcher(rule.value),
+                                           rule.invert});
+    }
+
     return filter;
 }
+
+osmium::TagsFilter load_filter_patterns(std::string const &file_name)
+{
+    return make_tags_filter(read_filter_rules(file_name));
+}
+
+static bool match_string(string_pattern const &pattern,
+                         char const *string) noexcept
+{
+    switch (pattern.type) {
+    case string_pattern::kind::any:
+        return true;
+    case string_pattern::kind::equal:
+        return std::any_of(pattern.strings.cbegin(), pattern.strings.cend(),
+                           [&](std::string const &s) {
+                               return !std::strcmp(string, s.c_str());
+                           });
+    case string_pattern::kind::prefix:
+        return !std::strncmp(string, pattern.strings.front().c_str(),
+                             pattern.strings.front().size());
+    case string_pattern::kind::substring:
+        break;
+    }
+    return std::strstr(string, pattern.strings.front().c_str()) != nullptr;
+}
+
+bool CompiledTagsFilter::rule_list::match(char const *value) const noexcept
+{
+    return any_value ||
+           std::any_of(rules.cbegin(), rules.cend(), [&](value_rule const &r) {
+               return match_string(r.value, value) != r.invert;
+           });
+}
+
+std::uint32_t CompiledTagsFilter::child(std::vector<node> const &nodes,
+                                        std::uint32_t n, char c) noexcept
+{
+    for (auto const &ch : nodes[n].children) {
+        if (ch.first == c) {
+            return ch.second;
+        }
+    }
+    return none;
+}
+
+std::uint32_t CompiledTagsFilter::add_string(std::vector<node> *nodes,
+                                             std::string const &string)
+{
+    std::uint32_t n = 0;
+    for (char const c : string) {
+        auto next = child(*nodes, n, c);
+        if (next == none) {
+            next = static_cast<std::uint32_t>(nodes->size());
+            nodes->emplace_back();
+            (*nodes)[n].children.emplace_back(c, next);
+        }
+        n = next;
+    }
+    return n;
+}
+
+std::uint32_t CompiledTagsFilter::add_rule_list(std::uint32_t *index)
+{
+    if (*index == none) {
+        *index = static_cast<std::uint32_t>(m_rule_lists.size());
+        m_rule_lists.emplace_back();
+    }
+    return *index;
+}
+
+/**
+ * Fill in the failure links of the Aho-Corasick automaton and the output
+ * links which point to the next node on the failure chain that has rules
+ * attached. Nodes are visited in breadth-first order so the failure links
+ * of all shorter strings are already known.
+ */
+void CompiledTagsFilter::build_automaton()
+{
+    std::vector<std::uint32_t> queue;
+    for (auto const &ch : m_automaton[0].children) {
+        queue.push_back(ch.second);
+    }
+
+    for (std::size_t i = 0; i < queue.size(); ++i) {
+        auto const u = queue[i];
+
+        auto const f = m_automaton[u].fail;
+        m_automaton[u].output =
+            m_automaton[f].rules != none ? f : m_automaton[f].output;
+
+        for (auto const &ch : m_automaton[u].children) {
+            queue.push_back(ch.second);
+            if (u == 0) {
+                continue;
+            }
+            auto state = m_automaton[u].fail;
+            auto next = child(m_automaton, state, ch.first);
+            while (next == none && state != 0) {
+                state = m_automaton[state].fail;
+                next = child(m_automaton, state, ch.first);
+            }
+            m_automaton[ch.second].fail = next == none ? 0 : next;
+        }
+    }
+}
+
+CompiledTagsFilter::CompiledTagsFilter() : m_trie(1), m_automaton(1) {}
+
+CompiledTagsFilter::CompiledTagsFilter(std::vector<filter_rule> const &rules)
+: CompiledTagsFilter()
+{
+    for (auto const &rule : rules) {
+        std::vector<std::uint32_t> lists;
+
+        auto const &strings = rule.key.strings;
+        switch (rule.key.type) {
+        case string_pattern::kind::any:
+            lists.push_back(add_rule_list(&m_any_key));
+            break;
+        case string_pattern::kind::equal:
+            for (auto const &key : strings) {
+                auto it = m_exact.find(key);
+                if (it == m_exact.end()) {
+                    m_keys.push_back(key);
+                    it = m_exact.emplace(m_keys.back(), none).first;
+                }
+                lists.push_back(add_rule_list(&it->second));
+            }
+            break;
+        case string_pattern::kind::prefix: {
+            auto const n = add_string(&m_trie, strings.front());
+            lists.push_back(add_rule_list(&m_trie[n].rules));
+        } break;
+        case string_pattern::kind::substring:
+            if (strings.front().empty()) {
+                lists.push_back(add_rule_list(&m_any_key));
+            } else {
+                auto const n = add_string(&m_automaton, strings.front());
+                lists.push_back(add_rule_list(&m_automaton[n].rules));
+            }
+            break;
+        }
+
+        for (auto const index : lists) {
+            auto &list = m_rule_lists[index];
+            if (rule.value.type == string_pattern::kind::any && !rule.invert) {
+                list.any_value = true;
+            } else {
+                list.rules.push_back({rule.value, rule.invert});
+            }
+        }
+    }
+
+    build_automaton();
+}
+
+bool CompiledTagsFilter::match_prefix(char const *key,
+                                      char const *value) const noexcept
+{
+    std::uint32_t n = 0;
+    if (match(m_trie[n].rules, value)) {
+        return true;
+    }
+
+    for (; *key != '\0'; ++key) {
+        n = child(m_trie, n, *key);
+        if (n == none) {
+            return false;
+        }
+        if (match(m_trie[n].rules, value)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CompiledTagsFilter::match_substring(char const *key,
+                                         char const *value) const noexcept
+{
+    std::uint32_t state = 0;
+    for (; *key != '\0'; ++key) {
+        auto next = child(m_automaton, state, *key);
+        while (next == none && state != 0) {
+            state = m_automaton[state].fail;
+            next = child(m_automaton, state, *key);
+        }
+        state = next == none ? 0 : next;
+
+        for (auto n = state; n != none; n = m_automaton[n].output) {
+            if (match(m_automaton[n].rules, value)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool CompiledTagsFilter::operator()(char const *key,
+                                    char const *value) const noexcept
+{
+    if (match(m_any_key, value)) {
+        return true;
+    }
+
+    if (!m_exact.empty()) {
+        auto const it = m_exact.find(key);
+        if (it != m_exact.end() && match(it->second, value)) {
+            return true;
+        }
+    }
+
+    if (m_trie.size() > 1 && match_prefix(key, value)) {
+        return true;
+    }
+
+    return m_automaton.size() > 1 && match_substring(key, value);
+}
+
+CompiledTagsFilter load_compiled_filter_patterns(std::string const &file_name)
+{
+    return CompiledTagsFilter{read_filter_rules(file_name)};
+}
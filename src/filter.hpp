@@ -1,5 +1,150 @@
 #pragma once
 
+#include <osmium/osm/tag.hpp>
 #include <osmium/tags/tags_filter.hpp>
 
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * How a key or value in a filter expression is matched. A list of strings
+ * ("foo,bar") is an "equal" pattern with several strings.
+ */
+struct string_pattern
+{
+    enum class kind
+    {
+        any,
+        equal,
+        prefix,
+        substring
+    };
+
+    kind type = kind::any;
+    std::vector<std::string> strings;
+};
+
+/// One line from a filter expressions file.
+struct filter_rule
+{
+    string_pattern key;
+    string_pattern value;
+    bool invert = false;
+};
+
+std::vector<filter_rule> read_filter_rules(std::string const &file_name);
+
+/**
+ * Get the rules from one of the files in the filter-patterns directory
+ * (for instance "meta-tags"). They are built into the program, so this
+ * doesn't need any file access.
+ *
+ * @throws std::runtime_error if there is no such set of rules.
+ */
+std::vector<filter_rule> default_filter_rules(std::string const &name);
+
+/// Build an osmium::TagsFilter matching if any of the rules match.
+osmium::TagsFilter make_tags_filter(std::vector<filter_rule> const &rules);
+
 osmium::TagsFilter load_filter_patterns(std::string const &file_name);
+
+/**
+ * A filter built from filter rules that answers the question "does any
+ * rule match this tag" without testing all rules one after the other like
+ * the osmium::TagsFilter does. Exact keys are looked up in a hash map,
+ * prefix keys ("foo:*") in a trie and substring keys ("*foo*") with an
+ * Aho-Corasick automaton. Only the (few) rules with a matching key have
+ * their value checked.
+ */
+class CompiledTagsFilter
+{
+
+    static constexpr std::uint32_t const none = 0xffffffffU;
+
+    struct value_rule
+    {
+        string_pattern value;
+        bool invert;
+    };
+
+    struct rule_list
+    {
+        bool any_value = false;
+        std::vector<value_rule> rules;
+
+        [[nodiscard]] bool match(char const *value) const noexcept;
+    };
+
+    struct node
+    {
+        std::vector<std::pair<char, std::uint32_t>> children;
+        std::uint32_t rules = none;
+
+        // only used in the Aho-Corasick automaton
+        std::uint32_t fail = 0;
+        std::uint32_t output = none;
+    };
+
+    std::vector<rule_list> m_rule_lists;
+
+    // Storage for the keys in m_exact. A deque never moves its elements,
+    // so the string views stay valid.
+    std::deque<std::string> m_keys;
+    std::unordered_map<std::string_view, std::uint32_t> m_exact;
+
+    std::vector<node> m_trie;
+    std::vector<node> m_automaton;
+    std::uint32_t m_any_key = none;
+
+    static std::uint32_t child(std::vector<node> const &nodes,
+                               std::uint32_t n, char c) noexcept;
+
+    static std::uint32_t add_string(std::vector<node> *nodes,
+                                    std::string const &string);
+
+    std::uint32_t add_rule_list(std::uint32_t *index);
+
+    void build_automaton();
+
+    [[nodiscard]] bool match(std::uint32_t index,
+                             char const *value) const noexcept
+    {
+        return index != none && m_rule_lists[index].match(value);
+    }
+
+    [[nodiscard]] bool match_prefix(char const *key,
+                                    char const *value) const noexcept;
+
+    [[nodiscard]] bool match_substring(char const *key,
+                                       char const *value) const noexcept;
+
+public:
+    /// Create an empty filter which doesn't match anything.
+    CompiledTagsFilter();
+
+    explicit CompiledTagsFilter(std::vector<filter_rule> const &rules);
+
+    CompiledTagsFilter(CompiledTagsFilter const &) = delete;
+    CompiledTagsFilter &operator=(CompiledTagsFilter const &) = delete;
+
+    CompiledTagsFilter(CompiledTagsFilter &&) = default;
+    CompiledTagsFilter &operator=(CompiledTagsFilter &&) = default;
+
+    ~CompiledTagsFilter() noexcept = default;
+
+    [[nodiscard]] bool operator()(char const *key,
+                                  char const *value) const noexcept;
+
+    [[nodiscard]] bool operator()(osmium::Tag const &tag) const noexcept
+    {
+        return operator()(tag.key(), tag.value());
+    }
+
+}; // class CompiledTagsFilter
+
+CompiledTagsFilter load_compiled_filter_patterns(std::string const &file_name);
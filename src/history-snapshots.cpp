@@ -0,0 +1,35 @@
+#include "history-snapshots.hpp"
+
+#include <osmium/osm/object_comparisons.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+HistorySnapshots::HistorySnapshots(std::vector<osmium::Timestamp> timestamps)
+: m_timestamps(std::move(timestamps)),
+  m_buffer(1024, osmium::memory::Buffer::auto_grow::yes)
+{
+    std::sort(m_timestamps.begin(), m_timestamps.end());
+    m_timestamps.erase(std::unique(m_timestamps.begin(), m_timestamps.end()),
+                       m_timestamps.end());
+}
+
+osmium::OSMObject const &HistorySnapshots::pending() const
+{
+    return m_buffer.get<osmium::OSMObject>(0);
+}
+
+void HistorySnapshots::keep(osmium::OSMObject const &object)
+{
+    if (m_pending &&
+        !osmium::object_order_type_id_version{}(pending(), object)) {
+        throw std::runtime_error{
+            "Input must be a history file sorted by type, ID, and version"};
+    }
+
+    m_buffer.clear();
+    m_buffer.add_item(object);
+    m_buffer.commit();
+    m_pending = true;
+}
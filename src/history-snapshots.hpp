@@ -0,0 +1,97 @@
+#pragma once
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/timestamp.hpp>
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Finds the version of each object from a history file that was current
+ * at each of a list of points in time (the snapshots). The versions must
+ * come in the order of a history file: sorted by type, ID, and version.
+ *
+ * A version is current from its timestamp until the timestamp of the next
+ * version of the same object. The last version stays current. Deleted
+ * versions are not current in any snapshot, so objects are only in the
+ * snapshots in which they existed.
+ *
+ * Each version is only known to be complete when the next version (or
+ * another object) arrives, so the last version seen is kept in a buffer of
+ * its own until then.
+ */
+class HistorySnapshots
+{
+
+    std::vector<osmium::Timestamp> m_timestamps;
+    osmium::memory::Buffer m_buffer;
+    bool m_pending = false;
+
+    [[nodiscard]] osmium::OSMObject const &pending() const;
+
+    /// Remember the version until the next one arrives.
+    void keep(osmium::OSMObject const &object);
+
+    /**
+     * Call func(snapshot, version) for all snapshots in which the version
+     * was current. If until is nullptr, the version is the last one.
+     */
+    template <typename TFunc>
+    void emit(osmium::OSMObject const &version,
+              osmium::Timestamp const *until, TFunc &&func) const
+    {
+        if (!version.visible()) {
+            return;
+        }
+        for (std::size_t i = 0; i < m_timestamps.size(); ++i) {
+            if (version.timestamp() <= m_timestamps[i] &&
+                (!until || m_timestamps[i] < *until)) {
+                func(i, version);
+            }
+        }
+    }
+
+public:
+    /// The timestamps are sorted, duplicates are removed.
+    explicit HistorySnapshots(std::vector<osmium::Timestamp> timestamps);
+
+    /// The timestamps of the snapshots in order.
+    [[nodiscard]] std::vector<osmium::Timestamp> const &
+    timestamps() const noexcept
+    {
+        return m_timestamps;
+    }
+
+    /**
+     * Add the next version of an object. Calls func(snapshot, version)
+     * for each snapshot in which the version added before was current.
+     *
+     * @throws std::runtime_error if the versions are not in order.
+     */
+    template <typename TFunc>
+    void add(osmium::OSMObject const &object, TFunc &&func)
+    {
+        if (m_pending) {
+            auto const &last = pending();
+            if (last.type() == object.type() && last.id() == object.id()) {
+                auto const until = object.timestamp();
+                emit(last, &until, func);
+            } else {
+                emit(last, nullptr, func);
+            }
+        }
+        keep(object);
+    }
+
+    /// Call func for the last version after all versions are added.
+    template <typename TFunc>
+    void finish(TFunc &&func)
+    {
+        if (m_pending) {
+            emit(pending(), nullptr, func);
+            m_pending = false;
+        }
+    }
+
+}; // class HistorySnapshots
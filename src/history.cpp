@@ -0,0 +1,327 @@
+/*
+
+OSM Data Model Tools
+
+history
+
+Copyright (C) 2018-2022  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "history-snapshots.hpp"
+#include "input-reader.hpp"
+#include "limits-analysis.hpp"
+#include "line-or-polygon-analysis.hpp"
+#include "output-pool.hpp"
+#include "run-stats.hpp"
+#include "tag-stats-analysis.hpp"
+
+#include <osmium/io/any_input.hpp>
+#include <osmium/util/string.hpp>
+#include <osmium/util/verbose_output.hpp>
+
+#include <lyra.hpp>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+static char const *const all_analyses = "limits,tag-stats,line-or-polygon";
+
+/// The analyses for one point in time and the number of objects in it.
+struct snapshot
+{
+    std::string directory;
+    std::vector<std::unique_ptr<std::ofstream>> reports;
+    std::vector<std::unique_ptr<Analysis>> analyses;
+    std::uint64_t nodes = 0;
+    std::uint64_t ways = 0;
+    std::uint64_t relations = 0;
+};
+
+/**
+ * Open a file for the report of an analysis that the single tool would
+ * write to stdout.
+ */
+static std::unique_ptr<std::ofstream> open_report(std::string const &dir,
+                                                  std::string const &name,
+                                                  RunStats *stats)
+{
+    auto file_name = dir + "/" + name + ".txt";
+    stats->add_output_file(file_name);
+    auto out = std::make_unique<std::ofstream>(file_name);
+    if (!out->is_open()) {
+        throw std::runtime_error{"Could not open file '" + file_name + "'"};
+    }
+    return out;
+}
+
+static void create_directory(std::string const &directory)
+{
+    if (::mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+        throw std::runtime_error{"Could not create directory '" + directory +
+                                 "'"};
+    }
+}
+
+static void add_analysis(snapshot *s, std::string const &name,
+                         line_or_polygon_options const &lp_options,
+                         OutputPool *output_pool, RunStats *stats)
+{
+    if (name == "limits") {
+        s->analyses.push_back(std::make_unique<LimitsAnalysis>(
+            s->directory, limits_options{}, output_pool));
+    } else if (name == "tag-stats") {
+        s->reports.push_back(open_report(s->directory, name, stats));
+        s->analyses.push_back(std::make_unique<TagStatsAnalysis>(
+            tag_stats_options{}, s->reports.back().get()));
+    } else if (name == "line-or-polygon") {
+        s->reports.push_back(open_report(s->directory, name, stats));
+        s->analyses.push_back(std::make_unique<LineOrPolygonAnalysis>(
+            s->directory, lp_options, output_pool, s->reports.back().get()));
+    }
+}
+
+/**
+ * Write the number of objects in each snapshot as CSV file. There are only
+ * columns for the types of objects read for the analyses.
+ */
+static void write_counts(std::string const &file_name,
+                         osmium::osm_entity_bits::type entities,
+                         std::vector<osmium::Timestamp> const &timestamps,
+                         std::vector<snapshot> const &snapshots)
+{
+    std::ofstream out{file_name};
+    if (!out.is_open()) {
+        throw std::runtime_error{"Could not open file '" + file_name + "'"};
+    }
+
+    bool const nodes = entities & osmium::osm_entity_bits::node;
+    bool const ways = entities & osmium::osm_entity_bits::way;
+    bool const relations = entities & osmium::osm_entity_bits::relation;
+
+    out << "timestamp" << (nodes ? ",nodes" : "") << (ways ? ",ways" : "")
+        << (relations ? ",relations" : "") << '\n';
+    for (std::size_t i = 0; i < snapshots.size(); ++i) {
+        auto const &s = snapshots[i];
+        out << timestamps[i].to_iso();
+        if (nodes) {
+            out << ',' << s.nodes;
+        }
+        if (ways) {
+            out << ',' << s.ways;
+        }
+        if (relations) {
+            out << ',' << s.relations;
+        }
+        out << '\n';
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    try {
+        std::string input_filename;
+        std::string stats_filename;
+        std::vector<std::string> timestamp_strings;
+        input_options input;
+        output_options output;
+        std::string output_directory{"."};
+        std::string analyses{all_analyses};
+        line_or_polygon_options lp_options;
+        bool help = false;
+
+        // clang-format off
+        auto const cli
+            = lyra::opt(timestamp_strings, "TIMESTAMP")
+                ["-t"]["--timestamp"]
+                ("create snapshot at TIMESTAMP (like 2008-01-01T00:00:00Z, can be given several times)")
+            | lyra::opt(output_directory, "DIR")
+                ["-o"]["--output-dir"]
+                ("output directory (default: cwd)")
+            | lyra::opt(analyses, "LIST")
+                ["-a"]["--analyses"]
+                ("comma-separated list of analyses (default: all)")
+            | lyra::opt(lp_options.expressions_directory, "DIR")
+                ["-e"]["--expressions-dir"]
+                ("directory with expression files (default: built-in)")
+            | lyra::opt(input.format, "FORMAT")
+                ["--input-format"]
+                ("format of input file (needed for STDIN)")
+            | lyra::opt(input.mmap)
+                ["--mmap"]
+                ("memory map PBF input file")
+            | lyra::opt(output.compression, "COMPRESSION")
+                ["--output-compression"]
+                ("compression of PBF output files (none, lz4, zlib[:LEVEL])")
+            | lyra::opt(output.threads, "N")
+                ["--output-threads"]
+                ("number of threads encoding output (default: all cores)")
+            | lyra::opt(output.memory, "MB")
+                ["--output-memory"]
+                ("memory for output not yet encoded (default: 256)")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
+            | lyra::help(help)
+            | lyra::arg(input_filename, "FILENAME")
+                ("input history file");
+        // clang-format on
+
+        auto const result = cli.parse(lyra::args(argc, argv));
+        if (!result) {
+            std::cerr << "Error in command line: " << result.message() << '\n';
+            return 1;
+        }
+
+        if (help) {
+            std::cout << cli
+                      << "\nRun analyses on snapshots at several points in "
+                         "time in one pass over a history file."
+                      << "\nAvailable analyses: " << all_analyses << '\n';
+            return 0;
+        }
+
+        if (input_filename.empty()) {
+            std::cerr << "Missing input filename. Try '-h'.\n";
+            return 1;
+        }
+
+        if (timestamp_strings.empty()) {
+            std::cerr << "Missing timestamp. Try '-h'.\n";
+            return 1;
+        }
+
+        std::vector<osmium::Timestamp> timestamps;
+        for (auto const &str : timestamp_strings) {
+            try {
+                timestamps.emplace_back(str.c_str());
+            } catch (std::invalid_argument const &) {
+                std::cerr << "Invalid timestamp '" << str << "'.\n";
+                return 1;
+            }
+        }
+
+        auto const names = osmium::split_string(analyses, ',', true);
+        if (names.empty()) {
+            std::cerr << "No analyses enabled. Try '-h'.\n";
+            return 1;
+        }
+        for (auto const &name : names) {
+            if (name != "limits" && name != "tag-stats" &&
+                name != "line-or-polygon") {
+                std::cerr << "Unknown analysis '" << name << "'. Try '-h'.\n";
+                return 1;
+            }
+        }
+
+        RunStats stats{"odmt-history"};
+        stats.add_input_file(input_filename);
+
+        HistorySnapshots history{timestamps};
+
+        // All analyses of all snapshots share the output pool, it must
+        // outlive them.
+        OutputPool output_pool{output};
+        std::vector<snapshot> snapshots(history.timestamps().size());
+        for (std::size_t i = 0; i < snapshots.size(); ++i) {
+            auto &s = snapshots[i];
+            s.directory = output_directory + "/" +
+                          history.timestamps()[i].to_iso();
+            create_directory(s.directory);
+            for (auto const &name : names) {
+                add_analysis(&s, name, lp_options, &output_pool, &stats);
+            }
+        }
+
+        osmium::osm_entity_bits::type entities =
+            osmium::osm_entity_bits::nothing;
+        for (auto const &analysis : snapshots.front().analyses) {
+            entities |= analysis->entities();
+        }
+
+        auto const add_to_snapshot = [&](std::size_t n,
+                                         osmium::OSMObject const &object) {
+            auto &s = snapshots[n];
+            switch (object.type()) {
+            case osmium::item_type::node:
+                ++s.nodes;
+                break;
+            case osmium::item_type::way:
+                ++s.ways;
+                break;
+            case osmium::item_type::relation:
+                ++s.relations;
+                break;
+            default:
+                break;
+            }
+            auto const bit =
+                osmium::osm_entity_bits::from_item_type(object.type());
+            for (auto const &analysis : s.analyses) {
+                if (analysis->entities() & bit) {
+                    analysis->object(object);
+                }
+            }
+        };
+
+        osmium::VerboseOutput vout{true};
+
+        auto const input_file = make_input_file(input_filename, input);
+        InputReader reader{input_file, entities, input};
+
+        vout << "Reading input...\n";
+        stats.phase("process");
+        while (auto const buffer = stats.read(&reader)) {
+            for (auto const &object : buffer.select<osmium::OSMObject>()) {
+                history.add(object, add_to_snapshot);
+            }
+        }
+        history.finish(add_to_snapshot);
+        reader.close();
+
+        vout << "Writing results...\n";
+        stats.phase("write");
+        for (auto &s : snapshots) {
+            for (auto const &analysis : s.analyses) {
+                analysis->finish();
+                stats.add_output_files(analysis->output_files());
+            }
+            s.reports.clear();
+        }
+
+        auto const counts_filename = output_directory + "/snapshots.csv";
+        write_counts(counts_filename, entities, history.timestamps(),
+                     snapshots);
+        stats.add_output_file(counts_filename);
+        stats.write_json(stats_filename);
+
+        vout << "Done.\n";
+    } catch (std::exception const &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
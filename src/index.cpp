@@ -0,0 +1,98 @@
+/*
+
+OSM Data Model Tools
+
+index
+
+Copyright (C) 2018-2022  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "pbf-index.hpp"
+#include "run-stats.hpp"
+
+#include <lyra.hpp>
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+
+int main(int argc, char *argv[])
+{
+    try {
+        std::string input_filename;
+        std::string stats_filename;
+        bool help = false;
+
+        // clang-format off
+        auto const cli
+            = lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
+            | lyra::help(help)
+            | lyra::arg(input_filename, "FILENAME")
+                ("input file (must be a PBF file)");
+        // clang-format on
+
+        auto const result = cli.parse(lyra::args(argc, argv));
+        if (!result) {
+            std::cerr << "Error in command line: " << result.message() << '\n';
+            return 1;
+        }
+
+        if (help) {
+            std::cout << cli << "\nCreate index of the blobs in a PBF file.\n";
+            return 0;
+        }
+
+        if (input_filename.empty()) {
+            std::cerr << "Missing input filename. Try '-h'.\n";
+            return 1;
+        }
+
+        RunStats stats{"odmt-index"};
+        stats.add_input_file(input_filename);
+
+        stats.phase("process");
+        auto const blobs = build_pbf_index(input_filename);
+
+        stats.phase("write");
+        write_pbf_index(input_filename, blobs);
+        stats.add_output_file(pbf_index_file_name(input_filename));
+
+        std::uint64_t bytes = 0;
+        std::uint64_t way_relation_bytes = 0;
+        for (auto const &blob : blobs) {
+            bytes += blob.size;
+            if (blob.entities & (osmium::osm_entity_bits::way |
+                                 osmium::osm_entity_bits::relation)) {
+                way_relation_bytes += blob.size;
+            }
+        }
+
+        std::cout << "Blobs: " << blobs.size() << '\n'
+                  << "Bytes in blobs: " << bytes << '\n'
+                  << "Bytes in blobs with ways or relations: "
+                  << way_relation_bytes << '\n';
+
+        stats.write_json(stats_filename);
+    } catch (std::exception const &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,304 @@
+#include "input-reader.hpp"
+
+#include "osmium-internals.hpp"
+
+#include <osmium/io/file_compression.hpp>
+#include <osmium/io/file_format.hpp>
+#include <osmium/thread/pool.hpp>
+
+#include <protozero/data_view.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Seed for choosing the blobs in a sample.
+static constexpr std::uint64_t const sample_seed = 0x6f646d7473616d70ULL;
+
+// Set when the first reader for STDIN is opened.
+static bool stdin_opened = false;
+
+static std::uintptr_t page_size() noexcept
+{
+    static std::uintptr_t const size =
+        static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+static bool is_stdin_file(osmium::io::File const &file) noexcept
+{
+    return file.filename().empty() || file.filename() == "-";
+}
+
+static bool is_pbf_file(osmium::io::File const &file) noexcept
+{
+    return file.format() == osmium::io::file_format::pbf &&
+           file.compression() == osmium::io::file_compression::none &&
+           !is_stdin_file(file);
+}
+
+/**
+ * Decide whether the blob at this offset is in the sample. The offset is
+ * hashed (with the splitmix64 finalizer), so the choice doesn't depend on
+ * which other blobs are read (for instance because of an index) and is
+ * the same everywhere.
+ */
+static bool in_sample(std::uint64_t offset, double rate) noexcept
+{
+    std::uint64_t z = offset + sample_seed;
+    z = (z ^ (z >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27U)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31U;
+
+    // Use the top 53 bits as a number between 0 and 1.
+    return static_cast<double>(z >> 11U) * 0x1.0p-53 < rate;
+}
+
+osmium::io::File make_input_file(std::string const &file_name,
+                                 input_options const &options)
+{
+    if (is_stdin(file_name) && options.format.empty()) {
+        throw std::runtime_error{"Reading from STDIN needs --input-format"};
+    }
+    return osmium::io::File{file_name, options.format};
+}
+
+/// Parse a number of shards or a shard number, returns false if invalid.
+static bool parse_shard_number(std::string const &str, unsigned int *value)
+{
+    if (str.empty() || str.size() > 6 ||
+        str.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    *value = static_cast<unsigned int>(std::stoul(str));
+    return true;
+}
+
+void parse_shard(std::string const &str, input_options *options)
+{
+    auto const slash = str.find('/');
+    if (slash == std::string::npos ||
+        !parse_shard_number(str.substr(0, slash), &options->shard) ||
+        !parse_shard_number(str.substr(slash + 1), &options->shards) ||
+        options->shard >= options->shards) {
+        throw std::runtime_error{"Invalid shard '" + str +
+                                 "' (must be I/N with 0 <= I < N)"};
+    }
+}
+
+InputReader::InputReader(osmium::io::File const &file,
+                         osmium::osm_entity_bits::type entities,
+                         input_options const &options)
+: m_entities(entities)
+{
+    bool const sampling = options.sample < 1.0;
+    if (!(options.sample > 0.0 && options.sample <= 1.0)) {
+        throw std::runtime_error{"Sample rate must be between 0 and 1"};
+    }
+
+    bool const sharded = options.shards > 1;
+    if (options.shard >= options.shards) {
+        throw std::runtime_error{"Shard must be smaller than shards"};
+    }
+
+    if (is_pbf_file(file)) {
+        bool const filtered = (entities & osmium::osm_entity_bits::nwr) !=
+                              osmium::osm_entity_bits::nwr;
+        bool const indexed = (filtered || sampling) &&
+                             read_pbf_index(file.filename(), &m_blobs);
+        bool const by_blob = options.mmap || sampling || sharded ||
+                             options.resumable || options.start_offset > 0;
+        if (!indexed && by_blob) {
+            m_blobs = scan_pbf_blobs(file.filename());
+        }
+
+        if (indexed || by_blob) {
+            select_blobs(options);
+            m_file = std::make_unique<PBFFile>(file.filename());
+            if (options.mmap) {
+                map_file();
+            }
+            return;
+        }
+    }
+
+    if (sampling) {
+        throw std::runtime_error{
+            "Sampling only works with uncompressed PBF files"};
+    }
+
+    if (sharded) {
+        throw std::runtime_error{
+            "Sharding only works with uncompressed PBF files"};
+    }
+
+    if (options.start_offset > 0) {
+        throw std::runtime_error{
+            "Resuming only works with uncompressed PBF files"};
+    }
+
+    // A second reader would silently get nothing.
+    if (is_stdin_file(file)) {
+        if (stdin_opened) {
+            throw std::runtime_error{
+                "Can not read STDIN more than once, use an input file"};
+        }
+        stdin_opened = true;
+    }
+
+    m_reader = std::make_unique<osmium::io::Reader>(file, entities);
+}
+
+InputReader::~InputReader() noexcept { stop(); }
+
+/**
+ * Remove all blobs we don't need (including those before the start offset
+ * and those of other shards) and set the types of objects to decode from
+ * each blob. Blobs not in the sample are still read if they can contain
+ * objects of types that are not sampled. What the blobs contain is only
+ * known from an index, without one we have to assume anything.
+ *
+ * Shards are based on the position of the blob among all blobs in the
+ * file, so they are the same with or without an index.
+ */
+void InputReader::select_blobs(input_options const &options)
+{
+    auto const not_sampled = m_entities & ~options.sample_entities;
+
+    std::vector<pbf_blob_info> blobs;
+    for (std::size_t i = 0; i < m_blobs.size(); ++i) {
+        if (i % options.shards != options.shard) {
+            continue;
+        }
+        auto blob = m_blobs[i];
+        auto const contents = blob.entities == osmium::osm_entity_bits::nothing
+                                  ? osmium::osm_entity_bits::all
+                                  : blob.entities;
+        blob.entities = in_sample(blob.offset, options.sample) ? m_entities
+                                                               : not_sampled;
+        if ((contents & blob.entities) &&
+            blob.offset >= options.start_offset) {
+            blobs.push_back(blob);
+        }
+    }
+
+    m_blobs = std::move(blobs);
+}
+
+void InputReader::map_file()
+{
+    m_map_size = static_cast<std::size_t>(m_file->size());
+    if (m_map_size == 0) {
+        return;
+    }
+
+    void *map =
+        ::mmap(nullptr, m_map_size, PROT_READ, MAP_SHARED, m_file->fd(), 0);
+    if (map == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        throw std::runtime_error{"Could not memory map file '" +
+                                 m_file->name() + "'"};
+    }
+    ::madvise(map, m_map_size, MADV_SEQUENTIAL);
+    m_map = static_cast<char const *>(map);
+}
+
+/**
+ * Hand blobs to the thread pool for decoding until there are enough blobs
+ * in flight. The futures are kept in file order. Blobs are either read
+ * from the file or, if it is memory mapped, decoded in place. In that
+ * case the kernel is told that we'll soon need the blob, which matters if
+ * blobs are skipped and the sequential read-ahead doesn't help.
+ */
+void InputReader::submit_blobs()
+{
+    auto &pool = osmium::thread::Pool::default_instance();
+    std::size_t const max_in_flight =
+        static_cast<std::size_t>(pool.num_threads()) * 2;
+
+    while (m_queue.size() < max_in_flight && m_next_blob < m_blobs.size()) {
+        auto const &blob = m_blobs[m_next_blob++];
+        if (m_map) {
+            char const *data = m_map + blob.offset;
+            auto const start = reinterpret_cast<std::uintptr_t>(data) &
+                               ~(page_size() - 1);
+            ::madvise(reinterpret_cast<void *>(start),
+                      reinterpret_cast<std::uintptr_t>(data) - start +
+                          blob.size,
+                      MADV_WILLNEED);
+            m_queue.push_back(
+                pool.submit([view = protozero::data_view{data, blob.size},
+                             entities = blob.entities]() {
+                    return decode_pbf_blob(view, entities);
+                }));
+        } else {
+            m_queue.push_back(
+                pool.submit([data = m_file->read(blob.offset, blob.size),
+                             entities = blob.entities]() mutable {
+                    return decode_pbf_blob(std::move(data), entities, true);
+                }));
+        }
+    }
+}
+
+osmium::memory::Buffer InputReader::read()
+{
+    if (m_reader) {
+        return m_reader->read();
+    }
+
+    while (true) {
+        submit_blobs();
+        if (m_queue.empty()) {
+            return osmium::memory::Buffer{};
+        }
+        auto buffer = m_queue.front().get();
+        m_queue.pop_front();
+        ++m_done_blobs;
+
+        // Blobs can contain objects of several types, if all of them were
+        // filtered out, the buffer is empty.
+        if (buffer.committed() > 0) {
+            return buffer;
+        }
+    }
+}
+
+std::uint64_t InputReader::offset() const noexcept
+{
+    assert(direct());
+    if (m_done_blobs < m_blobs.size()) {
+        return m_blobs[m_done_blobs].offset;
+    }
+    return m_file->size();
+}
+
+void InputReader::close()
+{
+    if (m_reader) {
+        m_reader->close();
+    } else {
+        stop();
+    }
+}
+
+void InputReader::stop() noexcept
+{
+    // Decoding tasks still running might use the mapping, so wait for
+    // them before unmapping.
+    for (auto const &future : m_queue) {
+        future.wait();
+    }
+    m_queue.clear();
+    m_next_blob = m_blobs.size();
+
+    if (m_map) {
+        ::munmap(const_cast<char *>(m_map), m_map_size);
+        m_map = nullptr;
+    }
+}
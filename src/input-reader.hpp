@@ -0,0 +1,161 @@
+#pragma once
+
+#include "pbf-index.hpp"
+
+#include <osmium/io/file.hpp>
+#include <osmium/io/reader.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/entity_bits.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct input_options
+{
+    // Format of the input file as understood by libosmium (like "pbf",
+    // "opl", or "osm.bz2"). Empty to detect it from the file name, which
+    // doesn't work when reading from STDIN.
+    std::string format;
+
+    // Memory map PBF input files instead of reading them.
+    bool mmap = false;
+
+    // Only read this fraction of the blobs of PBF files. The blobs are
+    // chosen randomly, but always the same for the same file.
+    double sample = 1.0;
+
+    // Only blobs with objects of these types are sampled, objects of
+    // other types are always read.
+    osmium::osm_entity_bits::type sample_entities =
+        osmium::osm_entity_bits::all;
+
+    // Only read every shards-th blob of PBF files, starting with blob
+    // number shard (counting from 0). Several runs with different shards
+    // together read every blob exactly once.
+    unsigned int shard = 0;
+    unsigned int shards = 1;
+
+    // Read PBF files blob by blob, so that offset() can be used to resume
+    // reading later.
+    bool resumable = false;
+
+    // Only read the blobs of PBF files at or after this offset.
+    std::uint64_t start_offset = 0;
+};
+
+/**
+ * The file to read with the format from the options. The file name "-"
+ * is STDIN.
+ *
+ * @throws std::runtime_error if reading from STDIN without a format.
+ */
+osmium::io::File make_input_file(std::string const &file_name,
+                                 input_options const &options);
+
+/**
+ * Set the shard options from a string like "2/8" (shard 2 of 8 shards,
+ * counting from 0).
+ *
+ * @throws std::runtime_error if the string is not a valid shard.
+ */
+void parse_shard(std::string const &str, input_options *options);
+
+/// Is the file name the one for STDIN ("-")?
+[[nodiscard]] inline bool is_stdin(std::string const &file_name) noexcept
+{
+    return file_name == "-";
+}
+
+/**
+ * Reads OSM data like the osmium::io::Reader. If the input is a PBF file
+ * which has an up-to-date blob index (created by odmt-index) and not all
+ * types of objects are needed, only the blobs containing objects of the
+ * needed types are read and decoded, all others are skipped without even
+ * reading them from disk.
+ *
+ * With the mmap option PBF files are memory mapped. The blob boundaries
+ * are found up front (or taken from the index) and the blobs are decoded
+ * straight from the mapping in the osmium thread pool without copying
+ * them first.
+ *
+ * With the sample option only a random sample of the blobs is read. This
+ * only works for PBF files. Each blob becomes one buffer, so the buffers
+ * can be used as blocks for estimating the error of the results.
+ *
+ * With the shard options only every N-th blob is read. This also only
+ * works for PBF files.
+ *
+ * With the resumable option PBF files are also read blob by blob. The
+ * offset() of the reader can then be given as start_offset to a later
+ * reader to continue after the last buffer read.
+ *
+ * In all other cases this falls back to the normal osmium::io::Reader.
+ *
+ * Buffers are always returned in the order they are in the file. The
+ * header of the file is not available.
+ *
+ * STDIN can only be read once in a program. Programs reading their input
+ * several times need a file.
+ */
+class InputReader
+{
+
+    std::unique_ptr<osmium::io::Reader> m_reader;
+
+    std::unique_ptr<PBFFile> m_file;
+    char const *m_map = nullptr;
+    std::size_t m_map_size = 0;
+
+    // The blobs to read. Their entities are the types of objects to decode
+    // from them, not the types they contain.
+    std::vector<pbf_blob_info> m_blobs;
+    std::size_t m_next_blob = 0;
+    std::size_t m_done_blobs = 0; // blobs returned from read() so far
+    std::deque<std::future<osmium::memory::Buffer>> m_queue;
+    osmium::osm_entity_bits::type m_entities;
+
+    void select_blobs(input_options const &options);
+
+    void map_file();
+
+    void submit_blobs();
+
+    void stop() noexcept;
+
+public:
+    explicit InputReader(
+        osmium::io::File const &file,
+        osmium::osm_entity_bits::type entities = osmium::osm_entity_bits::all,
+        input_options const &options = {});
+
+    InputReader(InputReader const &) = delete;
+    InputReader &operator=(InputReader const &) = delete;
+
+    InputReader(InputReader &&) = delete;
+    InputReader &operator=(InputReader &&) = delete;
+
+    ~InputReader() noexcept;
+
+    /// Are blobs read directly instead of through the osmium::io::Reader?
+    [[nodiscard]] bool direct() const noexcept { return m_file != nullptr; }
+
+    /**
+     * Get the next buffer of data. Returns an invalid buffer at the end of
+     * the file.
+     */
+    osmium::memory::Buffer read();
+
+    /**
+     * The offset in the file to start reading at to get the buffers after
+     * the last one returned by read(). Only available if direct() is true.
+     */
+    [[nodiscard]] std::uint64_t offset() const noexcept;
+
+    void close();
+
+}; // class InputReader
@@ -0,0 +1,271 @@
+#include "limits-analysis.hpp"
+
+#include "serialize.hpp"
+
+#include <osmium/io/any_output.hpp>
+#include <osmium/osm/object_comparisons.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/way.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <stdexcept>
+#include <vector>
+
+static void increment(std::vector<SampledCount> *hist, std::size_t len,
+                      std::size_t block)
+{
+    if (hist->size() <= len) {
+        hist->resize(len + 1);
+    }
+    (*hist)[len].count(block);
+}
+
+/**
+ * Write histogram as CSV file with the columns length and count. If only
+ * a sample was read, the count is the estimate and there is a third
+ * column with the error.
+ */
+static void output_hist(std::string const &file_name,
+                        std::vector<SampledCount> const &hist, double rate)
+{
+    std::ofstream out{file_name};
+    for (std::size_t len = 0; len < hist.size(); ++len) {
+        if (rate >= 1.0) {
+            out << len << ',' << hist[len].get() << '\n';
+        } else {
+            auto const estimate = hist[len].estimate(rate);
+            out << len << ',' << std::llround(estimate.value) << ','
+                << std::llround(estimate.error) << '\n';
+        }
+    }
+}
+
+LimitsAnalysis::LimitsAnalysis(std::string const &output_directory,
+                               limits_options const &options,
+                               OutputPool *output)
+: m_output_directory(output_directory), m_options(options),
+  m_writer_key_length(output,
+                      output_file(output_directory + "/key-length.osm.pbf")),
+  m_writer_value_length(output,
+                        output_file(output_directory + "/value-length.osm.pbf")),
+  m_writer_role_length(output,
+                       output_file(output_directory + "/role-length.osm.pbf")),
+  m_writer_empty(output,
+                 output_file(output_directory + "/empty-key-or-value.osm.pbf")),
+  m_writer_tags_count(output,
+                      output_file(output_directory + "/tags-count.osm.pbf")),
+  m_writer_tags_bytes(output,
+                      output_file(output_directory + "/tags-bytes.osm.pbf"))
+{
+}
+
+std::tuple<std::size_t, std::size_t, std::size_t, std::size_t, bool>
+LimitsAnalysis::check_limits(osmium::OSMObject const &object)
+{
+    std::size_t max_len_keys = 0;
+    std::size_t max_len_values = 0;
+    std::size_t max_len_roles = 0;
+    std::size_t tags_bytes = 0;
+    bool empty_key_or_role = false;
+
+    for (auto const &tag : object.tags()) {
+        auto const len_key = std::strlen(tag.key());
+        auto const len_value = std::strlen(tag.value());
+
+        increment(&m_hist_keys, len_key, block());
+        increment(&m_hist_values, len_value, block());
+
+        tags_bytes += len_key;
+        tags_bytes += len_value;
+
+        if (len_key > max_len_keys) {
+            max_len_keys = len_key;
+        }
+        if (len_value > max_len_values) {
+            max_len_values = len_value;
+        }
+        if (len_key == 0 || len_value == 0) {
+            empty_key_or_role = true;
+        }
+    }
+
+    if (object.type() == osmium::item_type::way) {
+        increment(&m_hist_way_nodes,
+                  static_cast<osmium::Way const &>(object).nodes().size(),
+                  block());
+    } else if (object.type() == osmium::item_type::relation) {
+        auto const &members =
+            static_cast<osmium::Relation const &>(object).members();
+        increment(&m_hist_members, members.size(), block());
+        for (auto const &member : members) {
+            auto const len = std::strlen(member.role());
+
+            increment(&m_hist_roles, len, block());
+
+            if (len > max_len_roles) {
+                max_len_roles = len;
+            }
+        }
+    }
+
+    return {max_len_keys, max_len_values, max_len_roles, tags_bytes,
+            empty_key_or_role};
+}
+
+void LimitsAnalysis::object(osmium::OSMObject const &object)
+{
+    increment(&m_hist_tags_count, object.tags().size(), block());
+    if (object.tags().size() > m_options.max_tags_count) {
+        m_writer_tags_count(object);
+    }
+    auto [lk, lv, lr, tags_bytes, empty] = check_limits(object);
+    increment(&m_hist_tags_bytes, tags_bytes, block());
+    if (lk > m_options.max_key_length) {
+        m_writer_key_length(object);
+    }
+    if (lv > m_options.max_value_length) {
+        m_writer_value_length(object);
+    }
+    if (lr > m_options.max_role_length) {
+        m_writer_role_length(object);
+    }
+    if (tags_bytes > m_options.max_tags_bytes) {
+        m_writer_tags_bytes(object);
+    }
+    if (empty) {
+        m_writer_empty(object);
+    }
+}
+
+void LimitsAnalysis::finish()
+{
+    write_partial_objects();
+
+    m_writer_tags_bytes.close();
+    m_writer_tags_count.close();
+    m_writer_empty.close();
+    m_writer_role_length.close();
+    m_writer_value_length.close();
+    m_writer_key_length.close();
+
+    auto const hist_file = [&](char const *name) {
+        return output_file(m_output_directory + "/hist-" + name + ".csv");
+    };
+    auto const rate = sample_rate();
+    output_hist(hist_file("key-lengths"), m_hist_keys, rate);
+    output_hist(hist_file("value-lengths"), m_hist_values, rate);
+    output_hist(hist_file("role-lengths"), m_hist_roles, rate);
+    output_hist(hist_file("tags-count"), m_hist_tags_count, rate);
+    output_hist(hist_file("tags-bytes"), m_hist_tags_bytes, rate);
+    output_hist(hist_file("way-nodes-count"), m_hist_way_nodes, rate);
+    output_hist(hist_file("members-count"), m_hist_members, rate);
+}
+
+std::vector<std::uint64_t> LimitsAnalysis::partial_options() const
+{
+    return {m_options.max_key_length, m_options.max_value_length,
+            m_options.max_role_length, m_options.max_tags_count,
+            m_options.max_tags_bytes};
+}
+
+limits_options LimitsAnalysis::options_from_partial(
+    std::vector<std::uint64_t> const &options)
+{
+    if (options.size() != 5) {
+        throw std::runtime_error{"Invalid options in partial file"};
+    }
+    limits_options result;
+    result.max_key_length = static_cast<std::size_t>(options[0]);
+    result.max_value_length = static_cast<std::size_t>(options[1]);
+    result.max_role_length = static_cast<std::size_t>(options[2]);
+    result.max_tags_count = static_cast<std::size_t>(options[3]);
+    result.max_tags_bytes = static_cast<std::size_t>(options[4]);
+    return result;
+}
+
+void LimitsAnalysis::write_partial(std::ostream &out) const
+{
+    for (auto const *hist :
+         {&m_hist_keys, &m_hist_values, &m_hist_roles, &m_hist_way_nodes,
+          &m_hist_members, &m_hist_tags_count, &m_hist_tags_bytes}) {
+        write_varint(out, hist->size());
+        for (auto const &count : *hist) {
+            write_varint(out, count.get());
+        }
+    }
+
+    // The objects are written as they are in the buffer, so partial files
+    // can only be merged on machines with the same byte order.
+    for (auto const *writer :
+         {&m_writer_key_length, &m_writer_value_length, &m_writer_role_length,
+          &m_writer_empty, &m_writer_tags_count, &m_writer_tags_bytes}) {
+        auto const &buffer = writer->collected();
+        write_varint(out, buffer.committed());
+        out.write(reinterpret_cast<char const *>(buffer.data()),
+                  static_cast<std::streamsize>(buffer.committed()));
+    }
+}
+
+void LimitsAnalysis::read_partial(std::istream &in)
+{
+    for (auto *hist :
+         {&m_hist_keys, &m_hist_values, &m_hist_roles, &m_hist_way_nodes,
+          &m_hist_members, &m_hist_tags_count, &m_hist_tags_bytes}) {
+        auto const size = static_cast<std::size_t>(read_varint(in));
+        if (hist->size() < size) {
+            hist->resize(size);
+        }
+        for (std::size_t len = 0; len < size; ++len) {
+            (*hist)[len].count(block(), read_varint(in));
+        }
+    }
+
+    if (m_partial_objects.empty()) { // one buffer for each writer
+        for (int i = 0; i < 6; ++i) {
+            m_partial_objects.emplace_back(
+                1024, osmium::memory::Buffer::auto_grow::yes);
+        }
+    }
+    for (auto &buffer : m_partial_objects) {
+        auto const data = read_string(in);
+        std::memcpy(buffer.reserve_space(data.size()), data.data(),
+                    data.size());
+        buffer.commit();
+    }
+}
+
+/**
+ * Write the objects from the partial results sorted by type, ID, and
+ * version, which is the order of the input for sorted input files.
+ */
+void LimitsAnalysis::write_partial_objects()
+{
+    if (m_partial_objects.empty()) {
+        return;
+    }
+
+    std::size_t n = 0;
+    for (auto *writer :
+         {&m_writer_key_length, &m_writer_value_length, &m_writer_role_length,
+          &m_writer_empty, &m_writer_tags_count, &m_writer_tags_bytes}) {
+        std::vector<osmium::OSMObject const *> objects;
+        for (auto const &object :
+             m_partial_objects[n++].select<osmium::OSMObject>()) {
+            objects.push_back(&object);
+        }
+        std::stable_sort(objects.begin(), objects.end(),
+                         [](osmium::OSMObject const *a,
+                            osmium::OSMObject const *b) {
+                             return osmium::object_order_type_id_version{}(
+                                 *a, *b);
+                         });
+        for (auto const *object : objects) {
+            (*writer)(*object);
+        }
+    }
+    m_partial_objects.clear();
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "output-pool.hpp"
+#include "sample.hpp"
+
+#include <osmium/memory/buffer.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+struct limits_options
+{
+    std::size_t max_key_length = 63;
+    std::size_t max_value_length = 200;
+    std::size_t max_role_length = 63;
+    std::size_t max_tags_count = 50;
+    std::size_t max_tags_bytes = 1024;
+};
+
+/**
+ * Writes objects with unusually long keys, values, or roles, or unusually
+ * many tags into PBF files in the output directory. Histograms of all
+ * those lengths and counts are written as CSV files by finish(). If only
+ * a sample of the input was read, the histograms contain the estimated
+ * counts and their error.
+ *
+ * Without output pool the objects are only collected for write_partial().
+ */
+class LimitsAnalysis : public Analysis
+{
+
+    std::string m_output_directory;
+    limits_options m_options;
+
+    std::vector<SampledCount> m_hist_keys;
+    std::vector<SampledCount> m_hist_values;
+    std::vector<SampledCount> m_hist_roles;
+    std::vector<SampledCount> m_hist_way_nodes;
+    std::vector<SampledCount> m_hist_members;
+    std::vector<SampledCount> m_hist_tags_count;
+    std::vector<SampledCount> m_hist_tags_bytes;
+
+    PooledWriter m_writer_key_length;
+    PooledWriter m_writer_value_length;
+    PooledWriter m_writer_role_length;
+    PooledWriter m_writer_empty;
+    PooledWriter m_writer_tags_count;
+    PooledWriter m_writer_tags_bytes;
+
+    // The objects for each writer from partial results read with
+    // read_partial().
+    std::vector<osmium::memory::Buffer> m_partial_objects;
+
+    void write_partial_objects();
+
+public:
+    LimitsAnalysis(std::string const &output_directory,
+                   limits_options const &options,
+                   OutputPool *output);
+
+    /**
+     * Update the histograms for the object. Returns the maximum lengths of
+     * its keys, values, and roles, the number of bytes in its tags, and
+     * whether any key or value is empty.
+     */
+    std::tuple<std::size_t, std::size_t, std::size_t, std::size_t, bool>
+    check_limits(osmium::OSMObject const &object);
+
+    [[nodiscard]] osmium::osm_entity_bits::type
+    entities() const noexcept override
+    {
+        return osmium::osm_entity_bits::nwr;
+    }
+
+    void object(osmium::OSMObject const &object) override;
+
+    void finish() override;
+
+    /// The options as stored in the header of partial files.
+    [[nodiscard]] std::vector<std::uint64_t> partial_options() const;
+
+    /// @throws std::runtime_error if the options are invalid.
+    static limits_options
+    options_from_partial(std::vector<std::uint64_t> const &options);
+
+    /**
+     * Write the histograms and the objects collected (without output pool)
+     * for merging them with those of other shards.
+     */
+    void write_partial(std::ostream &out) const;
+
+    /**
+     * Add the histograms and objects written by write_partial(). The
+     * objects are written in finish() sorted by type, ID, and version.
+     */
+    void read_partial(std::istream &in);
+
+}; // class LimitsAnalysis
@@ -21,106 +21,32 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
 
+#include "input-reader.hpp"
+#include "limits-analysis.hpp"
+#include "output-pool.hpp"
+#include "partial-state.hpp"
+#include "run-stats.hpp"
+
 #include <osmium/io/any_input.hpp>
-#include <osmium/io/any_output.hpp>
 #include <osmium/util/verbose_output.hpp>
 
 #include <lyra.hpp>
 
-#include <cstdlib>
-#include <cstring>
 #include <exception>
-#include <fstream>
+#include <iostream>
 #include <string>
-#include <tuple>
-#include <utility>
-#include <vector>
-
-static std::vector<std::size_t> hist_keys;
-static std::vector<std::size_t> hist_values;
-static std::vector<std::size_t> hist_roles;
-static std::vector<std::size_t> hist_way_nodes;
-static std::vector<std::size_t> hist_members;
-
-void increment(std::vector<std::size_t> *hist, std::size_t len)
-{
-    if (hist->size() <= len) {
-        hist->resize(len + 1);
-    }
-    ++(*hist)[len];
-}
-
-void output_hist(std::string const &dir, char const *name,
-                 std::vector<std::size_t> const &hist)
-{
-    std::ofstream out{dir + "/hist-" + name + ".csv"};
-    for (std::size_t len = 0; len < hist.size(); ++len) {
-        out << len << ',' << hist[len] << '\n';
-    }
-}
-
-std::tuple<std::size_t, std::size_t, std::size_t, std::size_t, bool>
-check_limits(osmium::OSMObject const &object)
-{
-    std::size_t max_len_keys = 0;
-    std::size_t max_len_values = 0;
-    std::size_t max_len_roles = 0;
-    std::size_t tags_bytes = 0;
-    bool empty_key_or_role = false;
-
-    for (auto const &tag : object.tags()) {
-        auto const len_key = std::strlen(tag.key());
-        auto const len_value = std::strlen(tag.value());
-
-        increment(&hist_keys, len_key);
-        increment(&hist_values, len_value);
-
-        tags_bytes += len_key;
-        tags_bytes += len_value;
-
-        if (len_key > max_len_keys) {
-            max_len_keys = len_key;
-        }
-        if (len_value > max_len_values) {
-            max_len_values = len_value;
-        }
-        if (len_key == 0 || len_value == 0) {
-            empty_key_or_role = true;
-        }
-    }
-
-    if (object.type() == osmium::item_type::way) {
-        increment(&hist_way_nodes,
-                  static_cast<osmium::Way const &>(object).nodes().size());
-    } else if (object.type() == osmium::item_type::relation) {
-        auto const &members =
-            static_cast<osmium::Relation const &>(object).members();
-        increment(&hist_members, members.size());
-        for (auto const &member : members) {
-            auto const len = std::strlen(member.role());
-
-            increment(&hist_roles, len);
-
-            if (len > max_len_roles) {
-                max_len_roles = len;
-            }
-        }
-    }
-
-    return {max_len_keys, max_len_values, max_len_roles, tags_bytes,
-            empty_key_or_role};
-}
 
 int main(int argc, char *argv[])
 {
     try {
         std::string input_filename;
+        std::string stats_filename;
+        std::string shard;
+        std::string partial_filename;
+        input_options input;
+        output_options output;
         std::string output_directory{"."};
-        std::size_t max_key_length = 63;
-        std::size_t max_value_length = 200;
-        std::size_t max_role_length = 63;
-        std::size_t max_tags_count = 50;
-        std::size_t max_tags_bytes = 1024;
+        limits_options options;
         bool help = false;
 
         // clang-format off
@@ -128,21 +54,48 @@ int main(int argc, char *argv[])
             = lyra::opt(output_directory, "DIR")
                 ["-o"]["--output-dir"]
                 ("output directory (default: cwd)")
-            | lyra::opt(max_key_length, "LENGTH")
+            | lyra::opt(options.max_key_length, "LENGTH")
                 ["-k"]["--max-key-length"]
                 ("max key length (default: 63)")
-            | lyra::opt(max_value_length, "LENGTH")
+            | lyra::opt(options.max_value_length, "LENGTH")
                 ["-v"]["--max-value-length"]
                 ("max value length (default: 200)")
-            | lyra::opt(max_role_length, "LENGTH")
+            | lyra::opt(options.max_role_length, "LENGTH")
                 ["-r"]["--max-role-length"]
                 ("max role length (default: 63)")
-            | lyra::opt(max_tags_count, "COUNT")
+            | lyra::opt(options.max_tags_count, "COUNT")
                 ["-t"]["--max-tags-count"]
                 ("max tags count (default: 50)")
-            | lyra::opt(max_tags_bytes, "BYTES")
+            | lyra::opt(options.max_tags_bytes, "BYTES")
                 ["-b"]["--max-tags-bytes"]
                 ("max tags bytes (default: 1024)")
+            | lyra::opt(input.sample, "RATE")
+                ["--sample"]
+                ("only read this fraction of the PBF blobs and estimate results (default: 1)")
+            | lyra::opt(shard, "I/N")
+                ["--shard"]
+                ("only read every N-th PBF blob starting with blob I (counting from 0, needs --partial-out)")
+            | lyra::opt(partial_filename, "FILE")
+                ["--partial-out"]
+                ("write partial results to FILE for odmt-merge instead of the output files")
+            | lyra::opt(input.format, "FORMAT")
+                ["--input-format"]
+                ("format of input file (needed for STDIN)")
+            | lyra::opt(input.mmap)
+                ["--mmap"]
+                ("memory map PBF input file")
+            | lyra::opt(output.compression, "COMPRESSION")
+                ["--output-compression"]
+                ("compression of PBF output files (none, lz4, zlib[:LEVEL])")
+            | lyra::opt(output.threads, "N")
+                ["--output-threads"]
+                ("number of threads encoding output (default: all cores)")
+            | lyra::opt(output.memory, "MB")
+                ["--output-memory"]
+                ("memory for output not yet encoded (default: 256)")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
             | lyra::help(help)
             | lyra::arg(input_filename, "FILENAME")
                 ("input file");
@@ -165,75 +118,57 @@ int main(int argc, char *argv[])
             return 1;
         }
 
-        std::vector<std::size_t> hist_tags_count;
-        std::vector<std::size_t> hist_tags_bytes;
+        if (!partial_filename.empty() && input.sample < 1.0) {
+            std::cerr << "Option --partial-out can't be used with --sample.\n";
+            return 1;
+        }
+
+        if (!shard.empty()) {
+            if (partial_filename.empty()) {
+                std::cerr << "Option --shard needs --partial-out.\n";
+                return 1;
+            }
+            parse_shard(shard, &input);
+        }
 
-        osmium::io::File input_file{input_filename};
+        RunStats stats{"odmt-limits"};
+        stats.add_input_file(input_filename);
+
+        auto const input_file = make_input_file(input_filename, input);
 
         osmium::VerboseOutput vout{true};
 
-        osmium::io::Reader reader{input_file};
-        osmium::io::Writer writer_key_length{output_directory +
-                                                 "/key-length.osm.pbf",
-                                             osmium::io::overwrite::allow};
-        osmium::io::Writer writer_value_length{output_directory +
-                                                   "/value-length.osm.pbf",
-                                               osmium::io::overwrite::allow};
-        osmium::io::Writer writer_role_length{output_directory +
-                                                  "/role-length.osm.pbf",
-                                              osmium::io::overwrite::allow};
-        osmium::io::Writer writer_empty{output_directory +
-                                            "/empty-key-or-value.osm.pbf",
-                                        osmium::io::overwrite::allow};
-        osmium::io::Writer writer_tags_count{output_directory +
-                                                 "/tags-count.osm.pbf",
-                                             osmium::io::overwrite::allow};
-        osmium::io::Writer writer_tags_bytes{output_directory +
-                                                 "/tags-bytes.osm.pbf",
-                                             osmium::io::overwrite::allow};
-
-        while (auto const buffer = reader.read()) {
+        // For partial results the objects are only collected, the output
+        // files are written by odmt-merge.
+        OutputPool output_pool{output};
+        LimitsAnalysis analysis{output_directory, options,
+                                partial_filename.empty() ? &output_pool
+                                                         : nullptr};
+        analysis.set_sample_rate(input.sample);
+        InputReader reader{input_file, analysis.entities(), input};
+
+        stats.phase("process");
+        while (auto const buffer = stats.read(&reader)) {
             for (auto const &object : buffer.select<osmium::OSMObject>()) {
-                increment(&hist_tags_count, object.tags().size());
-                if (object.tags().size() > max_tags_count) {
-                    writer_tags_count(object);
-                }
-                auto [lk, lv, lr, tags_bytes, empty] = check_limits(object);
-                increment(&hist_tags_bytes, tags_bytes);
-                if (lk > max_key_length) {
-                    writer_key_length(object);
-                }
-                if (lv > max_value_length) {
-                    writer_value_length(object);
-                }
-                if (lr > max_role_length) {
-                    writer_role_length(object);
-                }
-                if (tags_bytes > max_tags_bytes) {
-                    writer_tags_bytes(object);
-                }
-                if (empty) {
-                    writer_empty(object);
-                }
+                analysis.object(object);
             }
+            analysis.next_block();
         }
-
-        writer_tags_bytes.close();
-        writer_tags_count.close();
-        writer_empty.close();
-        writer_role_length.close();
-        writer_value_length.close();
-        writer_key_length.close();
-
         reader.close();
 
-        output_hist(output_directory, "key-lengths", hist_keys);
-        output_hist(output_directory, "value-lengths", hist_values);
-        output_hist(output_directory, "role-lengths", hist_roles);
-        output_hist(output_directory, "tags-count", hist_tags_count);
-        output_hist(output_directory, "tags-bytes", hist_tags_bytes);
-        output_hist(output_directory, "way-nodes-count", hist_way_nodes);
-        output_hist(output_directory, "members-count", hist_members);
+        stats.phase("write");
+        if (partial_filename.empty()) {
+            analysis.finish();
+            stats.add_output_files(analysis.output_files());
+        } else {
+            write_partial_file(
+                partial_filename,
+                make_partial_header("odmt-limits", analysis.partial_options(),
+                                    input_filename, input),
+                [&](std::ostream &out) { analysis.write_partial(out); });
+            stats.add_output_file(partial_filename);
+        }
+        stats.write_json(stats_filename);
 
         vout << "Done.\n";
     } catch (std::exception const &e) {
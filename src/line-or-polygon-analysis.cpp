@@ -0,0 +1,277 @@
+#include "line-or-polygon-analysis.hpp"
+
+#include <osmium/io/any_output.hpp>
+#include <osmium/osm/way.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <utility>
+
+/**
+ * Read the rules from the named file in the directory. If no directory is
+ * set, use the rules built into the program.
+ */
+static std::vector<filter_rule> get_rules(std::string const &directory,
+                                          std::string const &name)
+{
+    if (directory.empty()) {
+        return default_filter_rules(name);
+    }
+    return read_filter_rules(directory + "/" + name);
+}
+
+static std::vector<filter_rule> get_neutral_rules(std::string const &directory)
+{
+    std::vector<filter_rule> neutral_rules;
+    for (auto const *name : {"meta-tags", "neutral-tags", "import-tags"}) {
+        auto rules = get_rules(directory, name);
+        neutral_rules.insert(neutral_rules.end(), rules.begin(), rules.end());
+    }
+    return neutral_rules;
+}
+
+LineOrPolygonClassifier::LineOrPolygonClassifier(
+    line_or_polygon_options const &options)
+: m_filter_linestring(
+      get_rules(options.expressions_directory, "linestring-tags")),
+  m_filter_polygon(get_rules(options.expressions_directory, "polygon-tags")),
+  m_filter_neutral(get_neutral_rules(options.expressions_directory)),
+  m_debug(options.debug)
+{
+}
+
+lptype
+LineOrPolygonClassifier::check_tag(osmium::Tag const &tag) const noexcept
+{
+    if (m_filter_polygon(tag)) {
+        return lptype::polygon;
+    }
+
+    if (m_filter_linestring(tag)) {
+        return lptype::linestring;
+    }
+
+    if (m_filter_neutral(tag)) {
+        return lptype::neutral;
+    }
+
+    return lptype::unknown;
+}
+
+lptype LineOrPolygonClassifier::get_type(
+    osmium::TagList const &tags, std::vector<std::string> *unknown_keys) const
+{
+    auto type = lptype::unclassified;
+
+    for (auto const &tag : tags) {
+        if (m_debug) {
+            std::cerr << "  " << type << " -> " << tag.key() << '='
+                      << tag.value();
+        }
+
+        if (!std::strcmp(tag.key(), "area")) {
+            if (!std::strcmp(tag.value(), "yes")) {
+                if (m_debug) {
+                    std::cerr << " area=yes\n";
+                }
+                return lptype::polygon;
+            }
+            if (!std::strcmp(tag.value(), "no")) {
+                if (m_debug) {
+                    std::cerr << " area=no\n";
+                }
+                return lptype::linestring;
+            }
+            if (m_debug) {
+                std::cerr << " area=INVALID\n  -> error";
+            }
+            return lptype::error;
+        }
+
+        auto const t = check_tag(tag);
+        if (m_debug) {
+            std::cerr << " [" << t << "]\n";
+        }
+
+        if (t == lptype::unknown) {
+            unknown_keys->emplace_back(tag.key());
+        }
+
+        if (t == lptype::neutral) {
+            continue;
+        }
+
+        switch (type) {
+        case lptype::unclassified:
+            if (t == lptype::linestring || t == lptype::polygon) {
+                type = t;
+            } else {
+                type = lptype::unknown;
+            }
+            break;
+        case lptype::linestring:
+            if (t == lptype::polygon) {
+                return lptype::both;
+            } else if (t != lptype::linestring) {
+                type = lptype::unknown;
+            }
+            break;
+        case lptype::polygon:
+            if (t == lptype::linestring) {
+                return lptype::both;
+            } else if (t != lptype::polygon) {
+                type = lptype::unknown;
+            }
+            break;
+        case lptype::unknown:
+            break;
+        default:
+            assert(false);
+        }
+    }
+
+    if (m_debug) {
+        std::cerr << "  -> " << type << '\n';
+    }
+    return type;
+}
+
+LineOrPolygonAnalysis::LineOrPolygonAnalysis(
+    std::string const &output_directory,
+    line_or_polygon_options const &options, OutputPool *output,
+    std::ostream *out)
+: m_classifier(options), m_out(out), m_debug(options.debug),
+  m_writer_unknown(output,
+                   output_file(output_directory + "/lp-unknown.osm.pbf")),
+  m_writer_linestring(output,
+                      output_file(output_directory + "/lp-linestring.osm.pbf")),
+  m_writer_polygon(output,
+                   output_file(output_directory + "/lp-polygon.osm.pbf")),
+  m_writer_both(output, output_file(output_directory + "/lp-both.osm.pbf")),
+  m_writer_no_tags(output,
+                   output_file(output_directory + "/lp-no-tags.osm.pbf")),
+  m_writer_error(output, output_file(output_directory + "/lp-error.osm.pbf"))
+{
+    assert(out);
+}
+
+void LineOrPolygonAnalysis::count_keys(
+    std::vector<std::string> const &unknown_keys)
+{
+    for (auto const &key : unknown_keys) {
+        m_keys[key].count(block());
+    }
+}
+
+void LineOrPolygonAnalysis::count_closed(lptype type) noexcept
+{
+    m_count_closed.count(block());
+    m_count_unknown.count(block(), type == lptype::unknown);
+    m_count_linestring.count(block(), type == lptype::linestring);
+    m_count_polygon.count(block(), type == lptype::polygon);
+    m_count_both.count(block(), type == lptype::both);
+    m_count_error.count(block(), type == lptype::error);
+    m_count_no_tags.count(block(), type == lptype::unclassified);
+}
+
+void LineOrPolygonAnalysis::object(osmium::OSMObject const &object)
+{
+    if (object.type() != osmium::item_type::way) {
+        return;
+    }
+    auto const &way = static_cast<osmium::Way const &>(object);
+
+    if (way.nodes().empty() || !way.is_closed()) {
+        m_count_nonclosed.count(block());
+        return;
+    }
+
+    if (way.tags().empty()) {
+        count_closed(lptype::unclassified);
+        m_writer_no_tags(way);
+        return;
+    }
+
+    if (m_debug) {
+        std::cerr << "WAY " << way.id() << '\n';
+    }
+    std::vector<std::string> unknown_keys;
+    auto type = m_classifier.get_type(way.tags(), &unknown_keys);
+    count_closed(type);
+    switch (type) {
+    case lptype::unclassified:
+        m_writer_no_tags(way);
+        break;
+    case lptype::unknown:
+        m_writer_unknown(way);
+        break;
+    case lptype::linestring:
+        m_writer_linestring(way);
+        break;
+    case lptype::polygon:
+        m_writer_polygon(way);
+        break;
+    case lptype::neutral:
+        break;
+    case lptype::both:
+        m_writer_both(way);
+        count_keys(unknown_keys);
+        break;
+    case lptype::error:
+        m_writer_error(way);
+        break;
+    }
+}
+
+void LineOrPolygonAnalysis::finish()
+{
+    m_writer_error.close();
+    m_writer_no_tags.close();
+    m_writer_both.close();
+    m_writer_polygon.close();
+    m_writer_linestring.close();
+    m_writer_unknown.close();
+
+    auto const rate = sample_rate();
+    auto const line = [&](SampledFraction const &count) {
+        return format_part(count, rate) + " (" + format_percent(count, rate) +
+               ")";
+    };
+
+    *m_out << "Statistics:"
+           << "\n  non-closed: " << format_count(m_count_nonclosed, rate)
+           << "\n  closed:     " << format_count(m_count_closed, rate)
+           << " (100%)"
+           << "\n    unknown:    " << line(m_count_unknown)
+           << "\n    linestring: " << line(m_count_linestring)
+           << "\n    polygon:    " << line(m_count_polygon)
+           << "\n    both:       " << line(m_count_both)
+           << "\n    no tags:    " << line(m_count_no_tags)
+           << "\n    error:      " << line(m_count_error) << '\n';
+
+    *m_out << "Keys:\n";
+
+    // Only output keys found more often than this (in the whole input)
+    double const min_key_count = 10000.0 * rate;
+
+    using si = std::pair<std::string, SampledCount>;
+    std::vector<si> common_keys;
+    std::copy_if(m_keys.cbegin(), m_keys.cend(),
+                 std::back_inserter(common_keys),
+                 [&min_key_count](auto const &p) {
+                     return static_cast<double>(p.second.get()) >=
+                            min_key_count;
+                 });
+
+    std::sort(common_keys.begin(), common_keys.end(),
+              [](si const &a, si const &b) {
+                  return a.second.get() > b.second.get();
+              });
+
+    for (auto const &p : common_keys) {
+        *m_out << p.first << ' ' << format_count(p.second, rate) << '\n';
+    }
+}
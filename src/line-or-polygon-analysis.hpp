@@ -0,0 +1,146 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "filter.hpp"
+#include "output-pool.hpp"
+#include "sample.hpp"
+
+#include <osmium/osm/tag.hpp>
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class lptype
+{
+    unclassified,
+    unknown,
+    linestring,
+    polygon,
+    both,
+    neutral,
+    error
+};
+
+template <typename TChar, typename TTraits>
+std::basic_ostream<TChar, TTraits> &
+operator<<(std::basic_ostream<TChar, TTraits> &out, lptype lpt)
+{
+    switch (lpt) {
+    case lptype::unclassified:
+        out << "unclassified";
+        break;
+    case lptype::unknown:
+        out << "unknown";
+        break;
+    case lptype::linestring:
+        out << "linestring";
+        break;
+    case lptype::polygon:
+        out << "polygon";
+        break;
+    case lptype::both:
+        out << "both";
+        break;
+    case lptype::neutral:
+        out << "neutral";
+        break;
+    case lptype::error:
+        out << "error";
+        break;
+    }
+    return out;
+}
+
+struct line_or_polygon_options
+{
+    // Directory with the expression files. If empty, the built-in
+    // expressions are used.
+    std::string expressions_directory;
+
+    bool debug = false;
+};
+
+/**
+ * Classifies the tags of closed ways as linestring or polygon tags using
+ * the expression files.
+ */
+class LineOrPolygonClassifier
+{
+
+    CompiledTagsFilter m_filter_linestring;
+    CompiledTagsFilter m_filter_polygon;
+    CompiledTagsFilter m_filter_neutral; // meta, neutral, and import tags
+
+    bool m_debug;
+
+    lptype check_tag(osmium::Tag const &tag) const noexcept;
+
+public:
+    explicit LineOrPolygonClassifier(line_or_polygon_options const &options);
+
+    /**
+     * Get the type of a closed way with these tags. The keys of tags not
+     * matching any expression are added to unknown_keys.
+     */
+    lptype get_type(osmium::TagList const &tags,
+                    std::vector<std::string> *unknown_keys) const;
+
+}; // class LineOrPolygonClassifier
+
+/**
+ * Classifies closed ways as linestrings or polygons based on their tags
+ * and writes them into lp-*.osm.pbf files in the output directory. The
+ * statistics are written to the output stream in finish(). If only a
+ * sample of the input was read, the statistics contain the estimated
+ * counts and percentages with their errors.
+ */
+class LineOrPolygonAnalysis : public Analysis
+{
+
+    LineOrPolygonClassifier m_classifier;
+
+    std::ostream *m_out;
+    bool m_debug;
+
+    std::unordered_map<std::string, SampledCount> m_keys;
+
+    PooledWriter m_writer_unknown;
+    PooledWriter m_writer_linestring;
+    PooledWriter m_writer_polygon;
+    PooledWriter m_writer_both;
+    PooledWriter m_writer_no_tags;
+    PooledWriter m_writer_error;
+
+    SampledCount m_count_closed;
+    SampledCount m_count_nonclosed;
+
+    // Fractions of the closed ways.
+    SampledFraction m_count_unknown;
+    SampledFraction m_count_linestring;
+    SampledFraction m_count_polygon;
+    SampledFraction m_count_both;
+    SampledFraction m_count_error;
+    SampledFraction m_count_no_tags;
+
+    void count_keys(std::vector<std::string> const &unknown_keys);
+
+    void count_closed(lptype type) noexcept;
+
+public:
+    LineOrPolygonAnalysis(std::string const &output_directory,
+                          line_or_polygon_options const &options,
+                          OutputPool *output, std::ostream *out);
+
+    [[nodiscard]] osmium::osm_entity_bits::type
+    entities() const noexcept override
+    {
+        return osmium::osm_entity_bits::way;
+    }
+
+    void object(osmium::OSMObject const &object) override;
+
+    void finish() override;
+
+}; // class LineOrPolygonAnalysis
@@ -21,8 +21,14 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
 
+#include "checkpoint.hpp"
+#include "input-reader.hpp"
+#include "output-options.hpp"
+#include "ranked-id-set.hpp"
+#include "run-stats.hpp"
+#include "topology-state.hpp"
+
 #include <osmium/builder/osm_object_builder.hpp>
-#include <osmium/index/id_set.hpp>
 #include <osmium/io/any_input.hpp>
 #include <osmium/io/any_output.hpp>
 
@@ -38,7 +44,13 @@ int main(int argc, char *argv[])
 {
     try {
         std::string input_filename;
+        std::string stats_filename;
+        input_options input;
+        output_options output;
         std::string output_directory;
+        std::string topology_directory;
+        std::string checkpoint_directory;
+        unsigned int checkpoint_interval = 600;
         bool help = false;
 
         // clang-format off
@@ -46,6 +58,27 @@ int main(int argc, char *argv[])
             = lyra::opt(output_directory, "DIR")
                 ["-o"]["--output-dir"]
                 ("output directory")
+            | lyra::opt(topology_directory, "DIR")
+                ["-t"]["--topology"]
+                ("use topology state in DIR (see odmt-topology) instead of reading ways and relations")
+            | lyra::opt(checkpoint_directory, "DIR")
+                ["--checkpoint-dir"]
+                ("save progress in DIR and resume from there when restarted")
+            | lyra::opt(checkpoint_interval, "SECONDS")
+                ["--checkpoint-interval"]
+                ("time between checkpoints (default: 600)")
+            | lyra::opt(input.format, "FORMAT")
+                ["--input-format"]
+                ("format of input file (needed for STDIN)")
+            | lyra::opt(input.mmap)
+                ["--mmap"]
+                ("memory map PBF input file")
+            | lyra::opt(output.compression, "COMPRESSION")
+                ["--output-compression"]
+                ("compression of PBF output files (none, lz4, zlib[:LEVEL])")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
             | lyra::help(help)
             | lyra::arg(input_filename, "FILENAME")
                 ("input file");
@@ -69,59 +102,125 @@ int main(int argc, char *argv[])
             return 1;
         }
 
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> in_way;
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type>
-            in_multiple_ways;
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> in_relation;
+        if (is_stdin(input_filename) && topology_directory.empty()) {
+            std::cerr << "Reading from STDIN needs --topology, otherwise the "
+                         "input is read twice.\n";
+            return 1;
+        }
 
-        osmium::io::File input_file{input_filename};
+        if (is_stdin(input_filename) && !checkpoint_directory.empty()) {
+            std::cerr << "Can not use --checkpoint-dir when reading from "
+                         "STDIN.\n";
+            return 1;
+        }
 
-        osmium::io::Reader reader1{input_file,
-                                   osmium::osm_entity_bits::way |
-                                       osmium::osm_entity_bits::relation};
-        while (auto const buffer = reader1.read()) {
-            for (auto const &object : buffer.select<osmium::OSMObject>()) {
-                if (object.type() == osmium::item_type::way) {
-                    auto const &way = static_cast<osmium::Way const &>(object);
-                    if (way.nodes().empty()) {
-                        continue;
-                    }
-                    auto const *it = way.nodes().begin();
-                    if (way.is_closed()) {
-                        ++it;
-                    }
-                    for (; it != way.nodes().end(); ++it) {
-                        if (in_way.get(it->positive_ref())) {
-                            in_multiple_ways.set(it->positive_ref());
-                        } else {
-                            in_way.set(it->positive_ref());
+        RunStats stats{"odmt-mark-topo-nodes"};
+        stats.add_input_file(input_filename);
+
+        RankedIdSet in_way;
+        RankedIdSet in_multiple_ways;
+        RankedIdSet in_relation;
+
+        auto const input_file = make_input_file(input_filename, input);
+
+        // The first pass (step 0) can be resumed from any checkpoint, the
+        // output pass (step 1) is always done from the beginning.
+        Checkpoint checkpoint{checkpoint_directory,
+                              topology_directory.empty()
+                                  ? "odmt-mark-topo-nodes"
+                                  : "odmt-mark-topo-nodes --topology",
+                              input_filename, checkpoint_interval};
+        auto const save_state = [&](std::ostream &out) {
+            in_way.save(out);
+            in_multiple_ways.save(out);
+            in_relation.save(out);
+        };
+        if (checkpoint.resume()) {
+            std::cerr << "Resuming from checkpoint in step "
+                      << checkpoint.step() << " at offset "
+                      << checkpoint.offset() << "...\n";
+        }
+        checkpoint.load([&](std::istream &in) {
+            in_way.load(in);
+            in_multiple_ways.load(in);
+            in_relation.load(in);
+        });
+        input.resumable = checkpoint.enabled();
+
+        // With a topology state we already know which nodes are in which
+        // ways and relations, otherwise we need an extra pass for that.
+        std::unique_ptr<TopologyState> topology;
+        stats.phase("process");
+        if (!topology_directory.empty()) {
+            topology = std::make_unique<TopologyState>(topology_directory,
+                                                       open_mode::read);
+        } else if (checkpoint.step() == 0) {
+            auto options = input;
+            options.start_offset = checkpoint.offset();
+            InputReader reader1{input_file,
+                                osmium::osm_entity_bits::way |
+                                    osmium::osm_entity_bits::relation,
+                                options};
+            while (auto const buffer = stats.read(&reader1)) {
+                for (auto const &object :
+                     buffer.select<osmium::OSMObject>()) {
+                    if (object.type() == osmium::item_type::way) {
+                        auto const &way =
+                            static_cast<osmium::Way const &>(object);
+                        if (way.nodes().empty()) {
+                            continue;
                         }
-                    }
-                } else {
-                    for (auto const &member :
-                         static_cast<osmium::Relation const &>(object)
-                             .members()) {
-                        if (member.type() == osmium::item_type::node) {
-                            in_relation.set(member.positive_ref());
+                        auto const *it = way.nodes().begin();
+                        if (way.is_closed()) {
+                            ++it;
+                        }
+                        for (; it != way.nodes().end(); ++it) {
+                            if (in_way.get(it->positive_ref())) {
+                                in_multiple_ways.set(it->positive_ref());
+                            } else {
+                                in_way.set(it->positive_ref());
+                            }
+                        }
+                    } else {
+                        for (auto const &member :
+                             static_cast<osmium::Relation const &>(object)
+                                 .members()) {
+                            if (member.type() == osmium::item_type::node) {
+                                in_relation.set(member.positive_ref());
+                            }
                         }
                     }
                 }
+                if (checkpoint.due() && reader1.direct()) {
+                    checkpoint.save(0, reader1.offset(), save_state);
+                }
             }
+            reader1.close();
+            checkpoint.save(1, 0, save_state);
         }
-        reader1.close();
 
         constexpr std::size_t const initial_buffer_size = 1024;
         osmium::memory::Buffer outbuffer{initial_buffer_size};
-        osmium::io::Writer writer{output_directory +
-                                  "/with-marked-topo-nodes.osm.pbf"};
+        std::string const output_filename{output_directory +
+                                          "/with-marked-topo-nodes.osm.pbf"};
+        stats.add_output_file(output_filename);
+        // A run killed while writing leaves a partial output file behind.
+        osmium::io::Writer writer{make_output_file(output_filename, output),
+                                  checkpoint.resume()
+                                      ? osmium::io::overwrite::allow
+                                      : osmium::io::overwrite::no};
 
-        osmium::io::Reader reader2{input_file};
-        while (auto const buffer = reader2.read()) {
+        stats.phase("write");
+        InputReader reader2{input_file, osmium::osm_entity_bits::all, input};
+        while (auto const buffer = stats.read(&reader2)) {
             for (auto const &object : buffer.select<osmium::OSMObject>()) {
                 if (object.type() == osmium::item_type::node) {
-                    bool const in_mw =
-                        in_multiple_ways.get(object.positive_id());
-                    bool const in_rel = in_relation.get(object.positive_id());
+                    auto const id = object.positive_id();
+                    bool const in_mw = topology
+                                           ? topology->in_multiple_ways(id)
+                                           : in_multiple_ways.get(id);
+                    bool const in_rel = topology ? topology->in_relation(id)
+                                                 : in_relation.get(id);
                     if (!object.tags().empty() || (!in_mw && !in_rel)) {
                         writer(object);
                     } else {
@@ -156,6 +255,9 @@ int main(int argc, char *argv[])
 
         writer.close();
         reader2.close();
+
+        checkpoint.remove();
+        stats.write_json(stats_filename);
     } catch (std::exception const &e) {
         std::cerr << "ERROR: " << e.what() << "\n";
         return 1;
@@ -0,0 +1,183 @@
+/*
+
+OSM Data Model Tools
+
+merge
+
+Copyright (C) 2018-2022  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "limits-analysis.hpp"
+#include "output-pool.hpp"
+#include "partial-state.hpp"
+#include "run-stats.hpp"
+#include "tag-stats-analysis.hpp"
+#include "way-nodes-analysis.hpp"
+
+#include <lyra.hpp>
+
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Read the headers of all partial files and check that they are from the
+ * same program run on the same input with the same options and that there
+ * is exactly one file for each shard. Returns the header of the first file.
+ */
+static partial_header
+check_partial_files(std::vector<std::string> const &file_names)
+{
+    auto const first = read_partial_header(file_names.front());
+    std::vector<bool> seen(first.shards, false);
+
+    for (auto const &file_name : file_names) {
+        auto const header = read_partial_header(file_name);
+        if (header.program != first.program ||
+            header.options != first.options ||
+            header.input_size != first.input_size ||
+            header.shards != first.shards) {
+            throw std::runtime_error{"Partial file '" + file_name +
+                                     "' is not from the same run as '" +
+                                     file_names.front() + "'"};
+        }
+        if (header.shard >= header.shards) {
+            throw std::runtime_error{"Invalid shard in partial file '" +
+                                     file_name + "'"};
+        }
+        if (seen[header.shard]) {
+            throw std::runtime_error{"Shard " + std::to_string(header.shard) +
+                                     " is in more than one partial file"};
+        }
+        seen[header.shard] = true;
+    }
+
+    for (unsigned int shard = 0; shard < first.shards; ++shard) {
+        if (!seen[shard]) {
+            throw std::runtime_error{"Missing partial file for shard " +
+                                     std::to_string(shard) + " of " +
+                                     std::to_string(first.shards)};
+        }
+    }
+
+    return first;
+}
+
+int main(int argc, char *argv[])
+{
+    try {
+        std::vector<std::string> partial_filenames;
+        std::string stats_filename;
+        output_options output;
+        std::string output_directory{"."};
+        bool help = false;
+
+        // clang-format off
+        auto const cli
+            = lyra::opt(output_directory, "DIR")
+                ["-o"]["--output-dir"]
+                ("output directory for odmt-limits results (default: cwd)")
+            | lyra::opt(output.compression, "COMPRESSION")
+                ["--output-compression"]
+                ("compression of PBF output files (none, lz4, zlib[:LEVEL])")
+            | lyra::opt(output.threads, "N")
+                ["--output-threads"]
+                ("number of threads encoding output (default: all cores)")
+            | lyra::opt(output.memory, "MB")
+                ["--output-memory"]
+                ("memory for output not yet encoded (default: 256)")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
+            | lyra::help(help)
+            | lyra::arg(partial_filenames, "PARTIAL-FILE")
+                ("partial files written with --partial-out, one for each shard");
+        // clang-format on
+
+        auto const result = cli.parse(lyra::args(argc, argv));
+        if (!result) {
+            std::cerr << "Error in command line: " << result.message() << '\n';
+            return 1;
+        }
+
+        if (help) {
+            std::cout << cli
+                      << "\nMerge the partial results of all shards of a run "
+                         "of odmt-tag-stats, odmt-limits, or odmt-way-nodes.\n";
+            return 0;
+        }
+
+        if (partial_filenames.empty()) {
+            std::cerr << "Missing partial files. Try '-h'.\n";
+            return 1;
+        }
+
+        RunStats stats{"odmt-merge"};
+        for (auto const &file_name : partial_filenames) {
+            stats.add_input_file(file_name);
+        }
+
+        auto const header = check_partial_files(partial_filenames);
+
+        // The analysis gets the partial results of all shards in turn, then
+        // it writes the results like after a run over the complete input.
+        auto const merge = [&](auto *analysis) {
+            stats.phase("process");
+            for (auto const &file_name : partial_filenames) {
+                read_partial_file(file_name, [&](std::istream &in) {
+                    analysis->read_partial(in);
+                });
+            }
+            stats.phase("write");
+            analysis->finish();
+            stats.add_output_files(analysis->output_files());
+        };
+
+        if (header.program == "odmt-tag-stats") {
+            TagStatsAnalysis analysis{
+                TagStatsAnalysis::options_from_partial(header.options),
+                &std::cout};
+            merge(&analysis);
+        } else if (header.program == "odmt-limits") {
+            OutputPool output_pool{output};
+            LimitsAnalysis analysis{
+                output_directory,
+                LimitsAnalysis::options_from_partial(header.options),
+                &output_pool};
+            merge(&analysis);
+        } else if (header.program == "odmt-way-nodes") {
+            // The node ID sets are merged in one pass over all files.
+            WayNodesAnalysis analysis{&std::cout};
+            stats.phase("process");
+            analysis.merge_partial(partial_filenames);
+            stats.phase("write");
+            analysis.finish();
+        } else {
+            throw std::runtime_error{"Unknown program '" + header.program +
+                                     "' in partial file '" +
+                                     partial_filenames.front() + "'"};
+        }
+
+        stats.write_json(stats_filename);
+    } catch (std::exception const &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
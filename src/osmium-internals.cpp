@@ -0,0 +1,90 @@
+#include "osmium-internals.hpp"
+
+#include <osmium/io/detail/opl_parser_functions.hpp>
+#include <osmium/io/detail/pbf_decoder.hpp>
+#include <osmium/io/detail/zlib.hpp>
+#include <osmium/version.hpp>
+
+#include <protozero/pbf_reader.hpp>
+
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+static constexpr int osmium_version(int major, int minor) noexcept
+{
+    return (major << 16) | (minor << 8); // NOLINT(hicpp-signed-bitwise)
+}
+
+// Before allowing a newer version check that the internals used below
+// still exist and work the same.
+static_assert(LIBOSMIUM_VERSION_CODE >= osmium_version(2, 18),
+              "libosmium 2.18.0 or newer is needed");
+static_assert(LIBOSMIUM_VERSION_CODE < osmium_version(2, 21),
+              "osmium-internals.cpp has not been checked with this "
+              "libosmium version");
+
+// Limit from the PBF format specification.
+static constexpr std::int32_t const max_uncompressed_blob_size =
+    32 * 1024 * 1024;
+
+osmium::memory::Buffer decode_pbf_blob(std::string &&blob,
+                                       osmium::osm_entity_bits::type entities,
+                                       bool meta)
+{
+    osmium::io::detail::PBFDataBlobDecoder decoder{
+        std::move(blob), entities,
+        meta ? osmium::io::read_meta::yes : osmium::io::read_meta::no};
+    return decoder();
+}
+
+osmium::memory::Buffer
+decode_pbf_blob(protozero::data_view const &blob,
+                osmium::osm_entity_bits::type entities)
+{
+    protozero::data_view raw;
+    protozero::data_view zlib_data;
+    std::int32_t raw_size = 0;
+
+    protozero::pbf_reader reader{blob};
+    while (reader.next()) {
+        switch (reader.tag()) {
+        case 1: // Blob.raw
+            raw = reader.get_view();
+            break;
+        case 2: // Blob.raw_size
+            raw_size = reader.get_int32();
+            break;
+        case 3: // Blob.zlib_data
+            zlib_data = reader.get_view();
+            break;
+        default:
+            reader.skip();
+        }
+    }
+
+    std::string output;
+    protozero::data_view data;
+    if (raw.data() != nullptr) {
+        data = raw;
+    } else if (zlib_data.data() != nullptr) {
+        if (raw_size <= 0 || raw_size > max_uncompressed_blob_size) {
+            throw std::runtime_error{"Invalid raw_size in PBF blob"};
+        }
+        data = osmium::io::detail::zlib_uncompress_string(
+            zlib_data.data(), static_cast<unsigned long>(zlib_data.size()),
+            static_cast<unsigned long>(raw_size), output);
+    } else {
+        return decode_pbf_blob(std::string{blob.data(), blob.size()},
+                               entities, true);
+    }
+
+    osmium::io::detail::PBFPrimitiveBlockDecoder decoder{
+        data, entities, osmium::io::read_meta::yes};
+    return decoder();
+}
+
+void parse_opl_tags(char const *tags, osmium::memory::Buffer *buffer)
+{
+    osmium::io::detail::opl_parse_tags(tags, *buffer);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/entity_bits.hpp>
+
+#include <protozero/data_view.hpp>
+
+#include <string>
+
+/**
+ * Everything that needs the internals of libosmium (the osmium::io::detail
+ * namespace) is in these functions. The internals have no API guarantee,
+ * so only this module has to be checked for a new libosmium version. It
+ * doesn't compile with libosmium versions it hasn't been checked with.
+ */
+
+/**
+ * Decode a PBF Blob message (the data after the BlobHeader) with an
+ * OSMData block.
+ *
+ * @param meta Decode the metadata (version, timestamp, ...) of the objects.
+ */
+osmium::memory::Buffer decode_pbf_blob(std::string &&blob,
+                                       osmium::osm_entity_bits::type entities,
+                                       bool meta);
+
+/**
+ * Decode a PBF Blob message in memory, for instance in a memory mapped
+ * file. Uncompressed blobs are decoded in place, zlib compressed blobs are
+ * decompressed straight from memory. Blobs with other compressions are
+ * copied first.
+ */
+osmium::memory::Buffer
+decode_pbf_blob(protozero::data_view const &blob,
+                osmium::osm_entity_bits::type entities);
+
+/// Parse tags in OPL format (k=v,k=v) into a TagList in the buffer.
+void parse_opl_tags(char const *tags, osmium::memory::Buffer *buffer);
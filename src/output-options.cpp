@@ -0,0 +1,44 @@
+#include "output-options.hpp"
+
+#include <stdexcept>
+
+osmium::io::File make_output_file(std::string const &file_name,
+                                  output_options const &options)
+{
+    if (file_name == "-" && options.format.empty()) {
+        throw std::runtime_error{"Writing to STDOUT needs --output-format"};
+    }
+
+    osmium::io::File file{file_name, options.format};
+
+    if (options.compression.empty()) {
+        return file;
+    }
+
+    auto const pos = options.compression.find(':');
+    auto const type = options.compression.substr(0, pos);
+
+    if (type == "lz4") {
+#ifndef OSMIUM_WITH_LZ4
+        throw std::runtime_error{
+            "LZ4 compression is not available in this build"};
+#endif
+    } else if (type != "none" && type != "zlib") {
+        throw std::runtime_error{"Unknown output compression '" + type +
+                                 "' (use none, lz4, or zlib[:LEVEL])"};
+    }
+    file.set("pbf_compression", type);
+
+    if (pos != std::string::npos) {
+        auto const level = options.compression.substr(pos + 1);
+        if (type != "zlib" || level.size() != 1 || level[0] < '1' ||
+            level[0] > '9') {
+            throw std::runtime_error{"Invalid output compression '" +
+                                     options.compression +
+                                     "' (level must be 1 to 9 for zlib)"};
+        }
+        file.set("pbf_compression_level", level);
+    }
+
+    return file;
+}
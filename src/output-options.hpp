@@ -0,0 +1,36 @@
+#pragma once
+
+#include <osmium/io/file.hpp>
+
+#include <cstddef>
+#include <string>
+
+struct output_options
+{
+    // Format of output files as understood by libosmium (like "pbf" or
+    // "opl"). Empty to use the file name, which doesn't work for STDOUT.
+    std::string format;
+
+    // Compression of the blobs in PBF output files: "none", "lz4", "zlib",
+    // or "zlib:LEVEL". Empty for the libosmium default (zlib).
+    std::string compression;
+
+    // Number of threads encoding PBF output in programs writing several
+    // output files (0 for one per CPU).
+    unsigned int threads = 0;
+
+    // Memory in MB for output data not yet encoded in those programs.
+    std::size_t memory = 256;
+};
+
+/**
+ * The file to write to with the output options set. The file name "-" is
+ * STDOUT. The compression only changes PBF files, all other formats are
+ * written as usual.
+ *
+ * @throws std::runtime_error if the compression is invalid or not
+ *         supported by this build or if writing to STDOUT without a
+ *         format.
+ */
+osmium::io::File make_output_file(std::string const &file_name,
+                                  output_options const &options);
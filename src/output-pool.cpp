@@ -0,0 +1,103 @@
+#include "output-pool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+#include <utility>
+
+static int num_threads(unsigned int threads)
+{
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    return static_cast<int>(threads);
+}
+
+OutputPool::OutputPool(output_options const &options)
+: m_options(options), m_batch_size(default_batch_size),
+  m_buffered_limit(std::max(options.memory * 1024UL * 1024UL / 2,
+                            m_batch_size)),
+  m_pool(num_threads(options.threads),
+         std::max(m_buffered_limit / m_batch_size,
+                  static_cast<std::size_t>(num_threads(options.threads))))
+{
+}
+
+void OutputPool::add(PooledWriter *writer) { m_writers.push_back(writer); }
+
+void OutputPool::remove(PooledWriter *writer) noexcept
+{
+    m_buffered -= writer->buffered();
+    m_writers.erase(std::remove(m_writers.begin(), m_writers.end(), writer),
+                    m_writers.end());
+}
+
+void OutputPool::buffered(std::size_t bytes)
+{
+    m_buffered += bytes;
+    while (m_buffered > m_buffered_limit) {
+        auto const it = std::max_element(
+            m_writers.cbegin(), m_writers.cend(),
+            [](PooledWriter const *a, PooledWriter const *b) {
+                return a->buffered() < b->buffered();
+            });
+        assert(it != m_writers.cend());
+        (*it)->flush();
+    }
+}
+
+PooledWriter::PooledWriter(OutputPool *pool, std::string const &file_name)
+: m_pool(pool),
+  m_buffer(pool ? pool->m_batch_size : OutputPool::default_batch_size,
+           osmium::memory::Buffer::auto_grow::yes)
+{
+    if (m_pool) {
+        m_writer = std::make_unique<osmium::io::Writer>(
+            make_output_file(file_name, m_pool->options()),
+            osmium::io::overwrite::allow, m_pool->m_pool);
+        m_pool->add(this);
+    }
+}
+
+PooledWriter::~PooledWriter() noexcept
+{
+    if (m_pool) {
+        m_pool->remove(this);
+    }
+}
+
+void PooledWriter::operator()(osmium::memory::Item const &item)
+{
+    if (!m_pool) {
+        m_buffer.add_item(item);
+        m_buffer.commit();
+        return;
+    }
+    if (m_buffer.committed() + item.padded_size() > m_buffer.capacity()) {
+        flush();
+    }
+    m_buffer.add_item(item);
+    m_buffer.commit();
+    m_pool->buffered(item.padded_size());
+}
+
+void PooledWriter::flush()
+{
+    auto const size = m_buffer.committed();
+    if (!m_pool || size == 0) {
+        return;
+    }
+    (*m_writer)(std::move(m_buffer));
+    m_buffer = osmium::memory::Buffer{m_pool->m_batch_size,
+                                      osmium::memory::Buffer::auto_grow::yes};
+    m_pool->m_buffered -= size;
+}
+
+void PooledWriter::close()
+{
+    if (!m_pool) {
+        return;
+    }
+    flush();
+    m_writer->close();
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "output-options.hpp"
+
+#include <osmium/io/writer.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/memory/item.hpp>
+#include <osmium/thread/pool.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+class PooledWriter;
+
+/**
+ * Shared by all writers of a program writing several output files. Their
+ * PBF data is encoded in one thread pool of a fixed size, no matter how
+ * many output files there are.
+ *
+ * Each writer collects objects in a buffer and only hands full buffers to
+ * the encoder. The memory used by all those buffers together is limited to
+ * half of the memory option. If the limit is reached, the largest buffer is
+ * handed on early. The work queue of the thread pool holds about the other
+ * half. When it is full because the encoders can't keep up, writing blocks
+ * until there is room again, so the program stops reading more input.
+ *
+ * Not thread safe, all writers must be used from the same thread.
+ */
+class OutputPool
+{
+
+    friend class PooledWriter;
+
+    output_options m_options;
+    std::size_t m_batch_size;
+    std::size_t m_buffered_limit;
+    std::size_t m_buffered = 0;
+    std::vector<PooledWriter *> m_writers;
+    osmium::thread::Pool m_pool;
+
+    void add(PooledWriter *writer);
+
+    void remove(PooledWriter *writer) noexcept;
+
+    /// Account for bytes added to a buffer, flush if over the limit.
+    void buffered(std::size_t bytes);
+
+public:
+    /// The size of the buffers handed to the encoder.
+    static constexpr std::size_t const default_batch_size = 1024UL * 1024UL;
+
+    explicit OutputPool(output_options const &options);
+
+    [[nodiscard]] output_options const &options() const noexcept
+    {
+        return m_options;
+    }
+
+    /// Bytes in all buffers not yet handed to the encoder.
+    [[nodiscard]] std::size_t buffered() const noexcept { return m_buffered; }
+
+}; // class OutputPool
+
+/**
+ * Writes objects to an output file like the osmium::io::Writer, but the
+ * data is encoded in the thread pool of the OutputPool.
+ *
+ * Without a pool nothing is written, all objects are collected in the
+ * buffer instead. This is used for the partial results of a shard of the
+ * input, which are written later by odmt-merge.
+ */
+class PooledWriter
+{
+
+    OutputPool *m_pool;
+    std::unique_ptr<osmium::io::Writer> m_writer;
+    osmium::memory::Buffer m_buffer;
+
+public:
+    /**
+     * Open the file for writing with the options of the pool. An existing
+     * file is overwritten. If the pool is nullptr, the file isn't opened.
+     */
+    PooledWriter(OutputPool *pool, std::string const &file_name);
+
+    PooledWriter(PooledWriter const &) = delete;
+    PooledWriter &operator=(PooledWriter const &) = delete;
+
+    PooledWriter(PooledWriter &&) = delete;
+    PooledWriter &operator=(PooledWriter &&) = delete;
+
+    ~PooledWriter() noexcept;
+
+    void operator()(osmium::memory::Item const &item);
+
+    /// Hand the buffer to the encoder even if it isn't full.
+    void flush();
+
+    [[nodiscard]] std::size_t buffered() const noexcept
+    {
+        return m_buffer.committed();
+    }
+
+    /// The objects collected by a writer without pool.
+    [[nodiscard]] osmium::memory::Buffer const &collected() const noexcept
+    {
+        return m_buffer;
+    }
+
+    /// Flush and close the file. Must be called before destruction.
+    void close();
+
+}; // class PooledWriter
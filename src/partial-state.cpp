@@ -0,0 +1,108 @@
+#include "partial-state.hpp"
+
+#include "serialize.hpp"
+
+#include <osmium/util/file.hpp>
+
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+static constexpr char const *const partial_magic = "odmt-partial";
+static constexpr std::uint64_t const partial_version = 2;
+
+// The magic is written without length, so that any other file is
+// recognized before reading a length from it.
+static bool read_magic(std::istream &in)
+{
+    std::string const magic{partial_magic};
+    std::string data(magic.size(), '\0');
+    in.read(&data[0], static_cast<std::streamsize>(data.size()));
+    return in && data == magic;
+}
+
+static void read_header(std::istream &in, std::string const &file_name,
+                        partial_header *header)
+{
+    if (!read_magic(in) || read_varint(in) != partial_version) {
+        throw std::runtime_error{"File '" + file_name +
+                                 "' is not a partial file"};
+    }
+
+    header->program = read_string(in);
+    header->options.resize(static_cast<std::size_t>(read_varint(in)));
+    for (auto &option : header->options) {
+        option = read_varint(in);
+    }
+    header->input_size = read_varint(in);
+    header->shard = static_cast<unsigned int>(read_varint(in));
+    header->shards = static_cast<unsigned int>(read_varint(in));
+}
+
+partial_header make_partial_header(std::string program,
+                                   std::vector<std::uint64_t> options,
+                                   std::string const &input_filename,
+                                   input_options const &input)
+{
+    partial_header header;
+    header.program = std::move(program);
+    header.options = std::move(options);
+    header.input_size =
+        is_stdin(input_filename) ? 0 : osmium::file_size(input_filename);
+    header.shard = input.shard;
+    header.shards = input.shards;
+    return header;
+}
+
+void write_partial_file(std::string const &file_name,
+                        partial_header const &header,
+                        std::function<void(std::ostream &)> const &func)
+{
+    write_file_atomically(file_name, [&](std::ostream &out) {
+        out << partial_magic;
+        write_varint(out, partial_version);
+        write_string(out, header.program);
+        write_varint(out, header.options.size());
+        for (auto const option : header.options) {
+            write_varint(out, option);
+        }
+        write_varint(out, header.input_size);
+        write_varint(out, header.shard);
+        write_varint(out, header.shards);
+        func(out);
+    });
+}
+
+partial_header read_partial_header(std::string const &file_name)
+{
+    std::ifstream in{file_name, std::ios::binary};
+    if (!in.is_open()) {
+        throw std::runtime_error{"Could not open file '" + file_name + "'"};
+    }
+
+    partial_header header;
+    read_header(in, file_name, &header);
+    return header;
+}
+
+std::ifstream open_partial_file(std::string const &file_name)
+{
+    std::ifstream in{file_name, std::ios::binary};
+    if (!in.is_open()) {
+        throw std::runtime_error{"Could not open file '" + file_name + "'"};
+    }
+
+    partial_header header;
+    read_header(in, file_name, &header);
+    return in;
+}
+
+void read_partial_file(std::string const &file_name,
+                       std::function<void(std::istream &)> const &func)
+{
+    auto in = open_partial_file(file_name);
+    func(in);
+    if (!in || in.peek() != std::char_traits<char>::eof()) {
+        throw std::runtime_error{"Error reading file '" + file_name + "'"};
+    }
+}
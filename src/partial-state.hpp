@@ -0,0 +1,74 @@
+#pragma once
+
+#include "input-reader.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Describes the contents of a partial file. A partial file contains the
+ * state of an analysis after reading one shard of the input (see --shard
+ * and --partial-out). odmt-merge combines the partial files of all shards
+ * into the results of a run over the complete input.
+ */
+struct partial_header
+{
+    // The program that wrote the file, like "odmt-tag-stats".
+    std::string program;
+
+    // The options of the program the state depends on. They must be the
+    // same for all shards.
+    std::vector<std::uint64_t> options;
+
+    // The size of the input file. All shards must read the same file.
+    std::uint64_t input_size = 0;
+
+    unsigned int shard = 0;
+    unsigned int shards = 1;
+};
+
+/**
+ * The header for the partial file of a program reading the input file
+ * with the shard from the input options.
+ */
+partial_header make_partial_header(std::string program,
+                                   std::vector<std::uint64_t> options,
+                                   std::string const &input_filename,
+                                   input_options const &input);
+
+/**
+ * Write a partial file. Func is called to write the state after the
+ * header. The file is written with write_file_atomically(), so there is
+ * never an incomplete partial file.
+ *
+ * @throws std::runtime_error if the file can't be written.
+ */
+void write_partial_file(std::string const &file_name,
+                        partial_header const &header,
+                        std::function<void(std::ostream &)> const &func);
+
+/// @throws std::runtime_error if the file is not a partial file.
+partial_header read_partial_header(std::string const &file_name);
+
+/**
+ * Open a partial file and return a stream positioned at the state after
+ * the header. This is for reading parts of the state with several streams
+ * at once, use read_partial_file() otherwise.
+ *
+ * @throws std::runtime_error if the file is not a partial file.
+ */
+std::ifstream open_partial_file(std::string const &file_name);
+
+/**
+ * Read a partial file. Func is called to read the state after the header.
+ *
+ * @throws std::runtime_error if the file is not a partial file or the
+ *         state is incomplete.
+ */
+void read_partial_file(std::string const &file_name,
+                       std::function<void(std::istream &)> const &func);
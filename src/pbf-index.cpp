@@ -0,0 +1,251 @@
+#include "pbf-index.hpp"
+
+#include "osmium-internals.hpp"
+
+#include <osmium/osm/object.hpp>
+#include <osmium/thread/pool.hpp>
+
+#include <protozero/pbf_reader.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Limits from the PBF format specification.
+static constexpr std::uint32_t const max_blob_header_size = 64U * 1024U;
+static constexpr std::uint32_t const max_blob_size = 32U * 1024U * 1024U;
+
+static constexpr char const *const index_magic = "odmt-pbf-index";
+static constexpr int const index_version = 1;
+
+PBFFile::PBFFile(std::string name)
+: m_name(std::move(name)), m_fd(::open(m_name.c_str(), O_RDONLY))
+{
+    if (m_fd < 0) {
+        throw std::runtime_error{"Could not open file '" + m_name + "'"};
+    }
+
+    struct stat s = {};
+    if (::fstat(m_fd, &s) != 0) {
+        ::close(m_fd);
+        throw std::runtime_error{"Could not stat file '" + m_name + "'"};
+    }
+    m_size = static_cast<std::uint64_t>(s.st_size);
+}
+
+PBFFile::~PBFFile() noexcept { ::close(m_fd); }
+
+std::string PBFFile::read(std::uint64_t offset, std::size_t size) const
+{
+    std::string data(size, '\0');
+
+    std::size_t done = 0;
+    while (done < size) {
+        auto const n = ::pread(m_fd, &data[done], size - done,
+                               static_cast<off_t>(offset + done));
+        if (n <= 0) {
+            throw std::runtime_error{"Error reading file '" + m_name + "'"};
+        }
+        done += static_cast<std::size_t>(n);
+    }
+
+    return data;
+}
+
+std::string pbf_index_file_name(std::string const &pbf_file_name)
+{
+    return pbf_file_name + ".odmt-index";
+}
+
+std::vector<pbf_blob_info> scan_pbf_blobs(std::string const &pbf_file_name)
+{
+    PBFFile const file{pbf_file_name};
+    std::vector<pbf_blob_info> blobs;
+
+    std::uint64_t offset = 0;
+    while (offset < file.size()) {
+        if (offset + 4 > file.size()) {
+            throw std::runtime_error{"Truncated PBF file '" + pbf_file_name +
+                                     "'"};
+        }
+        auto const size_data = file.read(offset, 4);
+        std::uint32_t header_size = 0;
+        for (char const c : size_data) {
+            header_size = (header_size << 8U) |
+                          static_cast<std::uint32_t>(
+                              static_cast<unsigned char>(c));
+        }
+        if (header_size > max_blob_header_size) {
+            throw std::runtime_error{"Invalid BlobHeader size in file '" +
+                                     pbf_file_name + "' (not a PBF file?)"};
+        }
+        offset += 4;
+
+        auto const header = file.read(offset, header_size);
+        offset += header_size;
+
+        std::string type;
+        std::int32_t data_size = 0;
+        protozero::pbf_reader reader{header};
+        while (reader.next()) {
+            switch (reader.tag()) {
+            case 1: // BlobHeader.type
+                type = reader.get_string();
+                break;
+            case 3: // BlobHeader.datasize
+                data_size = reader.get_int32();
+                break;
+            default:
+                reader.skip();
+            }
+        }
+
+        if (data_size < 0 ||
+            static_cast<std::uint32_t>(data_size) > max_blob_size ||
+            offset + static_cast<std::uint64_t>(data_size) > file.size()) {
+            throw std::runtime_error{"Invalid Blob size in file '" +
+                                     pbf_file_name + "'"};
+        }
+
+        if (type == "OSMData") {
+            pbf_blob_info blob;
+            blob.offset = offset;
+            blob.size = static_cast<std::uint32_t>(data_size);
+            blobs.push_back(blob);
+        }
+
+        offset += static_cast<std::uint64_t>(data_size);
+    }
+
+    return blobs;
+}
+
+static pbf_blob_info decode_blob_info(pbf_blob_info blob, std::string &&data)
+{
+    auto const buffer =
+        decode_pbf_blob(std::move(data), osmium::osm_entity_bits::nwr, false);
+
+    bool first = true;
+    for (auto const &object : buffer.select<osmium::OSMObject>()) {
+        blob.entities |=
+            osmium::osm_entity_bits::from_item_type(object.type());
+        if (first) {
+            blob.min_id = object.id();
+            blob.max_id = object.id();
+            first = false;
+        } else {
+            blob.min_id = std::min(blob.min_id, object.id());
+            blob.max_id = std::max(blob.max_id, object.id());
+        }
+    }
+
+    return blob;
+}
+
+std::vector<pbf_blob_info> build_pbf_index(std::string const &pbf_file_name)
+{
+    auto blobs = scan_pbf_blobs(pbf_file_name);
+    PBFFile const file{pbf_file_name};
+
+    auto &pool = osmium::thread::Pool::default_instance();
+    std::deque<std::future<pbf_blob_info>> queue;
+    std::size_t const max_in_flight =
+        static_cast<std::size_t>(pool.num_threads()) * 4;
+
+    std::size_t done = 0;
+    for (auto const &blob : blobs) {
+        queue.push_back(pool.submit(
+            [blob, data = file.read(blob.offset, blob.size)]() mutable {
+                return decode_blob_info(blob, std::move(data));
+            }));
+        if (queue.size() > max_in_flight) {
+            blobs[done++] = queue.front().get();
+            queue.pop_front();
+        }
+    }
+
+    while (!queue.empty()) {
+        blobs[done++] = queue.front().get();
+        queue.pop_front();
+    }
+
+    return blobs;
+}
+
+static std::pair<std::uint64_t, std::int64_t>
+file_size_and_mtime(std::string const &file_name)
+{
+    struct stat s = {};
+    if (::stat(file_name.c_str(), &s) != 0) {
+        return {0, 0};
+    }
+    return {static_cast<std::uint64_t>(s.st_size),
+            static_cast<std::int64_t>(s.st_mtime)};
+}
+
+void write_pbf_index(std::string const &pbf_file_name,
+                     std::vector<pbf_blob_info> const &blobs)
+{
+    auto const index_file_name = pbf_index_file_name(pbf_file_name);
+    std::ofstream out{index_file_name};
+    if (!out.is_open()) {
+        throw std::runtime_error{"Could not open file '" + index_file_name +
+                                 "'"};
+    }
+
+    auto const stat = file_size_and_mtime(pbf_file_name);
+    out << index_magic << ' ' << index_version << ' ' << stat.first << ' '
+        << stat.second << ' ' << blobs.size() << '\n';
+
+    for (auto const &blob : blobs) {
+        out << blob.offset << ' ' << blob.size << ' '
+            << static_cast<unsigned int>(blob.entities) << ' ' << blob.min_id
+            << ' ' << blob.max_id << '\n';
+    }
+
+    out.close();
+    if (!out) {
+        throw std::runtime_error{"Error writing file '" + index_file_name +
+                                 "'"};
+    }
+}
+
+bool read_pbf_index(std::string const &pbf_file_name,
+                    std::vector<pbf_blob_info> *blobs)
+{
+    std::ifstream in{pbf_index_file_name(pbf_file_name)};
+    if (!in.is_open()) {
+        return false;
+    }
+
+    std::string magic;
+    int version = 0;
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+    std::size_t count = 0;
+    in >> magic >> version >> size >> mtime >> count;
+    if (!in || magic != index_magic || version != index_version ||
+        std::make_pair(size, mtime) != file_size_and_mtime(pbf_file_name)) {
+        return false;
+    }
+
+    blobs->clear();
+    blobs->reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        pbf_blob_info blob;
+        unsigned int entities = 0;
+        in >> blob.offset >> blob.size >> entities >> blob.min_id >>
+            blob.max_id;
+        blob.entities = static_cast<osmium::osm_entity_bits::type>(entities);
+        blobs->push_back(blob);
+    }
+
+    return static_cast<bool>(in);
+}
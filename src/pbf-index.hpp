@@ -0,0 +1,88 @@
+#pragma once
+
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Position and contents of one OSMData blob in a PBF file. The offset and
+ * size are those of the Blob message itself, not of the BlobHeader in
+ * front of it.
+ */
+struct pbf_blob_info
+{
+    std::uint64_t offset = 0;
+    std::uint32_t size = 0;
+    osmium::osm_entity_bits::type entities = osmium::osm_entity_bits::nothing;
+    osmium::object_id_type min_id = 0;
+    osmium::object_id_type max_id = 0;
+};
+
+/// A PBF file opened for reading data at known offsets.
+class PBFFile
+{
+
+    std::string m_name;
+    int m_fd;
+    std::uint64_t m_size = 0;
+
+public:
+    /// @throws std::runtime_error if the file can't be opened.
+    explicit PBFFile(std::string name);
+
+    PBFFile(PBFFile const &) = delete;
+    PBFFile &operator=(PBFFile const &) = delete;
+
+    PBFFile(PBFFile &&) = delete;
+    PBFFile &operator=(PBFFile &&) = delete;
+
+    ~PBFFile() noexcept;
+
+    [[nodiscard]] std::string const &name() const noexcept { return m_name; }
+
+    [[nodiscard]] std::uint64_t size() const noexcept { return m_size; }
+
+    [[nodiscard]] int fd() const noexcept { return m_fd; }
+
+    /// @throws std::runtime_error if the data can't be read completely.
+    [[nodiscard]] std::string read(std::uint64_t offset,
+                                   std::size_t size) const;
+
+}; // class PBFFile
+
+/// The name of the blob index file for a PBF file.
+std::string pbf_index_file_name(std::string const &pbf_file_name);
+
+/**
+ * Find all OSMData blobs in a PBF file. This only reads the blob headers,
+ * the entities and ID ranges are not filled in.
+ *
+ * @throws std::runtime_error if the file is not a valid PBF file.
+ */
+std::vector<pbf_blob_info> scan_pbf_blobs(std::string const &pbf_file_name);
+
+/**
+ * Find all OSMData blobs in a PBF file and decode them to find out which
+ * types of objects and which ID ranges they contain. Blobs are decoded in
+ * the osmium thread pool.
+ */
+std::vector<pbf_blob_info> build_pbf_index(std::string const &pbf_file_name);
+
+/**
+ * Write the index for a PBF file. It is written next to the PBF file and
+ * records size and modification time of the PBF file so that outdated
+ * indexes can be detected.
+ */
+void write_pbf_index(std::string const &pbf_file_name,
+                     std::vector<pbf_blob_info> const &blobs);
+
+/**
+ * Read the index for a PBF file. Returns false if there is no index or if
+ * it doesn't match the PBF file (any more).
+ */
+bool read_pbf_index(std::string const &pbf_file_name,
+                    std::vector<pbf_blob_info> *blobs);
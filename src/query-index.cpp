@@ -0,0 +1,243 @@
+#include "query-index.hpp"
+
+#include "osmium-internals.hpp"
+#include "tag-stats-state.hpp"
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/tag.hpp>
+#include <osmium/osm/way.hpp>
+
+#include <charconv>
+#include <exception>
+#include <sstream>
+#include <system_error>
+
+static bool parse_id(std::string_view arg, osmium::unsigned_object_id_type *id)
+{
+    auto const *end = arg.data() + arg.size();
+    auto const result = std::from_chars(arg.data(), end, *id);
+    return result.ec == std::errc{} && result.ptr == end;
+}
+
+static char const *yes_no(bool value) noexcept { return value ? "yes" : "no"; }
+
+static std::string ok(lptype type)
+{
+    std::ostringstream out;
+    out << "OK " << type;
+    return out.str();
+}
+
+QueryIndex::QueryIndex(query_index_options const &options, bool has_input)
+: m_classifier(options.line_or_polygon),
+  m_topology_from_input(has_input && options.topology_directory.empty()),
+  m_has_input(has_input),
+  m_count_from_input(has_input && options.tag_stats_state.empty()),
+  m_with_values(options.with_values)
+{
+    if (!options.topology_directory.empty()) {
+        m_topology = std::make_unique<TopologyState>(
+            options.topology_directory, open_mode::read);
+    }
+
+    if (!options.tag_stats_state.empty()) {
+        TagStatsState state{tag_stats_options{}};
+        state.read(options.tag_stats_state);
+        bool const tags = state.options().with_values;
+        auto *counts = tags ? &m_tag_counts : &m_key_counts;
+        state.for_each_count([&](std::string const &string,
+                                 std::uint64_t count) {
+            counts->emplace(string, count);
+        });
+        m_has_tag_counts = tags;
+        m_has_key_counts = !tags;
+    }
+
+    if (m_count_from_input) {
+        m_has_key_counts = true;
+        m_has_tag_counts = m_with_values;
+    }
+}
+
+osmium::osm_entity_bits::type QueryIndex::entities() const noexcept
+{
+    if (m_count_from_input) {
+        return osmium::osm_entity_bits::nwr;
+    }
+
+    if (m_topology_from_input) {
+        return osmium::osm_entity_bits::way | osmium::osm_entity_bits::relation;
+    }
+
+    return m_has_input ? osmium::osm_entity_bits::way
+                       : osmium::osm_entity_bits::nothing;
+}
+
+void QueryIndex::add_way(osmium::OSMObject const &object)
+{
+    auto const &way = static_cast<osmium::Way const &>(object);
+
+    auto const id = way.positive_id();
+    if (id >= m_way_types.size()) {
+        m_way_types.resize(static_cast<std::size_t>(id) + 1);
+    }
+
+    if (way.nodes().empty() || !way.is_closed()) {
+        m_way_types[id] = 1;
+    } else if (way.tags().empty()) {
+        m_way_types[id] = static_cast<std::uint8_t>(lptype::unclassified) + 2;
+    } else {
+        std::vector<std::string> unknown_keys;
+        auto const type = m_classifier.get_type(way.tags(), &unknown_keys);
+        m_way_types[id] = static_cast<std::uint8_t>(type) + 2;
+    }
+
+    if (!m_topology_from_input || way.nodes().empty()) {
+        return;
+    }
+
+    // Closed ways count only once for their first and last node, like in
+    // odmt-way-nodes.
+    auto const *it = way.nodes().begin();
+    if (way.is_closed()) {
+        ++it;
+    }
+    for (; it != way.nodes().end(); ++it) {
+        if (m_in_way.get(it->positive_ref())) {
+            m_in_multiple_ways.set(it->positive_ref());
+        } else {
+            m_in_way.set(it->positive_ref());
+        }
+    }
+}
+
+void QueryIndex::object(osmium::OSMObject const &object)
+{
+    if (m_count_from_input) {
+        for (auto const &tag : object.tags()) {
+            ++m_key_counts[tag.key()];
+            if (m_with_values) {
+                ++m_tag_counts[tag.key() + std::string{"="} + tag.value()];
+            }
+        }
+    }
+
+    if (object.type() == osmium::item_type::way) {
+        add_way(object);
+    } else if (object.type() == osmium::item_type::relation &&
+               m_topology_from_input) {
+        for (auto const &member :
+             static_cast<osmium::Relation const &>(object).members()) {
+            if (member.type() == osmium::item_type::node) {
+                m_in_relation.set(member.positive_ref());
+            }
+        }
+    }
+}
+
+std::string QueryIndex::query_node(std::string_view arg) const
+{
+    if (!m_topology && !m_topology_from_input) {
+        return "ERROR no topology (needs --topology or an input file)";
+    }
+
+    osmium::unsigned_object_id_type id = 0;
+    if (!parse_id(arg, &id)) {
+        return "ERROR invalid node ID";
+    }
+
+    bool const in_way = m_topology ? m_topology->in_way(id) : m_in_way.get(id);
+    bool const in_multiple_ways = m_topology ? m_topology->in_multiple_ways(id)
+                                             : m_in_multiple_ways.get(id);
+    bool const in_relation =
+        m_topology ? m_topology->in_relation(id) : m_in_relation.get(id);
+
+    return std::string{"OK in-way="} + yes_no(in_way) +
+           " multiple-ways=" + yes_no(in_multiple_ways) +
+           " relation=" + yes_no(in_relation);
+}
+
+std::string QueryIndex::query_way(std::string_view arg) const
+{
+    if (!m_has_input) {
+        return "ERROR no ways (needs an input file)";
+    }
+
+    osmium::unsigned_object_id_type id = 0;
+    if (!parse_id(arg, &id)) {
+        return "ERROR invalid way ID";
+    }
+
+    if (id >= m_way_types.size() || m_way_types[id] == 0) {
+        return "OK missing";
+    }
+    if (m_way_types[id] == 1) {
+        return "OK not-closed";
+    }
+    return ok(static_cast<lptype>(m_way_types[id] - 2));
+}
+
+std::string QueryIndex::query_classify(std::string_view arg) const
+{
+    if (arg.empty()) {
+        return ok(lptype::unclassified);
+    }
+
+    // The OPL parser stops at a space, so the rest of the line would be
+    // ignored silently.
+    if (arg.find_first_of(" \t") != std::string_view::npos) {
+        return "ERROR tags must be in OPL format (k=v,k=v with %XX% escapes)";
+    }
+
+    std::string const tags{arg}; // null terminated for the OPL parser
+    osmium::memory::Buffer buffer{1024,
+                                  osmium::memory::Buffer::auto_grow::yes};
+    parse_opl_tags(tags.c_str(), &buffer);
+    buffer.commit();
+
+    std::vector<std::string> unknown_keys;
+    return ok(m_classifier.get_type(buffer.get<osmium::TagList>(0),
+                                    &unknown_keys));
+}
+
+std::string QueryIndex::query_count(std::string_view arg) const
+{
+    bool const is_tag = arg.find('=') != std::string_view::npos;
+    if (is_tag ? !m_has_tag_counts : !m_has_key_counts) {
+        return is_tag ? "ERROR no tag counts (needs --with-values)"
+                      : "ERROR no key counts";
+    }
+
+    auto const &counts = is_tag ? m_tag_counts : m_key_counts;
+    auto const it = counts.find(std::string{arg});
+    return "OK " + std::to_string(it == counts.end() ? 0 : it->second);
+}
+
+std::string QueryIndex::query(std::string_view request) const
+{
+    auto const space = request.find(' ');
+    auto const command = request.substr(0, space);
+    auto const arg = space == std::string_view::npos
+                         ? std::string_view{}
+                         : request.substr(space + 1);
+
+    try {
+        if (command == "node") {
+            return query_node(arg);
+        }
+        if (command == "way") {
+            return query_way(arg);
+        }
+        if (command == "classify") {
+            return query_classify(arg);
+        }
+        if (command == "count") {
+            return query_count(arg);
+        }
+    } catch (std::exception const &e) {
+        return std::string{"ERROR "} + e.what();
+    }
+
+    return "ERROR unknown query '" + std::string{command} + "'";
+}
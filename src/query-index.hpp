@@ -0,0 +1,97 @@
+#pragma once
+
+#include "line-or-polygon-analysis.hpp"
+#include "topology-state.hpp"
+
+#include <osmium/index/id_set.hpp>
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct query_index_options
+{
+    // Directory with a topology state (see odmt-topology). If empty, the
+    // topology is built from the input.
+    std::string topology_directory;
+
+    // Tag stats state file (see odmt-tag-stats). If empty, keys (and tags)
+    // are counted in the input.
+    std::string tag_stats_state;
+
+    // Also count tags when counting in the input.
+    bool with_values = false;
+
+    line_or_polygon_options line_or_polygon;
+};
+
+/**
+ * The indexes odmt-serve answers queries from. They are built once from
+ * the input or loaded from the states written by odmt-topology and
+ * odmt-tag-stats. After that they are only read, so query() can be called
+ * from several threads at the same time.
+ *
+ * Each query is one line, the answer is one line, too. It starts with "OK"
+ * or "ERROR", see doc/serve.md for the queries.
+ */
+class QueryIndex
+{
+
+    using id_set = osmium::index::IdSetDense<osmium::unsigned_object_id_type>;
+
+    LineOrPolygonClassifier m_classifier;
+
+    // Topology from a state or from the input.
+    std::unique_ptr<TopologyState> m_topology;
+    id_set m_in_way;
+    id_set m_in_multiple_ways;
+    id_set m_in_relation;
+    bool m_topology_from_input;
+
+    // Type of each way from the input by way ID: 0 = not in input,
+    // 1 = not closed, otherwise the lptype of the closed way + 2.
+    std::vector<std::uint8_t> m_way_types;
+    bool m_has_input;
+
+    std::unordered_map<std::string, std::uint64_t> m_key_counts;
+    std::unordered_map<std::string, std::uint64_t> m_tag_counts;
+    bool m_has_key_counts = false;
+    bool m_has_tag_counts = false;
+    bool m_count_from_input;
+    bool m_with_values;
+
+    void add_way(osmium::OSMObject const &object);
+
+    std::string query_node(std::string_view arg) const;
+
+    std::string query_way(std::string_view arg) const;
+
+    std::string query_classify(std::string_view arg) const;
+
+    std::string query_count(std::string_view arg) const;
+
+public:
+    /**
+     * Load the states given in the options. If has_input is set, the
+     * missing indexes are built from the objects given to object().
+     *
+     * @throws std::runtime_error if a state can't be loaded.
+     */
+    QueryIndex(query_index_options const &options, bool has_input);
+
+    /// The types of objects needed from the input.
+    [[nodiscard]] osmium::osm_entity_bits::type entities() const noexcept;
+
+    /// Add an object from the input to the indexes.
+    void object(osmium::OSMObject const &object);
+
+    /// Answer one query (without the newline).
+    [[nodiscard]] std::string query(std::string_view request) const;
+
+}; // class QueryIndex
@@ -0,0 +1,188 @@
+#include "radix-sort.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Buckets smaller than this are sorted with std::sort.
+static constexpr std::size_t const min_radix_sort_size = 256;
+
+namespace {
+
+using bucket_list = std::array<std::size_t, 257>;
+
+} // anonymous namespace
+
+static unsigned int digit(std::uint64_t key, unsigned int shift) noexcept
+{
+    return static_cast<unsigned int>(key >> shift) & 0xffU;
+}
+
+template <typename TPayload>
+static constexpr bool has_payload() noexcept
+{
+    return !std::is_same<TPayload, no_payload>::value;
+}
+
+template <typename TPayload>
+static TPayload *advance(TPayload *payload, std::size_t n) noexcept
+{
+    if constexpr (has_payload<TPayload>()) {
+        return payload + n;
+    } else {
+        return payload;
+    }
+}
+
+template <typename TPayload>
+static void small_sort(std::uint64_t *keys, TPayload *payload,
+                       std::size_t size)
+{
+    if constexpr (!has_payload<TPayload>()) {
+        std::sort(keys, keys + size);
+    } else {
+        std::vector<std::pair<std::uint64_t, TPayload>> data;
+        data.reserve(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            data.emplace_back(keys[i], payload[i]);
+        }
+        std::sort(data.begin(), data.end(), [](auto const &a, auto const &b) {
+            return a.first < b.first;
+        });
+        for (std::size_t i = 0; i < size; ++i) {
+            keys[i] = data[i].first;
+            payload[i] = data[i].second;
+        }
+    }
+}
+
+/**
+ * Partition the keys in place into 256 buckets by the 8 bits of the keys
+ * starting at bit "shift" ("American flag sort"). The payload, if any, is
+ * moved along with the keys.
+ */
+template <typename TPayload>
+static bucket_list partition(std::uint64_t *keys, TPayload *payload,
+                             std::size_t size, unsigned int shift)
+{
+    std::array<std::size_t, 256> counts{};
+    for (std::size_t i = 0; i < size; ++i) {
+        ++counts[digit(keys[i], shift)];
+    }
+
+    bucket_list bounds{};
+    std::array<std::size_t, 256> heads{};
+    for (std::size_t b = 0; b < 256; ++b) {
+        heads[b] = bounds[b];
+        bounds[b + 1] = bounds[b] + counts[b];
+    }
+
+    for (std::size_t b = 0; b < 256; ++b) {
+        while (heads[b] != bounds[b + 1]) {
+            auto const pos = heads[b]++;
+            auto value = keys[pos];
+            auto d = digit(value, shift);
+            while (d != b) {
+                auto const dest = heads[d]++;
+                std::swap(value, keys[dest]);
+                if constexpr (has_payload<TPayload>()) {
+                    std::swap(payload[pos], payload[dest]);
+                }
+                d = digit(value, shift);
+            }
+            keys[pos] = value;
+        }
+    }
+
+    return bounds;
+}
+
+template <typename TPayload>
+static void sort_bucket(std::uint64_t *keys, TPayload *payload,
+                        std::size_t size, unsigned int shift)
+{
+    if (size < min_radix_sort_size) {
+        small_sort(keys, payload, size);
+        return;
+    }
+
+    auto const bounds = partition(keys, payload, size, shift);
+    if (shift == 0) {
+        return;
+    }
+
+    // The next digit might overlap with this one if there are less than
+    // 8 bits left. That's okay, because those bits are the same for all
+    // keys in a bucket.
+    auto const next_shift = shift > 8 ? shift - 8 : 0;
+    for (std::size_t b = 0; b < 256; ++b) {
+        sort_bucket(keys + bounds[b], advance(payload, bounds[b]),
+                    bounds[b + 1] - bounds[b], next_shift);
+    }
+}
+
+template <typename TPayload>
+static void radix_sort_impl(std::uint64_t *keys, TPayload *payload,
+                            std::size_t size, unsigned int num_threads)
+{
+    if (size < min_radix_sort_size) {
+        small_sort(keys, payload, size);
+        return;
+    }
+
+    // Find highest bit that isn't the same in all keys and start sorting
+    // with the digit ending there. This way the top level partitioning
+    // uses all buckets even if the keys only use a small range.
+    std::uint64_t diff = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+        diff |= keys[i] ^ keys[0];
+    }
+    if (diff == 0) {
+        return;
+    }
+    auto const top_bit = 63U - static_cast<unsigned int>(__builtin_clzll(diff));
+    auto const shift = top_bit > 7 ? top_bit - 7 : 0;
+
+    auto const bounds = partition(keys, payload, size, shift);
+    if (shift == 0) {
+        return;
+    }
+    auto const next_shift = shift > 8 ? shift - 8 : 0;
+
+    std::atomic<std::size_t> next_bucket{0};
+    auto const worker = [&]() {
+        for (auto b = next_bucket++; b < 256; b = next_bucket++) {
+            sort_bucket(keys + bounds[b], advance(payload, bounds[b]),
+                        bounds[b + 1] - bounds[b], next_shift);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < num_threads; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+void radix_sort(std::uint64_t *first, std::uint64_t *last,
+                unsigned int num_threads)
+{
+    no_payload *payload = nullptr;
+    radix_sort_impl(first, payload, static_cast<std::size_t>(last - first),
+                    num_threads);
+}
+
+void radix_sort(std::uint64_t *first, std::uint64_t *last,
+                std::uint64_t *payload, unsigned int num_threads)
+{
+    radix_sort_impl(first, payload, static_cast<std::size_t>(last - first),
+                    num_threads);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+/// Used as payload type for sorting keys without payload.
+struct no_payload
+{};
+
+/**
+ * Sort the 64 bit keys in [first, last) in place using an MSD radix sort.
+ * The top level partitioning runs in the calling thread, the resulting
+ * buckets are then sorted by up to num_threads threads.
+ */
+void radix_sort(std::uint64_t *first, std::uint64_t *last,
+                unsigned int num_threads);
+
+/**
+ * Sort the 64 bit keys in [first, last) like above. The payload array
+ * must have the same size as the keys, its elements are moved along with
+ * the keys. The order of payloads with the same key is unspecified.
+ */
+void radix_sort(std::uint64_t *first, std::uint64_t *last,
+                std::uint64_t *payload, unsigned int num_threads);
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * A set of unsigned IDs stored as a bitmap. After the set has been filled
+ * and "frozen", it can map each ID in the set to its rank (the number of
+ * smaller IDs in the set) and back. Ranks are dense and fit into 32 bits,
+ * so they can be used as compact stand-ins for the 64 bit IDs.
+ *
+ * The bitmap is stored in chunks like osmium::index::IdSetDense, so growing
+ * the set never has to copy the whole thing. Without freeze() this is just
+ * a bitmap set that can be saved and loaded quickly (see save()).
+ */
+class RankedIdSet
+{
+
+    static constexpr std::size_t const chunk_bits = 22;
+    static constexpr std::size_t const words_per_chunk =
+        (std::size_t{1} << chunk_bits) / 64;
+    static constexpr std::size_t const words_per_block = 8;
+    static constexpr std::size_t const blocks_per_chunk =
+        words_per_chunk / words_per_block;
+
+    std::vector<std::unique_ptr<std::uint64_t[]>> m_chunks;
+
+    // Number of IDs in the set before each block of 512 bits.
+    std::vector<std::uint32_t> m_block_ranks;
+
+    std::uint64_t m_size = 0;
+
+    [[nodiscard]] std::uint64_t word(std::size_t n) const noexcept
+    {
+        auto const chunk = n / words_per_chunk;
+        if (chunk >= m_chunks.size() || !m_chunks[chunk]) {
+            return 0;
+        }
+        return m_chunks[chunk][n % words_per_chunk];
+    }
+
+    static int popcount(std::uint64_t value) noexcept
+    {
+        return __builtin_popcountll(value);
+    }
+
+public:
+    void set(std::uint64_t id)
+    {
+        assert(!frozen());
+
+        auto const chunk = id >> chunk_bits;
+        if (chunk >= m_chunks.size()) {
+            m_chunks.resize(chunk + 1);
+        }
+        if (!m_chunks[chunk]) {
+            m_chunks[chunk] =
+                std::make_unique<std::uint64_t[]>(words_per_chunk);
+        }
+
+        auto &w = m_chunks[chunk][(id / 64) % words_per_chunk];
+        auto const bit = std::uint64_t{1} << (id % 64);
+        if (!(w & bit)) {
+            w |= bit;
+            ++m_size;
+        }
+    }
+
+    [[nodiscard]] bool get(std::uint64_t id) const noexcept
+    {
+        return (word(id / 64) >> (id % 64)) & 1U;
+    }
+
+    [[nodiscard]] std::uint64_t size() const noexcept { return m_size; }
+
+    /// Remove all IDs and the rank index.
+    void clear()
+    {
+        m_chunks.clear();
+        m_block_ranks.clear();
+        m_size = 0;
+    }
+
+    /**
+     * Write the bitmap chunks as they are in memory. This is much faster
+     * than writing the IDs and the size only depends on the range of IDs,
+     * but the data can only be read on a machine with the same byte order.
+     * The rank index is not written.
+     */
+    void save(std::ostream &out) const
+    {
+        std::uint64_t const header[2] = {m_chunks.size(), m_size};
+        out.write(reinterpret_cast<char const *>(header), sizeof(header));
+        for (auto const &chunk : m_chunks) {
+            out.put(chunk ? 1 : 0);
+            if (chunk) {
+                out.write(reinterpret_cast<char const *>(chunk.get()),
+                          words_per_chunk * sizeof(std::uint64_t));
+            }
+        }
+    }
+
+    /**
+     * Read the bitmap written by save() into an empty set.
+     *
+     * @throws std::runtime_error at the end of the input.
+     */
+    void load(std::istream &in)
+    {
+        assert(m_chunks.empty() && !frozen());
+
+        std::uint64_t header[2] = {0, 0};
+        in.read(reinterpret_cast<char *>(header), sizeof(header));
+        m_chunks.resize(static_cast<std::size_t>(in ? header[0] : 0));
+        m_size = header[1];
+        for (auto &chunk : m_chunks) {
+            if (in.get() == 1) {
+                chunk = std::make_unique<std::uint64_t[]>(words_per_chunk);
+                in.read(reinterpret_cast<char *>(chunk.get()),
+                        words_per_chunk * sizeof(std::uint64_t));
+            }
+        }
+        if (!in) {
+            throw std::runtime_error{"Unexpected end of file"};
+        }
+    }
+
+    /// Call func with each ID in the set in ascending order.
+    template <typename TFunc>
+    void for_each(TFunc &&func) const
+    {
+        for (std::size_t chunk = 0; chunk < m_chunks.size(); ++chunk) {
+            if (!m_chunks[chunk]) {
+                continue;
+            }
+            for (std::size_t n = 0; n < words_per_chunk; ++n) {
+                auto w = m_chunks[chunk][n];
+                auto const base = (chunk * words_per_chunk + n) * 64;
+                for (; w != 0; w &= w - 1) {
+                    func(base + static_cast<std::uint64_t>(__builtin_ctzll(w)));
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] bool frozen() const noexcept
+    {
+        return !m_block_ranks.empty();
+    }
+
+    /**
+     * Build the rank index. After this the set can't be changed any more.
+     *
+     * @throws std::length_error if there are too many IDs for 32 bit ranks.
+     */
+    void freeze()
+    {
+        if (m_size >= std::numeric_limits<std::uint32_t>::max()) {
+            throw std::length_error{"Too many IDs for 32 bit ranks"};
+        }
+
+        m_block_ranks.reserve(m_chunks.size() * blocks_per_chunk + 1);
+
+        std::uint32_t rank = 0;
+        for (auto const &chunk : m_chunks) {
+            for (std::size_t block = 0; block < blocks_per_chunk; ++block) {
+                m_block_ranks.push_back(rank);
+                if (chunk) {
+                    for (std::size_t n = 0; n < words_per_block; ++n) {
+                        rank += popcount(chunk[block * words_per_block + n]);
+                    }
+                }
+            }
+        }
+
+        // sentinel so that the index is never empty
+        m_block_ranks.push_back(rank);
+    }
+
+    /// Return the rank of an ID. The ID must be in the set.
+    [[nodiscard]] std::uint32_t rank(std::uint64_t id) const noexcept
+    {
+        assert(frozen());
+        assert(get(id));
+
+        auto const n = id / 64;
+        auto const block = n / words_per_block;
+
+        std::uint32_t rank = m_block_ranks[block];
+        for (auto w = block * words_per_block; w < n; ++w) {
+            rank += popcount(word(w));
+        }
+
+        auto const mask = (std::uint64_t{1} << (id % 64)) - 1;
+        return rank + popcount(word(n) & mask);
+    }
+
+    /// Return the ID with the specified rank. This is the inverse of rank().
+    [[nodiscard]] std::uint64_t select(std::uint32_t rank) const noexcept
+    {
+        assert(frozen());
+        assert(rank < m_size);
+
+        auto const it = std::upper_bound(m_block_ranks.begin(),
+                                         m_block_ranks.end(), rank) -
+                        1;
+        auto const block = static_cast<std::size_t>(it - m_block_ranks.begin());
+
+        rank -= *it;
+        auto n = block * words_per_block;
+        auto w = word(n);
+        while (static_cast<std::uint32_t>(popcount(w)) <= rank) {
+            rank -= popcount(w);
+            w = word(++n);
+        }
+
+        for (; rank > 0; --rank) {
+            w &= w - 1; // clear lowest set bit
+        }
+
+        return n * 64 + static_cast<std::uint64_t>(__builtin_ctzll(w));
+    }
+
+}; // class RankedIdSet
+
+/**
+ * Create a compact key for a segment from the ranks of its two nodes. The
+ * key is independent of the direction of the segment. Because ranks are
+ * ordered like the node IDs, sorting keys sorts segments the same way
+ * sorting pairs of node IDs would.
+ */
+inline std::uint64_t segment_key(std::uint32_t a, std::uint32_t b) noexcept
+{
+    if (a > b) {
+        std::swap(a, b);
+    }
+    return (static_cast<std::uint64_t>(a) << 32U) | b;
+}
@@ -22,30 +22,66 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include "filter.hpp"
+#include "input-reader.hpp"
+#include "output-options.hpp"
+#include "run-stats.hpp"
 
 #include <osmium/builder/osm_object_builder.hpp>
 #include <osmium/io/any_input.hpp>
 #include <osmium/io/any_output.hpp>
-#include <osmium/tags/tags_filter.hpp>
+#include <osmium/thread/pool.hpp>
+#include <osmium/util/file.hpp>
 #include <osmium/visitor.hpp>
 
 #include <lyra.hpp>
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <deque>
 #include <exception>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
+
+struct rewrite_stats
+{
+    std::uint64_t objects_changed = 0;
+    std::uint64_t tags_removed = 0;
+    std::uint64_t input_bytes = 0;
+    std::uint64_t output_bytes = 0;
+
+    rewrite_stats &operator+=(rewrite_stats const &other) noexcept
+    {
+        objects_changed += other.objects_changed;
+        tags_removed += other.tags_removed;
+        input_bytes += other.input_bytes;
+        output_bytes += other.output_bytes;
+        return *this;
+    }
+}; // struct rewrite_stats
+
+struct rewrite_result
+{
+    osmium::memory::Buffer buffer;
+    rewrite_stats stats;
+};
 
 class RewriteHandler : public osmium::handler::Handler
 {
 
     osmium::memory::Buffer *m_buffer;
-    osmium::TagsFilter const &m_filter;
+    CompiledTagsFilter const &m_filter;
+    rewrite_stats *m_stats;
 
     template <typename T>
     void copy_attributes(T &builder, osmium::OSMObject const &object)
     {
         builder.set_id(object.id())
+            .set_visible(object.visible())
             .set_version(object.version())
             .set_changeset(object.changeset())
             .set_timestamp(object.timestamp())
@@ -53,28 +89,59 @@ class RewriteHandler : public osmium::handler::Handler
             .set_user(object.user());
     }
 
+    [[nodiscard]] bool has_matching_tag(osmium::TagList const &tags) const
+    {
+        return std::any_of(
+            tags.cbegin(), tags.cend(),
+            [&](osmium::Tag const &tag) { return m_filter(tag); });
+    }
+
+    /**
+     * If the object doesn't have any tags that need removing, copy it
+     * as is into the output buffer. This is much faster than rebuilding
+     * it.
+     */
+    bool copy_unchanged(osmium::OSMObject const &object)
+    {
+        if (has_matching_tag(object.tags())) {
+            return false;
+        }
+        m_buffer->add_item(object);
+        m_buffer->commit();
+        return true;
+    }
+
+    void count_changed() noexcept { ++m_stats->objects_changed; }
+
     void copy_tags(osmium::builder::Builder *parent,
                    osmium::TagList const &tags)
     {
         osmium::builder::TagListBuilder builder{*parent};
 
         for (auto const &tag : tags) {
-            if (!m_filter(tag)) {
+            if (m_filter(tag)) {
+                ++m_stats->tags_removed;
+            } else {
                 builder.add_tag(tag);
             }
         }
     }
 
 public:
-    explicit RewriteHandler(osmium::memory::Buffer *buffer,
-                            osmium::TagsFilter const &filter)
-    : m_buffer(buffer), m_filter(filter)
+    RewriteHandler(osmium::memory::Buffer *buffer,
+                   CompiledTagsFilter const &filter, rewrite_stats *stats)
+    : m_buffer(buffer), m_filter(filter), m_stats(stats)
     {
         assert(buffer);
+        assert(stats);
     }
 
     void node(osmium::Node const &node)
     {
+        if (copy_unchanged(node)) {
+            return;
+        }
+        count_changed();
         {
             osmium::builder::NodeBuilder builder{*m_buffer};
             copy_attributes(builder, node);
@@ -86,6 +153,10 @@ public:
 
     void way(osmium::Way const &way)
     {
+        if (copy_unchanged(way)) {
+            return;
+        }
+        count_changed();
         {
             osmium::builder::WayBuilder builder{*m_buffer};
             copy_attributes(builder, way);
@@ -97,6 +168,10 @@ public:
 
     void relation(osmium::Relation const &relation)
     {
+        if (copy_unchanged(relation)) {
+            return;
+        }
+        count_changed();
         {
             osmium::builder::RelationBuilder builder{*m_buffer};
             copy_attributes(builder, relation);
@@ -108,22 +183,124 @@ public:
 
 }; // class RewriteHandler
 
+/**
+ * Rewrite a buffer once for each filter. Returns one result for each
+ * filter in the same order.
+ */
+static std::vector<rewrite_result>
+rewrite(osmium::memory::Buffer const &buffer,
+        std::vector<CompiledTagsFilter> const &filters)
+{
+    std::vector<rewrite_result> results;
+    results.reserve(filters.size());
+
+    for (auto const &filter : filters) {
+        rewrite_result result{
+            osmium::memory::Buffer{buffer.committed(),
+                                   osmium::memory::Buffer::auto_grow::yes},
+            {}};
+        RewriteHandler handler{&result.buffer, filter, &result.stats};
+        osmium::apply(buffer, handler);
+        result.stats.input_bytes = buffer.committed();
+        result.stats.output_bytes = result.buffer.committed();
+        results.push_back(std::move(result));
+    }
+
+    return results;
+}
+
+/**
+ * Rewrite buffers in a pool of worker threads. The futures for the
+ * results are kept in a queue in input order, so the buffers are written
+ * in the same order they were read in, even if they are finished in a
+ * different order. The number of buffers in flight is limited.
+ */
+template <typename TFunc>
+static void rewrite_parallel(InputReader *reader, RunStats *stats,
+                             std::vector<CompiledTagsFilter> const &filters,
+                             unsigned int num_threads, TFunc &&write)
+{
+    osmium::thread::Pool pool{static_cast<int>(num_threads)};
+    std::deque<std::future<std::vector<rewrite_result>>> queue;
+    std::size_t const max_in_flight = num_threads * 4;
+
+    while (auto buffer = stats->read(reader)) {
+        queue.push_back(pool.submit([&filters, buffer = std::move(buffer)]() {
+            return rewrite(buffer, filters);
+        }));
+        if (queue.size() > max_in_flight) {
+            write(queue.front().get());
+            queue.pop_front();
+        }
+    }
+
+    while (!queue.empty()) {
+        write(queue.front().get());
+        queue.pop_front();
+    }
+}
+
+static void print_summary(std::ostream &out,
+                          std::vector<std::string> const &filter_filenames,
+                          std::vector<std::string> const &output_filenames,
+                          std::vector<rewrite_stats> const &stats)
+{
+    for (std::size_t i = 0; i < stats.size(); ++i) {
+        auto const &s = stats[i];
+        out << "Variant " << (i + 1) << ": '" << filter_filenames[i]
+            << "' -> '" << output_filenames[i] << "'\n"
+            << "  objects changed: " << s.objects_changed << '\n'
+            << "  tags removed: " << s.tags_removed << '\n'
+            << "  object bytes: " << s.input_bytes << " -> "
+            << s.output_bytes << " (saved "
+            << (static_cast<std::int64_t>(s.input_bytes) -
+                static_cast<std::int64_t>(s.output_bytes))
+            << ")\n";
+        if (output_filenames[i] != "-") {
+            out << "  output file size: "
+                << osmium::file_size(output_filenames[i]) << '\n';
+        }
+    }
+}
+
 int main(int argc, char *argv[])
 {
     try {
         std::string input_filename;
-        std::string output_filename;
-        std::string filter_filename;
+        std::string stats_filename;
+        input_options input;
+        output_options output;
+        std::vector<std::string> output_filenames;
+        std::vector<std::string> filter_filenames;
+        unsigned int num_threads = 1;
         bool help = false;
 
         // clang-format off
         auto const cli
-            = lyra::opt(output_filename, "OUTPUT-FILE")
+            = lyra::opt(output_filenames, "OUTPUT-FILE")
                 ["-o"]["--output"]
-                ("output file")
-            | lyra::opt(filter_filename, "FILTER-FILE")
+                ("output file (can be given several times)")
+            | lyra::opt(filter_filenames, "FILTER-FILE")
                 ["-e"]["--expressions"]
-                ("filter expressions file")
+                ("filter expressions file (one for each output file)")
+            | lyra::opt(num_threads, "N")
+                ["-t"]["--threads"]
+                ("number of threads used for rewriting (default: 1)")
+            | lyra::opt(input.format, "FORMAT")
+                ["--input-format"]
+                ("format of input file (needed for STDIN)")
+            | lyra::opt(input.mmap)
+                ["--mmap"]
+                ("memory map PBF input file")
+            | lyra::opt(output.format, "FORMAT")
+                ["--output-format"]
+                ("format of output files (needed for STDOUT)")
+            | lyra::opt(output.compression, "COMPRESSION")
+                ["--output-compression"]
+                ("compression of PBF output files (none, lz4, zlib[:LEVEL])")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
             | lyra::help(help)
             | lyra::arg(input_filename, "FILENAME")
                 ("input file");
@@ -147,35 +324,76 @@ int main(int argc, char *argv[])
             return 1;
         }
 
-        if (output_filename.empty()) {
+        if (output_filenames.empty()) {
             std::cerr << "Missing output filename. Try '-h'.\n";
             return 1;
         }
 
-        if (filter_filename.empty()) {
+        if (filter_filenames.empty()) {
             std::cerr << "Missing filter filename. Try '-h'.\n";
             return 1;
         }
 
-        auto const filter = load_filter_patterns(filter_filename);
+        if (filter_filenames.size() != output_filenames.size()) {
+            std::cerr << "Need exactly one filter file for each output file. "
+                         "Try '-h'.\n";
+            return 1;
+        }
+
+        auto const to_stdout = std::count(output_filenames.cbegin(),
+                                          output_filenames.cend(), "-");
+        if (to_stdout > 1) {
+            std::cerr << "Only one output can go to STDOUT.\n";
+            return 1;
+        }
+
+        RunStats stats{"odmt-remove-tags"};
+        stats.add_input_file(input_filename);
+        stats.add_output_files(output_filenames);
+
+        std::vector<CompiledTagsFilter> filters;
+        for (auto const &filter_filename : filter_filenames) {
+            filters.push_back(load_compiled_filter_patterns(filter_filename));
+        }
 
-        osmium::io::File input_file{input_filename};
-        osmium::io::File output_file{output_filename};
+        auto const input_file = make_input_file(input_filename, input);
+        InputReader reader{input_file, osmium::osm_entity_bits::all, input};
 
-        osmium::io::Reader reader{input_file};
-        osmium::io::Writer writer{output_file, osmium::io::overwrite::allow};
+        std::vector<std::unique_ptr<osmium::io::Writer>> writers;
+        for (auto const &output_filename : output_filenames) {
+            writers.push_back(std::make_unique<osmium::io::Writer>(
+                make_output_file(output_filename, output),
+                osmium::io::overwrite::allow));
+        }
 
-        while (auto const buffer = reader.read()) {
-            osmium::memory::Buffer output_buffer{
-                buffer.committed(), osmium::memory::Buffer::auto_grow::yes};
-            RewriteHandler handler{&output_buffer, filter};
-            osmium::apply(buffer, handler);
-            writer(std::move(output_buffer));
+        std::vector<rewrite_stats> variant_stats(filters.size());
+        auto const write = [&](std::vector<rewrite_result> &&results) {
+            for (std::size_t i = 0; i < results.size(); ++i) {
+                variant_stats[i] += results[i].stats;
+                (*writers[i])(std::move(results[i].buffer));
+            }
+        };
+
+        stats.phase("process");
+        if (num_threads > 1) {
+            rewrite_parallel(&reader, &stats, filters, num_threads, write);
+        } else {
+            while (auto const buffer = stats.read(&reader)) {
+                write(rewrite(buffer, filters));
+            }
         }
 
-        writer.close();
+        stats.phase("write");
+        for (auto &writer : writers) {
+            writer->close();
+        }
         reader.close();
 
+        // The summary must not end up in the data written to STDOUT.
+        print_summary(to_stdout > 0 ? std::cerr : std::cout, filter_filenames,
+                      output_filenames, variant_stats);
+        stats.write_json(stats_filename);
+
     } catch (std::exception const &e) {
         std::cerr << "ERROR: " << e.what() << "\n";
         return 1;
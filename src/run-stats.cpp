@@ -0,0 +1,202 @@
+#include "run-stats.hpp"
+
+#include <osmium/osm/entity.hpp>
+
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <utility>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+static double seconds(timeval const &tv) noexcept
+{
+    return static_cast<double>(tv.tv_sec) +
+           static_cast<double>(tv.tv_usec) / 1000000.0;
+}
+
+// Returns 0 for files that don't exist (any more).
+static std::uint64_t file_size(std::string const &file_name) noexcept
+{
+    struct stat s = {};
+    if (::stat(file_name.c_str(), &s) != 0) {
+        return 0;
+    }
+    return static_cast<std::uint64_t>(s.st_size);
+}
+
+static std::string json_string(std::string const &string)
+{
+    std::string out{"\""};
+    for (char const c : string) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20U) {
+                out += ' ';
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+    return out;
+}
+
+static std::uint64_t write_files(std::ostream &out, char const *name,
+                                 std::vector<std::string> const &file_names)
+{
+    std::uint64_t sum = 0;
+    out << "  \"" << name << "\": [";
+    char const *sep = "\n";
+    for (auto const &file_name : file_names) {
+        auto const size = file_size(file_name);
+        sum += size;
+        out << sep << "    {\"name\": " << json_string(file_name)
+            << ", \"bytes\": " << size << '}';
+        sep = ",\n";
+    }
+    out << (file_names.empty() ? "],\n" : "\n  ],\n");
+    return sum;
+}
+
+RunStats::RunStats(std::string tool)
+: m_tool(std::move(tool)), m_start(clock::now())
+{
+}
+
+RunStats::times RunStats::now() const
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    std::chrono::duration<double> const wall = clock::now() - m_start;
+    return {wall.count(), seconds(usage.ru_utime), seconds(usage.ru_stime)};
+}
+
+void RunStats::add_input_file(std::string const &file_name)
+{
+    m_input_files.push_back(file_name);
+}
+
+void RunStats::add_output_file(std::string const &file_name)
+{
+    m_output_files.push_back(file_name);
+}
+
+void RunStats::add_output_files(std::vector<std::string> const &file_names)
+{
+    m_output_files.insert(m_output_files.end(), file_names.cbegin(),
+                          file_names.cend());
+}
+
+void RunStats::phase(std::string const &name)
+{
+    end_phase();
+
+    m_current = 0;
+    while (m_current < m_phases.size() && m_phases[m_current].name != name) {
+        ++m_current;
+    }
+    if (m_current == m_phases.size()) {
+        m_phases.push_back({name, {}});
+    }
+
+    m_in_phase = true;
+    m_phase_start = now();
+}
+
+void RunStats::end_phase()
+{
+    if (!m_in_phase) {
+        return;
+    }
+
+    auto const end = now();
+    auto &t = m_phases[m_current].time;
+    t.wall += end.wall - m_phase_start.wall;
+    t.user += end.user - m_phase_start.user;
+    t.system += end.system - m_phase_start.system;
+    m_in_phase = false;
+}
+
+void RunStats::add_buffer(osmium::memory::Buffer const &buffer) noexcept
+{
+    ++m_buffers;
+    m_buffer_bytes += buffer.committed();
+
+    for (auto const &entity : buffer.select<osmium::OSMEntity>()) {
+        switch (entity.type()) {
+        case osmium::item_type::node:
+            ++m_nodes;
+            break;
+        case osmium::item_type::way:
+            ++m_ways;
+            break;
+        case osmium::item_type::relation:
+            ++m_relations;
+            break;
+        default:
+            ++m_other_objects;
+        }
+    }
+}
+
+void RunStats::write_json(std::string const &file_name)
+{
+    end_phase();
+
+    if (file_name.empty()) {
+        return;
+    }
+
+    std::ofstream out{file_name};
+    if (!out.is_open()) {
+        throw std::runtime_error{"Could not open file '" + file_name + "'"};
+    }
+
+    auto const total = now();
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"tool\": " << json_string(m_tool) << ",\n";
+
+    auto const bytes_in = write_files(out, "input_files", m_input_files);
+    auto const bytes_out = write_files(out, "output_files", m_output_files);
+
+    out << "  \"bytes_in\": " << bytes_in << ",\n"
+        << "  \"bytes_out\": " << bytes_out << ",\n"
+        << "  \"wall_time\": " << total.wall << ",\n"
+        << "  \"user_time\": " << total.user << ",\n"
+        << "  \"system_time\": " << total.system << ",\n"
+        << "  \"read_wait_time\": " << m_read_wait << ",\n"
+        << "  \"phases\": {";
+
+    char const *sep = "\n";
+    for (auto const &p : m_phases) {
+        out << sep << "    " << json_string(p.name) << ": {\"wall_time\": "
+            << p.time.wall << ", \"user_time\": " << p.time.user
+            << ", \"system_time\": " << p.time.system << '}';
+        sep = ",\n";
+    }
+    out << (m_phases.empty() ? "},\n" : "\n  },\n");
+
+    out << "  \"objects\": {\"nodes\": " << m_nodes
+        << ", \"ways\": " << m_ways << ", \"relations\": " << m_relations
+        << ", \"other\": " << m_other_objects << "},\n"
+        << "  \"buffers\": " << m_buffers << ",\n"
+        << "  \"buffer_bytes\": " << m_buffer_bytes << ",\n"
+        << "  \"peak_rss_kb\": " << usage.ru_maxrss << "\n}\n";
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <osmium/memory/buffer.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Statistics about one run of a tool: Wall and CPU time for each phase,
+ * the number of objects of each type and of buffers read, bytes read and
+ * written, and the peak memory use. Tools write them to a JSON file if
+ * the --stats-json option is used.
+ *
+ * Phases follow each other, starting a phase ends the current one. If a
+ * phase with the same name was already run before, the times are added
+ * up. The CPU time of a phase is the time used by all threads of the
+ * process, including the reader and writer threads of libosmium.
+ */
+class RunStats
+{
+
+    struct times
+    {
+        double wall = 0.0;
+        double user = 0.0;
+        double system = 0.0;
+    };
+
+    struct phase
+    {
+        std::string name;
+        times time;
+    };
+
+    using clock = std::chrono::steady_clock;
+
+    std::string m_tool;
+    std::vector<std::string> m_input_files;
+    std::vector<std::string> m_output_files;
+    std::vector<phase> m_phases;
+
+    std::uint64_t m_nodes = 0;
+    std::uint64_t m_ways = 0;
+    std::uint64_t m_relations = 0;
+    std::uint64_t m_other_objects = 0;
+    std::uint64_t m_buffers = 0;
+    std::uint64_t m_buffer_bytes = 0;
+
+    // Time the tool was waiting for the reader to deliver the next buffer.
+    double m_read_wait = 0.0;
+
+    clock::time_point m_start;
+    times m_phase_start;
+    std::size_t m_current = 0;
+    bool m_in_phase = false;
+
+    [[nodiscard]] times now() const;
+
+public:
+    explicit RunStats(std::string tool);
+
+    void add_input_file(std::string const &file_name);
+
+    void add_output_file(std::string const &file_name);
+
+    void add_output_files(std::vector<std::string> const &file_names);
+
+    /// Start the named phase, ending the current one.
+    void phase(std::string const &name);
+
+    void end_phase();
+
+    /// Count the objects in a buffer read from the input.
+    void add_buffer(osmium::memory::Buffer const &buffer) noexcept;
+
+    /**
+     * Read the next buffer from the reader (an osmium::io::Reader or an
+     * InputReader), count the objects in it, and remember how long we had
+     * to wait for it.
+     */
+    template <typename TReader>
+    osmium::memory::Buffer read(TReader *reader)
+    {
+        auto const start = clock::now();
+        auto buffer = reader->read();
+        std::chrono::duration<double> const wait = clock::now() - start;
+        m_read_wait += wait.count();
+
+        if (buffer) {
+            add_buffer(buffer);
+        }
+
+        return buffer;
+    }
+
+    /**
+     * End the current phase and write all statistics as JSON object to
+     * the file. Does nothing if the file name is empty.
+     */
+    void write_json(std::string const &file_name);
+
+}; // class RunStats
@@ -0,0 +1,102 @@
+#include "sample.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+// For a 95% confidence interval (normal approximation).
+static constexpr double const z_95 = 1.96;
+
+/**
+ * Half-width of the confidence interval for the estimate of a total from
+ * the sum of squared counts per block. Blocks are sampled independently
+ * (Poisson sampling), this is the Horvitz-Thompson variance estimator.
+ */
+static double total_error(double sum_squares, double rate) noexcept
+{
+    return z_95 * std::sqrt((1.0 - rate) * sum_squares) / rate;
+}
+
+sample_estimate SampledCount::estimate(double rate) const noexcept
+{
+    auto const c = static_cast<double>(m_block_count);
+    return {static_cast<double>(m_count) / rate,
+            total_error(m_sum_squares + c * c, rate)};
+}
+
+void SampledFraction::end_block() noexcept
+{
+    auto const p = static_cast<double>(m_block_part);
+    auto const w = static_cast<double>(m_block_whole);
+    m_sum_pp += p * p;
+    m_sum_ww += w * w;
+    m_sum_pw += p * w;
+    m_block_part = 0;
+    m_block_whole = 0;
+}
+
+sample_estimate SampledFraction::part_estimate(double rate) const noexcept
+{
+    auto const p = static_cast<double>(m_block_part);
+    return {static_cast<double>(m_part) / rate,
+            total_error(m_sum_pp + p * p, rate)};
+}
+
+sample_estimate SampledFraction::estimate(double rate) const noexcept
+{
+    if (m_whole == 0) {
+        return {};
+    }
+
+    auto const bp = static_cast<double>(m_block_part);
+    auto const bw = static_cast<double>(m_block_whole);
+    auto const whole = static_cast<double>(m_whole);
+    auto const r = static_cast<double>(m_part) / whole;
+
+    // Variance of a ratio estimator (linearized): The residuals of the
+    // blocks are part - r * whole.
+    auto const sum_residuals = (m_sum_pp + bp * bp) -
+                               2.0 * r * (m_sum_pw + bp * bw) +
+                               r * r * (m_sum_ww + bw * bw);
+    auto const variance =
+        (1.0 - rate) * std::fmax(sum_residuals, 0.0) / (whole * whole);
+
+    return {r, z_95 * std::sqrt(variance)};
+}
+
+static std::string format_estimate(sample_estimate const &estimate)
+{
+    return std::to_string(std::llround(estimate.value)) + " ±" +
+           std::to_string(std::llround(estimate.error));
+}
+
+std::string format_count(SampledCount const &count, double rate)
+{
+    if (rate >= 1.0) {
+        return std::to_string(count.get());
+    }
+    return format_estimate(count.estimate(rate));
+}
+
+std::string format_part(SampledFraction const &fraction, double rate)
+{
+    if (rate >= 1.0) {
+        return std::to_string(fraction.part());
+    }
+    return format_estimate(fraction.part_estimate(rate));
+}
+
+std::string format_percent(SampledFraction const &fraction, double rate)
+{
+    // The estimate for the fraction is the fraction in the sample.
+    auto const percent = fraction.whole() == 0
+                             ? 0
+                             : fraction.part() * 100 / fraction.whole();
+    if (rate >= 1.0) {
+        return std::to_string(percent) + "%";
+    }
+
+    char error[32];
+    std::snprintf(error, sizeof(error), "%.1f",
+                  fraction.estimate(rate).error * 100.0);
+    return std::to_string(percent) + "% ±" + error + "%";
+}
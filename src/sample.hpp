@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * An estimate for a total or a fraction from a sample together with the
+ * half-width of its 95% confidence interval.
+ */
+struct sample_estimate
+{
+    double value = 0.0;
+    double error = 0.0;
+};
+
+/**
+ * Counts something in the input. If the input is a random sample of
+ * blocks (PBF blobs), each block having been read with the probability
+ * "rate", the total in the complete input can be estimated from this.
+ *
+ * Objects from the same block are not independent, so the variance of
+ * the estimate is calculated from the counts per block. Blocks are
+ * numbered and count() must be called with nondecreasing block numbers,
+ * the count of a block is done once a higher block number shows up.
+ */
+class SampledCount
+{
+
+    std::uint64_t m_count = 0;
+    std::uint64_t m_block_count = 0;
+    std::size_t m_block = 0;
+    double m_sum_squares = 0.0;
+
+public:
+    void count(std::size_t block, std::uint64_t n = 1) noexcept
+    {
+        if (block != m_block) {
+            auto const c = static_cast<double>(m_block_count);
+            m_sum_squares += c * c;
+            m_block_count = 0;
+            m_block = block;
+        }
+        m_block_count += n;
+        m_count += n;
+    }
+
+    /// The count in the sample.
+    [[nodiscard]] std::uint64_t get() const noexcept { return m_count; }
+
+    /// The estimate for the count in the complete input.
+    [[nodiscard]] sample_estimate estimate(double rate) const noexcept;
+
+}; // class SampledCount
+
+/**
+ * Counts the objects in some set (the whole) and which of them are in
+ * a subset (the part) to estimate which fraction of the whole the part
+ * is. See SampledCount for how blocks work.
+ */
+class SampledFraction
+{
+
+    std::uint64_t m_part = 0;
+    std::uint64_t m_whole = 0;
+    std::uint64_t m_block_part = 0;
+    std::uint64_t m_block_whole = 0;
+    std::size_t m_block = 0;
+
+    // Sums over all blocks of part*part, whole*whole, and part*whole.
+    double m_sum_pp = 0.0;
+    double m_sum_ww = 0.0;
+    double m_sum_pw = 0.0;
+
+    void end_block() noexcept;
+
+public:
+    /// Count an object of the whole, in_part says whether it is in the part.
+    void count(std::size_t block, bool in_part) noexcept
+    {
+        if (block != m_block) {
+            end_block();
+            m_block = block;
+        }
+        ++m_block_whole;
+        ++m_whole;
+        if (in_part) {
+            ++m_block_part;
+            ++m_part;
+        }
+    }
+
+    /// The number of objects in the part in the sample.
+    [[nodiscard]] std::uint64_t part() const noexcept { return m_part; }
+
+    /// The number of objects in the whole in the sample.
+    [[nodiscard]] std::uint64_t whole() const noexcept { return m_whole; }
+
+    /// The estimate for the number of objects in the part in the input.
+    [[nodiscard]] sample_estimate part_estimate(double rate) const noexcept;
+
+    /// The estimate for the fraction (between 0 and 1).
+    [[nodiscard]] sample_estimate estimate(double rate) const noexcept;
+
+}; // class SampledFraction
+
+/**
+ * Format a count. If the rate is 1 (no sampling), this is the count, if
+ * not it is the estimate and the error ("1234 ±56").
+ */
+std::string format_count(SampledCount const &count, double rate);
+
+/// Format the part of a fraction like format_count().
+std::string format_part(SampledFraction const &fraction, double rate);
+
+/**
+ * Format a fraction as integer percentage, add the error with one decimal
+ * when sampling ("12% ±0.4%").
+ */
+std::string format_percent(SampledFraction const &fraction, double rate);
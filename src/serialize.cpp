@@ -0,0 +1,148 @@
+#include "serialize.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+void write_varint(std::ostream &out, std::uint64_t value)
+{
+    while (value >= 0x80U) {
+        out.put(static_cast<char>((value & 0x7fU) | 0x80U));
+        value >>= 7U;
+    }
+    out.put(static_cast<char>(value));
+}
+
+std::uint64_t read_varint(std::istream &in)
+{
+    std::uint64_t value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        auto const c = in.get();
+        if (c == std::char_traits<char>::eof()) {
+            throw std::runtime_error{"Unexpected end of file"};
+        }
+        value |= (static_cast<std::uint64_t>(c) & 0x7fU) << shift;
+        if ((static_cast<unsigned int>(c) & 0x80U) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error{"Invalid number in file"};
+}
+
+void write_varint(std::string *data, std::uint64_t value)
+{
+    while (value >= 0x80U) {
+        data->push_back(static_cast<char>((value & 0x7fU) | 0x80U));
+        value >>= 7U;
+    }
+    data->push_back(static_cast<char>(value));
+}
+
+std::uint64_t read_varint(char const **data, char const *end)
+{
+    std::uint64_t value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (*data == end) {
+            throw std::runtime_error{"Unexpected end of data"};
+        }
+        auto const c = static_cast<std::uint8_t>(*(*data)++);
+        value |= static_cast<std::uint64_t>(c & 0x7fU) << shift;
+        if ((c & 0x80U) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error{"Invalid number in data"};
+}
+
+void write_string(std::ostream &out, std::string const &str)
+{
+    write_varint(out, str.size());
+    out << str;
+}
+
+std::string read_string(std::istream &in)
+{
+    std::string str(static_cast<std::size_t>(read_varint(in)), '\0');
+    in.read(&str[0], static_cast<std::streamsize>(str.size()));
+    if (!in) {
+        throw std::runtime_error{"Unexpected end of file"};
+    }
+    return str;
+}
+
+void write_id_set(
+    std::ostream &out,
+    osmium::index::IdSetDense<osmium::unsigned_object_id_type> const &set)
+{
+    write_varint(out, set.size());
+    std::uint64_t last = 0;
+    for (auto const id : set) {
+        write_varint(out, id - last);
+        last = id;
+    }
+}
+
+void write_id_set(std::ostream &out, RankedIdSet const &set)
+{
+    write_varint(out, set.size());
+    std::uint64_t last = 0;
+    set.for_each([&](std::uint64_t id) {
+        write_varint(out, id - last);
+        last = id;
+    });
+}
+
+void sync_file(std::string const &file_name)
+{
+    int const fd = ::open(file_name.c_str(), O_RDONLY);
+    bool const synced = fd >= 0 && ::fsync(fd) == 0;
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (!synced) {
+        throw std::runtime_error{"Error writing file '" + file_name + "'"};
+    }
+}
+
+void write_file_atomically(std::string const &file_name,
+                           std::function<void(std::ostream &)> const &func)
+{
+    auto const tmp_file_name = file_name + ".new";
+    {
+        std::ofstream out{tmp_file_name, std::ios::binary};
+        if (!out.is_open()) {
+            throw std::runtime_error{"Could not open file '" + tmp_file_name +
+                                     "'"};
+        }
+        func(out);
+        out.close();
+        if (!out) {
+            throw std::runtime_error{"Error writing file '" + tmp_file_name +
+                                     "'"};
+        }
+    }
+
+    // Make sure the new file is on disk before it replaces the old one.
+    sync_file(tmp_file_name);
+
+    if (std::rename(tmp_file_name.c_str(), file_name.c_str()) != 0) {
+        throw std::runtime_error{"Could not rename file '" + tmp_file_name +
+                                 "' to '" + file_name + "'"};
+    }
+}
+
+void read_file(std::string const &file_name,
+               std::function<void(std::istream &)> const &func)
+{
+    std::ifstream in{file_name, std::ios::binary};
+    if (!in.is_open()) {
+        throw std::runtime_error{"Could not open file '" + file_name + "'"};
+    }
+    func(in);
+    if (!in) {
+        throw std::runtime_error{"Error reading file '" + file_name + "'"};
+    }
+}
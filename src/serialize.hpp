@@ -0,0 +1,83 @@
+#pragma once
+
+#include "ranked-id-set.hpp"
+
+#include <osmium/index/id_set.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+
+/**
+ * Functions for the binary state files (checkpoints, partial files, tag
+ * stats state, ...). Numbers are written as varints like in protobuf,
+ * strings with their length in front.
+ */
+
+void write_varint(std::ostream &out, std::uint64_t value);
+
+/// @throws std::runtime_error at the end of the input or on invalid data.
+std::uint64_t read_varint(std::istream &in);
+
+/// Append a varint to the data.
+void write_varint(std::string *data, std::uint64_t value);
+
+/**
+ * Read a varint from the data up to end, data is moved past it.
+ *
+ * @throws std::runtime_error at the end of the data or on invalid data.
+ */
+std::uint64_t read_varint(char const **data, char const *end);
+
+void write_string(std::ostream &out, std::string const &str);
+
+/// @throws std::runtime_error at the end of the input or on invalid data.
+std::string read_string(std::istream &in);
+
+/// Write the IDs in the set (delta encoded).
+void write_id_set(
+    std::ostream &out,
+    osmium::index::IdSetDense<osmium::unsigned_object_id_type> const &set);
+
+/// Write the IDs in the set (delta encoded). The ranks are not written.
+void write_id_set(std::ostream &out, RankedIdSet const &set);
+
+/// Add the IDs written by write_id_set() to the set.
+template <typename TSet>
+void read_id_set(std::istream &in, TSet *set)
+{
+    auto const count = read_varint(in);
+    std::uint64_t id = 0;
+    for (std::uint64_t i = 0; i < count; ++i) {
+        id += read_varint(in);
+        set->set(id);
+    }
+}
+
+/**
+ * Make sure the contents of a file are on disk.
+ *
+ * @throws std::runtime_error if the file can't be synced.
+ */
+void sync_file(std::string const &file_name);
+
+/**
+ * Write a file by calling func with a stream. The data is written to a
+ * temporary file next to it, synced to disk, and renamed to the final
+ * name. So there is always either the old or the new complete file.
+ *
+ * @throws std::runtime_error if the file can't be written.
+ */
+void write_file_atomically(std::string const &file_name,
+                           std::function<void(std::ostream &)> const &func);
+
+/**
+ * Read a file by calling func with a stream.
+ *
+ * @throws std::runtime_error if the file can't be opened or read.
+ */
+void read_file(std::string const &file_name,
+               std::function<void(std::istream &)> const &func);
@@ -0,0 +1,396 @@
+/*
+
+OSM Data Model Tools
+
+serve
+
+Copyright (C) 2018-2022  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "input-reader.hpp"
+#include "query-index.hpp"
+#include "run-stats.hpp"
+
+#include <osmium/io/any_input.hpp>
+
+#include <lyra.hpp>
+
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// The client sends this many queries before reading the answers, so
+// neither side blocks on a full socket buffer.
+static constexpr std::size_t const batch_size = 1000;
+
+// The socket file of the server, removed when it is stopped by a signal.
+static char const *socket_path = nullptr;
+
+static void remove_socket_and_exit(int signal)
+{
+    ::unlink(socket_path);
+    ::_exit(128 + signal);
+}
+
+static sockaddr_un socket_address(std::string const &path)
+{
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error{"Socket path too long: '" + path + "'"};
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+/// Connect to the socket. Returns -1 if there is no server.
+static int connect_to(std::string const &path)
+{
+    auto const address = socket_address(path);
+    int const fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error{"Could not create socket"};
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr const *>(&address),
+                  sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool send_all(int fd, std::string const &data)
+{
+    std::size_t done = 0;
+    while (done < data.size()) {
+        auto const len =
+            ::send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += static_cast<std::size_t>(len);
+    }
+    return true;
+}
+
+/**
+ * Read more data from the socket and append it to the buffer. Returns
+ * false at the end of the connection.
+ */
+static bool receive(int fd, std::string *buffer)
+{
+    char data[64 * 1024];
+    while (true) {
+        auto const len = ::read(fd, data, sizeof(data));
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            return false;
+        }
+        buffer->append(data, static_cast<std::size_t>(len));
+        return true;
+    }
+}
+
+/**
+ * Answer all queries on the connection. All complete lines received
+ * together are answered together.
+ */
+static void serve_connection(QueryIndex const &index, int fd)
+{
+    std::string input;
+    std::string output;
+
+    auto const answer = [&](std::string_view line) {
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        output += index.query(line);
+        output += '\n';
+    };
+
+    while (receive(fd, &input)) {
+        std::size_t start = 0;
+        for (auto end = input.find('\n'); end != std::string::npos;
+             end = input.find('\n', start)) {
+            answer(std::string_view{input}.substr(start, end - start));
+            start = end + 1;
+        }
+        input.erase(0, start);
+        if (!send_all(fd, output)) {
+            break;
+        }
+        output.clear();
+    }
+
+    // The last query might not end in a newline.
+    if (!input.empty()) {
+        answer(input);
+        send_all(fd, output);
+    }
+
+    ::close(fd);
+}
+
+static void run_server(QueryIndex const &index, std::string const &path)
+{
+    auto const address = socket_address(path);
+
+    // A socket file left over from a server killed without cleaning up is
+    // removed, but only if there is no server on it.
+    struct stat s = {};
+    if (::lstat(path.c_str(), &s) == 0) {
+        if (!S_ISSOCK(s.st_mode)) {
+            throw std::runtime_error{"File '" + path +
+                                     "' exists and is not a socket"};
+        }
+        int const fd = connect_to(path);
+        if (fd >= 0) {
+            ::close(fd);
+            throw std::runtime_error{"There is already a server on socket '" +
+                                     path + "'"};
+        }
+        ::unlink(path.c_str());
+    }
+
+    int const fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error{"Could not create socket"};
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr const *>(&address),
+               sizeof(address)) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0) {
+        throw std::runtime_error{"Could not listen on socket '" + path +
+                                 "': " + std::strerror(errno)};
+    }
+
+    socket_path = path.c_str();
+    std::signal(SIGINT, remove_socket_and_exit);
+    std::signal(SIGTERM, remove_socket_and_exit);
+
+    std::cerr << "Ready for queries on socket '" << path << "'.\n";
+
+    // The index is only read from here on, so each connection can get
+    // its own thread.
+    while (true) {
+        int const client = ::accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            throw std::runtime_error{"Error accepting connection: " +
+                                     std::string{std::strerror(errno)}};
+        }
+        std::thread{serve_connection, std::cref(index), client}.detach();
+    }
+}
+
+/**
+ * Send the queries (from the command line or, if there are none, from
+ * STDIN) and write the answers to STDOUT. Returns false if there was an
+ * error answer.
+ */
+static bool run_client(std::string const &path,
+                       std::vector<std::string> const &queries)
+{
+    int const fd = connect_to(path);
+    if (fd < 0) {
+        throw std::runtime_error{"Could not connect to server on socket '" +
+                                 path + "'"};
+    }
+
+    std::size_t next = 0;
+    auto const next_query = [&](std::string *query) {
+        if (!queries.empty()) {
+            if (next == queries.size()) {
+                return false;
+            }
+            *query = queries[next++];
+            return true;
+        }
+        return static_cast<bool>(std::getline(std::cin, *query));
+    };
+
+    bool ok = true;
+    std::string input;
+    std::string query;
+    bool more = true;
+    while (more) {
+        std::string request;
+        std::size_t count = 0;
+        while (count < batch_size && (more = next_query(&query))) {
+            request += query;
+            request += '\n';
+            ++count;
+        }
+
+        if (!send_all(fd, request)) {
+            throw std::runtime_error{"Connection closed by server"};
+        }
+
+        std::size_t start = 0;
+        while (count > 0) {
+            auto const end = input.find('\n', start);
+            if (end == std::string::npos) {
+                input.erase(0, start);
+                start = 0;
+                if (!receive(fd, &input)) {
+                    throw std::runtime_error{"Connection closed by server"};
+                }
+                continue;
+            }
+            std::string_view const answer{input.data() + start, end - start};
+            if (answer.substr(0, 5) == "ERROR") {
+                ok = false;
+            }
+            std::cout << answer << '\n';
+            start = end + 1;
+            --count;
+        }
+        input.erase(0, start);
+    }
+
+    ::close(fd);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    try {
+        std::string socket_filename;
+        std::string stats_filename;
+        std::vector<std::string> arguments;
+        query_index_options options;
+        input_options input;
+        bool client = false;
+        bool help = false;
+
+        // clang-format off
+        auto const cli
+            = lyra::opt(socket_filename, "SOCKET")
+                ["-s"]["--socket"]
+                ("Unix domain socket of the server")
+            | lyra::opt(client)
+                ["-c"]["--client"]
+                ("send queries to the server instead of being the server")
+            | lyra::opt(options.topology_directory, "DIR")
+                ["-t"]["--topology"]
+                ("use topology state in DIR (see odmt-topology)")
+            | lyra::opt(options.tag_stats_state, "FILE")
+                ["--tag-stats-state"]
+                ("use counts from tag stats state FILE (see odmt-tag-stats)")
+            | lyra::opt(options.with_values)
+                ["-v"]["--with-values"]
+                ("also count tags in the input, not only keys")
+            | lyra::opt(options.line_or_polygon.expressions_directory, "DIR")
+                ["-e"]["--expressions-dir"]
+                ("directory with expression files (default: built-in)")
+            | lyra::opt(input.format, "FORMAT")
+                ["--input-format"]
+                ("format of input file (needed for STDIN)")
+            | lyra::opt(input.mmap)
+                ["--mmap"]
+                ("memory map PBF input file")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about building the indexes to FILE as JSON")
+            | lyra::help(help)
+            | lyra::arg(arguments, "FILENAME|QUERY")
+                ("input file (server) or queries (client, default: from STDIN)");
+        // clang-format on
+
+        auto const result = cli.parse(lyra::args(argc, argv));
+        if (!result) {
+            std::cerr << "Error in command line: " << result.message() << '\n';
+            return 1;
+        }
+
+        if (help) {
+            std::cout << cli
+                      << "\nAnswer queries about the input over a Unix "
+                         "domain socket.\n";
+            return 0;
+        }
+
+        if (socket_filename.empty()) {
+            std::cerr << "Missing socket. Try '-h'.\n";
+            return 1;
+        }
+
+        if (client) {
+            return run_client(socket_filename, arguments) ? 0 : 1;
+        }
+
+        if (arguments.size() > 1) {
+            std::cerr << "Only one input file allowed.\n";
+            return 1;
+        }
+
+        if (arguments.empty() && options.topology_directory.empty() &&
+            options.tag_stats_state.empty()) {
+            std::cerr << "Need an input file or a state to answer queries "
+                         "from. Try '-h'.\n";
+            return 1;
+        }
+
+        RunStats stats{"odmt-serve"};
+
+        stats.phase("load");
+        QueryIndex index{options, !arguments.empty()};
+
+        if (!arguments.empty()) {
+            auto const &input_filename = arguments.front();
+            stats.add_input_file(input_filename);
+            auto const input_file = make_input_file(input_filename, input);
+            InputReader reader{input_file, index.entities(), input};
+            stats.phase("build");
+            while (auto const buffer = stats.read(&reader)) {
+                for (auto const &object : buffer.select<osmium::OSMObject>()) {
+                    index.object(object);
+                }
+            }
+            reader.close();
+        }
+
+        stats.end_phase();
+        stats.write_json(stats_filename);
+
+        run_server(index, socket_filename);
+    } catch (std::exception const &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,340 @@
+#include "synthetic-data.hpp"
+
+#include <osmium/builder/osm_object_builder.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/timestamp.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Buffers are handed to the callback when they are at least this full.
+static constexpr std::size_t const buffer_size = 1024UL * 1024UL;
+
+static constexpr std::size_t const num_users = 1000;
+
+using tag = std::pair<char const *, char const *>;
+
+static constexpr std::array<tag, 12> const node_tags = {{
+    {"amenity", "bench"},
+    {"amenity", "restaurant"},
+    {"barrier", "gate"},
+    {"crossing", "uncontrolled"},
+    {"highway", "bus_stop"},
+    {"highway", "crossing"},
+    {"highway", "street_lamp"},
+    {"natural", "tree"},
+    {"power", "pole"},
+    {"power", "tower"},
+    {"railway", "level_crossing"},
+    {"shop", "bakery"},
+}};
+
+static constexpr std::array<char const *, 8> const highway_values = {
+    "residential", "service",  "track",   "footway",
+    "unclassified", "tertiary", "primary", "path"};
+
+static constexpr std::array<tag, 8> const area_tags = {{
+    {"landuse", "farmland"},
+    {"landuse", "residential"},
+    {"landuse", "meadow"},
+    {"leisure", "park"},
+    {"natural", "water"},
+    {"natural", "wood"},
+    {"amenity", "parking"},
+    {"waterway", "riverbank"},
+}};
+
+static constexpr std::array<char const *, 10> const syllables = {
+    "ber", "lin", "ham", "burg", "stadt", "wald", "see", "bach", "dorf", "au"};
+
+// Keys with characters that are not in the "good" set.
+static constexpr std::array<char const *, 4> const odd_keys = {
+    "name:de ", "source=survey", "Name", "addr:street;name"};
+
+namespace {
+
+class Generator
+{
+
+    std::mt19937_64 m_rng;
+    synthetic_options m_options;
+    std::function<void(osmium::memory::Buffer &&)> const &m_func;
+    osmium::memory::Buffer m_buffer{buffer_size + buffer_size / 4,
+                                    osmium::memory::Buffer::auto_grow::yes};
+    std::vector<std::string> m_users;
+    std::vector<std::pair<std::string, std::string>> m_tags;
+
+    std::uint64_t m_next_node = 1;
+
+    std::uint64_t uniform(std::uint64_t n) noexcept { return m_rng() % n; }
+
+    bool chance(std::uint64_t per_mille) noexcept
+    {
+        return uniform(1000) < per_mille;
+    }
+
+    /// Geometric distribution with min value and the given mean.
+    std::uint64_t geometric(std::uint64_t min, std::uint64_t mean) noexcept
+    {
+        std::uint64_t value = min;
+        while (value < mean * 20 && uniform(mean - min + 1) != 0) {
+            ++value;
+        }
+        return value;
+    }
+
+    template <std::size_t N>
+    auto const &pick(std::array<char const *, N> const &list) noexcept
+    {
+        return list[uniform(N)];
+    }
+
+    template <std::size_t N>
+    auto const &pick(std::array<tag, N> const &list) noexcept
+    {
+        return list[uniform(N)];
+    }
+
+    std::string name()
+    {
+        std::string n;
+        auto const count = 2 + uniform(2);
+        for (std::uint64_t i = 0; i < count; ++i) {
+            n += pick(syllables);
+        }
+        n.front() = static_cast<char>(n.front() - 'a' + 'A');
+        return n;
+    }
+
+    void add_tag(char const *key, std::string value)
+    {
+        m_tags.emplace_back(key, std::move(value));
+    }
+
+    void add_common_tags()
+    {
+        if (chance(300)) {
+            add_tag("name", name());
+        }
+        if (chance(150)) {
+            add_tag("source", "survey");
+        }
+        if (chance(20)) {
+            add_tag("note", "synthetic data");
+        }
+        if (chance(2)) {
+            add_tag(pick(odd_keys), "yes");
+        }
+        if (chance(1)) {
+            add_tag("description", std::string(250 + uniform(200), 'x'));
+        }
+    }
+
+    template <typename TBuilder>
+    void set_attributes(TBuilder &builder, std::uint64_t id)
+    {
+        builder.set_id(static_cast<osmium::object_id_type>(id))
+            .set_version(static_cast<osmium::object_version_type>(
+                1 + geometric(0, 2)))
+            .set_changeset(
+                static_cast<osmium::changeset_id_type>(1 + uniform(100000)))
+            .set_timestamp(osmium::Timestamp{static_cast<std::uint32_t>(
+                1300000000 + uniform(300000000))})
+            .set_uid(static_cast<osmium::user_id_type>(
+                1 + uniform(num_users)));
+        builder.set_user(m_users[uniform(num_users)]);
+    }
+
+    void add_tags(osmium::builder::Builder *parent)
+    {
+        osmium::builder::TagListBuilder builder{*parent};
+        for (auto const &t : m_tags) {
+            builder.add_tag(t.first, t.second);
+        }
+        m_tags.clear();
+    }
+
+    void commit()
+    {
+        m_buffer.commit();
+        if (m_buffer.committed() >= buffer_size) {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        if (m_buffer.committed() > 0) {
+            m_func(std::move(m_buffer));
+            m_buffer = osmium::memory::Buffer{
+                buffer_size + buffer_size / 4,
+                osmium::memory::Buffer::auto_grow::yes};
+        }
+    }
+
+    void node(std::uint64_t id)
+    {
+        if (chance(50)) {
+            auto const &t = pick(node_tags);
+            add_tag(t.first, t.second);
+            add_common_tags();
+        }
+
+        {
+            osmium::builder::NodeBuilder builder{m_buffer};
+            set_attributes(builder, id);
+            builder.set_location(osmium::Location{
+                static_cast<std::int32_t>(uniform(100000000)),
+                static_cast<std::int32_t>(400000000 + uniform(100000000))});
+            add_tags(&builder);
+        }
+        commit();
+    }
+
+    // Pick the next way node, usually a new one but sometimes a node
+    // already used in another way.
+    std::uint64_t way_node() noexcept
+    {
+        if (m_next_node > m_options.num_nodes ||
+            (m_next_node > 1 && chance(80))) {
+            return 1 + uniform(m_next_node - 1);
+        }
+        return m_next_node++;
+    }
+
+    void way(std::uint64_t id)
+    {
+        bool const closed = chance(350);
+        std::vector<std::uint64_t> nodes;
+
+        if (closed) {
+            auto const count = geometric(3, 6);
+            for (std::uint64_t i = 0; i < count; ++i) {
+                nodes.push_back(way_node());
+            }
+            nodes.push_back(nodes.front());
+            if (chance(700)) {
+                add_tag("building", "yes");
+                if (chance(300)) {
+                    add_tag("addr:housenumber", std::to_string(uniform(200)));
+                    add_tag("addr:street", name() + "strasse");
+                }
+            } else {
+                auto const &t = pick(area_tags);
+                add_tag(t.first, t.second);
+            }
+        } else {
+            auto const count = geometric(2, 9);
+            for (std::uint64_t i = 0; i < count; ++i) {
+                nodes.push_back(way_node());
+            }
+            if (chance(900)) {
+                add_tag("highway", pick(highway_values));
+                if (chance(200)) {
+                    add_tag("oneway", "yes");
+                }
+                if (chance(100)) {
+                    add_tag("maxspeed", std::to_string(30 + uniform(10) * 10));
+                }
+            } else {
+                add_tag("waterway", "stream");
+            }
+        }
+        add_common_tags();
+
+        {
+            osmium::builder::WayBuilder builder{m_buffer};
+            set_attributes(builder, id);
+            add_tags(&builder);
+            osmium::builder::WayNodeListBuilder wnl_builder{builder};
+            for (auto const ref : nodes) {
+                wnl_builder.add_node_ref(
+                    static_cast<osmium::object_id_type>(ref));
+            }
+        }
+        commit();
+    }
+
+    void relation(std::uint64_t id, std::uint64_t num_ways)
+    {
+        bool const route = chance(400);
+        if (route) {
+            add_tag("type", "route");
+            add_tag("route", "bus");
+        } else {
+            add_tag("type", "multipolygon");
+            auto const &t = pick(area_tags);
+            add_tag(t.first, t.second);
+        }
+        add_common_tags();
+
+        {
+            osmium::builder::RelationBuilder builder{m_buffer};
+            set_attributes(builder, id);
+            add_tags(&builder);
+            osmium::builder::RelationMemberListBuilder rml_builder{builder};
+            auto const count = route ? geometric(5, 30) : geometric(1, 3);
+            for (std::uint64_t i = 0; i < count; ++i) {
+                if (route && chance(300)) {
+                    rml_builder.add_member(
+                        osmium::item_type::node,
+                        static_cast<osmium::object_id_type>(
+                            1 + uniform(m_options.num_nodes)),
+                        "stop");
+                } else {
+                    rml_builder.add_member(
+                        osmium::item_type::way,
+                        static_cast<osmium::object_id_type>(
+                            1 + uniform(num_ways)),
+                        route ? "" : (i == 0 ? "outer" : "inner"));
+                }
+            }
+        }
+        commit();
+    }
+
+public:
+    Generator(synthetic_options const &options,
+              std::function<void(osmium::memory::Buffer &&)> const &func)
+    : m_rng(options.seed), m_options(options), m_func(func)
+    {
+        m_users.reserve(num_users);
+        for (std::size_t i = 0; i < num_users; ++i) {
+            m_users.push_back("user" + std::to_string(i));
+        }
+    }
+
+    void run()
+    {
+        auto const num_nodes = m_options.num_nodes;
+        auto const num_ways = num_nodes / 7 + 1;
+        auto const num_relations = num_nodes / 700 + 1;
+
+        for (std::uint64_t id = 1; id <= num_nodes; ++id) {
+            node(id);
+        }
+        for (std::uint64_t id = 1; id <= num_ways; ++id) {
+            way(id);
+        }
+        for (std::uint64_t id = 1; id <= num_relations; ++id) {
+            relation(id, num_ways);
+        }
+        flush();
+    }
+
+}; // class Generator
+
+} // anonymous namespace
+
+void generate_synthetic_data(
+    synthetic_options const &options,
+    std::function<void(osmium::memory::Buffer &&)> const &func)
+{
+    Generator generator{options, func};
+    generator.run();
+}
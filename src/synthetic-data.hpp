@@ -0,0 +1,30 @@
+#pragma once
+
+#include <osmium/memory/buffer.hpp>
+
+#include <cstdint>
+#include <functional>
+
+struct synthetic_options
+{
+    // Number of nodes generated, all other numbers are derived from this.
+    std::uint64_t num_nodes = 1000000;
+
+    std::uint64_t seed = 1;
+};
+
+/**
+ * Generate synthetic OSM data with tag and way node distributions roughly
+ * like in real OSM data: Few tagged nodes, ways with a handful of nodes
+ * which share some nodes with other ways, closed ways for buildings and
+ * landuse, multipolygon and route relations, and the occasional odd key or
+ * overlong value. Objects are sorted by type and ID like in a planet file.
+ *
+ * The output only depends on the options, not on the platform or the
+ * standard library used.
+ *
+ * The function func is called with each filled buffer.
+ */
+void generate_synthetic_data(
+    synthetic_options const &options,
+    std::function<void(osmium::memory::Buffer &&)> const &func);
@@ -0,0 +1,99 @@
+#include "tag-stats-analysis.hpp"
+
+#include "serialize.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+TagStatsAnalysis::TagStatsAnalysis(tag_stats_options const &options,
+                                   std::ostream *out)
+: m_options(options), m_out(out)
+{
+    assert(out);
+}
+
+void TagStatsAnalysis::object(osmium::OSMObject const &object)
+{
+    if (object.tags().size() > m_options.max_tags) {
+        return;
+    }
+
+    for (auto const &tag : object.tags()) {
+        if (m_options.with_values) {
+            m_dict[tag.key() + std::string{"="} + tag.value()].count(block());
+        } else {
+            m_dict[tag.key()].count(block());
+        }
+    }
+}
+
+void TagStatsAnalysis::finish()
+{
+    // The minimum count applies to the (estimated) count in the input.
+    auto const min_count =
+        static_cast<double>(m_options.min_count) * sample_rate();
+
+    using si = std::pair<std::string, SampledCount>;
+    std::vector<si> common_keys;
+    std::copy_if(m_dict.cbegin(), m_dict.cend(),
+                 std::back_inserter(common_keys),
+                 [&min_count](auto const &p) {
+                     return static_cast<double>(p.second.get()) >= min_count;
+                 });
+
+    // Ties are sorted by name, so the output doesn't depend on the order
+    // in which keys were first seen. This makes merged partial results
+    // the same as those of a complete run.
+    std::sort(common_keys.begin(), common_keys.end(),
+              [](si const &a, si const &b) {
+                  return a.second.get() > b.second.get() ||
+                         (a.second.get() == b.second.get() &&
+                          a.first < b.first);
+              });
+
+    for (auto const &p : common_keys) {
+        *m_out << format_count(p.second, sample_rate()) << ' ' << p.first
+               << '\n';
+    }
+}
+
+std::vector<std::uint64_t> TagStatsAnalysis::partial_options() const
+{
+    return {m_options.max_tags, m_options.min_count,
+            m_options.with_values ? 1U : 0U};
+}
+
+tag_stats_options TagStatsAnalysis::options_from_partial(
+    std::vector<std::uint64_t> const &options)
+{
+    if (options.size() != 3) {
+        throw std::runtime_error{"Invalid options in partial file"};
+    }
+    tag_stats_options result;
+    result.max_tags = static_cast<std::size_t>(options[0]);
+    result.min_count = static_cast<std::size_t>(options[1]);
+    result.with_values = options[2] != 0;
+    return result;
+}
+
+void TagStatsAnalysis::write_partial(std::ostream &out) const
+{
+    write_varint(out, m_dict.size());
+    for (auto const &p : m_dict) {
+        write_string(out, p.first);
+        write_varint(out, p.second.get());
+    }
+}
+
+void TagStatsAnalysis::read_partial(std::istream &in)
+{
+    auto const count = read_varint(in);
+    for (std::uint64_t i = 0; i < count; ++i) {
+        auto const key = read_string(in);
+        m_dict[key].count(block(), read_varint(in));
+    }
+}
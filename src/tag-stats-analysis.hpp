@@ -0,0 +1,59 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "sample.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct tag_stats_options
+{
+    std::size_t max_tags = 10000; // essentially all
+    std::size_t min_count = 100;
+    bool with_values = false;
+};
+
+/**
+ * Counts keys (or tags) and writes all with at least min_count uses
+ * sorted by count to the output stream in finish(). If only a sample of
+ * the input was read, the estimated counts are written with their error.
+ */
+class TagStatsAnalysis : public Analysis
+{
+
+    tag_stats_options m_options;
+    std::ostream *m_out;
+    std::unordered_map<std::string, SampledCount> m_dict;
+
+public:
+    TagStatsAnalysis(tag_stats_options const &options, std::ostream *out);
+
+    [[nodiscard]] osmium::osm_entity_bits::type
+    entities() const noexcept override
+    {
+        return osmium::osm_entity_bits::nwr;
+    }
+
+    void object(osmium::OSMObject const &object) override;
+
+    void finish() override;
+
+    /// The options as stored in the header of partial files.
+    [[nodiscard]] std::vector<std::uint64_t> partial_options() const;
+
+    /// @throws std::runtime_error if the options are invalid.
+    static tag_stats_options
+    options_from_partial(std::vector<std::uint64_t> const &options);
+
+    /// Write the counts for merging them with those of other shards.
+    void write_partial(std::ostream &out) const;
+
+    /// Add the counts written by write_partial().
+    void read_partial(std::istream &in);
+
+}; // class TagStatsAnalysis
@@ -0,0 +1,273 @@
+#include "tag-stats-state.hpp"
+
+#include "serialize.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+static constexpr char const *const state_magic = "odmt-tag-stats-state";
+static constexpr std::uint64_t const state_version = 1;
+
+// Object IDs are stored in the lower bits of the key, the type above.
+static constexpr unsigned int const type_shift = 56U;
+
+static std::uint64_t object_key(osmium::OSMObject const &object)
+{
+    if (object.id() < 0) {
+        throw std::runtime_error{
+            "Objects with negative IDs are not supported with --state"};
+    }
+    return (static_cast<std::uint64_t>(object.type()) << type_shift) |
+           static_cast<std::uint64_t>(object.id());
+}
+
+TagStatsState::TagStatsState(tag_stats_options const &options)
+: m_options(options)
+{
+}
+
+std::uint32_t TagStatsState::string_index(std::string const &string)
+{
+    auto const it = m_index.find(string);
+    if (it != m_index.end()) {
+        return it->second;
+    }
+
+    if (m_strings.size() >= std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error{"Too many different keys or tags"};
+    }
+    auto const index = static_cast<std::uint32_t>(m_strings.size());
+    m_strings.push_back(string);
+    m_counts.push_back(0);
+    m_index.emplace(string, index);
+    return index;
+}
+
+std::vector<std::uint32_t>
+TagStatsState::current_strings(std::uint64_t key) const
+{
+    auto const changed = m_changed.find(key);
+    if (changed != m_changed.end()) {
+        return changed->second;
+    }
+
+    auto const it = std::lower_bound(
+        m_objects.cbegin(), m_objects.cend(), key,
+        [](object_entry const &entry, std::uint64_t k) {
+            return entry.key < k;
+        });
+    if (it == m_objects.cend() || it->key != key) {
+        return {};
+    }
+
+    auto const next = std::next(it);
+    auto const end = next == m_objects.cend() ? m_object_strings.size()
+                                              : next->offset;
+    auto const *data = m_object_strings.data();
+    return {data + it->offset, data + end};
+}
+
+template <typename TFunc>
+void TagStatsState::for_each_object(TFunc &&func) const
+{
+    auto const strings = [](std::vector<std::uint32_t> const &v) {
+        return std::make_pair(v.data(), v.data() + v.size());
+    };
+
+    auto changed = m_changed.cbegin();
+    for (std::size_t i = 0; i < m_objects.size(); ++i) {
+        auto const key = m_objects[i].key;
+        for (; changed != m_changed.cend() && changed->first <= key;
+             ++changed) {
+            if (!changed->second.empty()) {
+                auto const [begin, end] = strings(changed->second);
+                func(changed->first, begin, end);
+            }
+        }
+        if (m_changed.count(key) == 0) {
+            auto const end = i + 1 == m_objects.size()
+                                 ? m_object_strings.size()
+                                 : m_objects[i + 1].offset;
+            func(key, m_object_strings.data() + m_objects[i].offset,
+                 m_object_strings.data() + end);
+        }
+    }
+    for (; changed != m_changed.cend(); ++changed) {
+        if (!changed->second.empty()) {
+            auto const [begin, end] = strings(changed->second);
+            func(changed->first, begin, end);
+        }
+    }
+}
+
+void TagStatsState::update(osmium::OSMObject const &object)
+{
+    auto const key = object_key(object);
+
+    for (auto const index : current_strings(key)) {
+        assert(m_counts[index] > 0);
+        --m_counts[index];
+    }
+
+    std::vector<std::uint32_t> strings;
+    if (object.visible() && object.tags().size() <= m_options.max_tags) {
+        for (auto const &tag : object.tags()) {
+            if (m_options.with_values) {
+                strings.push_back(string_index(tag.key() + std::string{"="} +
+                                               tag.value()));
+            } else {
+                strings.push_back(string_index(tag.key()));
+            }
+        }
+    }
+
+    for (auto const index : strings) {
+        ++m_counts[index];
+    }
+
+    // When reading a sorted file all objects are simply appended.
+    if (m_changed.empty() &&
+        (m_objects.empty() || m_objects.back().key < key)) {
+        if (!strings.empty()) {
+            m_objects.push_back({key, m_object_strings.size()});
+            m_object_strings.insert(m_object_strings.end(), strings.cbegin(),
+                                    strings.cend());
+        }
+        return;
+    }
+
+    m_changed[key] = std::move(strings);
+}
+
+void TagStatsState::output(std::ostream *out, std::size_t min_count) const
+{
+    using si = std::pair<std::string const *, std::uint64_t>;
+    std::vector<si> common_keys;
+    for (std::size_t i = 0; i < m_strings.size(); ++i) {
+        if (m_counts[i] > 0 && m_counts[i] >= min_count) {
+            common_keys.emplace_back(&m_strings[i], m_counts[i]);
+        }
+    }
+
+    // Ties are sorted by name, so the output doesn't depend on the order
+    // in which keys were first seen.
+    std::sort(common_keys.begin(), common_keys.end(),
+              [](si const &a, si const &b) {
+                  return a.second > b.second ||
+                         (a.second == b.second && *a.first < *b.first);
+              });
+
+    for (auto const &p : common_keys) {
+        *out << p.second << ' ' << *p.first << '\n';
+    }
+}
+
+void TagStatsState::read(std::string const &file_name)
+{
+    std::ifstream in{file_name, std::ios::binary};
+    if (!in.is_open()) {
+        throw std::runtime_error{"Could not open file '" + file_name + "'"};
+    }
+
+    std::string magic(std::char_traits<char>::length(state_magic), '\0');
+    in.read(&magic[0], static_cast<std::streamsize>(magic.size()));
+    if (!in || magic != state_magic || read_varint(in) != state_version) {
+        throw std::runtime_error{"File '" + file_name +
+                                 "' is not a tag stats state file"};
+    }
+
+    m_options.max_tags = static_cast<std::size_t>(read_varint(in));
+    m_options.with_values = read_varint(in) != 0;
+
+    m_strings.clear();
+    m_counts.clear();
+    m_index.clear();
+    m_objects.clear();
+    m_object_strings.clear();
+    m_changed.clear();
+
+    auto const num_strings = read_varint(in);
+    if (num_strings > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error{"Invalid state file '" + file_name + "'"};
+    }
+    for (std::uint64_t i = 0; i < num_strings; ++i) {
+        auto string = read_string(in);
+        m_counts.push_back(read_varint(in));
+        m_index.emplace(string, static_cast<std::uint32_t>(i));
+        m_strings.push_back(std::move(string));
+    }
+
+    auto const num_objects = read_varint(in);
+    std::uint64_t key = 0;
+    for (std::uint64_t i = 0; i < num_objects; ++i) {
+        key += read_varint(in);
+        m_objects.push_back({key, m_object_strings.size()});
+        auto const count = read_varint(in);
+        for (std::uint64_t j = 0; j < count; ++j) {
+            auto const index = read_varint(in);
+            if (index >= num_strings) {
+                throw std::runtime_error{"Invalid state file '" + file_name +
+                                         "'"};
+            }
+            m_object_strings.push_back(static_cast<std::uint32_t>(index));
+        }
+    }
+
+    if (!in) {
+        throw std::runtime_error{"Error reading file '" + file_name + "'"};
+    }
+}
+
+void TagStatsState::write(std::string const &file_name) const
+{
+    write_file_atomically(file_name, [&](std::ostream &out) {
+        write_state(out);
+    });
+}
+
+void TagStatsState::write_state(std::ostream &out) const
+{
+    out << state_magic;
+    write_varint(out, state_version);
+    write_varint(out, m_options.max_tags);
+    write_varint(out, m_options.with_values ? 1 : 0);
+
+    // Strings not used any more are dropped, so they are renumbered.
+    constexpr auto const unused = std::numeric_limits<std::uint32_t>::max();
+    std::vector<std::uint32_t> new_index(m_strings.size(), unused);
+    std::uint32_t num_strings = 0;
+    for (std::size_t i = 0; i < m_strings.size(); ++i) {
+        if (m_counts[i] > 0) {
+            new_index[i] = num_strings++;
+        }
+    }
+
+    write_varint(out, num_strings);
+    for (std::size_t i = 0; i < m_strings.size(); ++i) {
+        if (new_index[i] != unused) {
+            write_string(out, m_strings[i]);
+            write_varint(out, m_counts[i]);
+        }
+    }
+
+    std::uint64_t num_objects = 0;
+    for_each_object([&](std::uint64_t /*key*/, std::uint32_t const * /*begin*/,
+                        std::uint32_t const * /*end*/) { ++num_objects; });
+
+    write_varint(out, num_objects);
+    std::uint64_t last_key = 0;
+    for_each_object([&](std::uint64_t key, std::uint32_t const *begin,
+                        std::uint32_t const *end) {
+        write_varint(out, key - last_key);
+        last_key = key;
+        write_varint(out, static_cast<std::uint64_t>(end - begin));
+        for (auto const *it = begin; it != end; ++it) {
+            write_varint(out, new_index[*it]);
+        }
+    });
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "tag-stats-analysis.hpp"
+
+#include <osmium/osm/object.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Exact key (or tag) counts together with the keys (or tags) counted for
+ * each object. This is what is needed to keep the counts up to date from
+ * change files: For a changed object the counts of the keys of the old
+ * version are decremented and those of the new version incremented.
+ *
+ * The state can be written to and read from a compact binary file. All
+ * numbers in it are varints, the strings are stored only once, objects
+ * refer to them by index.
+ */
+class TagStatsState
+{
+
+    struct object_entry
+    {
+        std::uint64_t key;    // type and ID, see object_key()
+        std::uint64_t offset; // into m_object_strings
+    };
+
+    tag_stats_options m_options;
+
+    // All keys (or tags) seen with their current counts.
+    std::vector<std::string> m_strings;
+    std::vector<std::uint64_t> m_counts;
+    std::unordered_map<std::string, std::uint32_t> m_index;
+
+    // Objects sorted by key and the indexes of the strings counted for
+    // them. The strings of an object run up to the offset of the next.
+    std::vector<object_entry> m_objects;
+    std::vector<std::uint32_t> m_object_strings;
+
+    // Objects changed (or added out of order) after they were added to
+    // m_objects. An empty list means the object doesn't count (any more).
+    std::map<std::uint64_t, std::vector<std::uint32_t>> m_changed;
+
+    std::uint32_t string_index(std::string const &string);
+
+    std::vector<std::uint32_t> current_strings(std::uint64_t key) const;
+
+    /**
+     * Call func(key, begin, end) for all objects counted in the order of
+     * their keys with the range of their string indexes.
+     */
+    template <typename TFunc>
+    void for_each_object(TFunc &&func) const;
+
+    void write_state(std::ostream &out) const;
+
+public:
+    explicit TagStatsState(tag_stats_options const &options);
+
+    /// The options used for counting. Read from the state file by read().
+    [[nodiscard]] tag_stats_options const &options() const noexcept
+    {
+        return m_options;
+    }
+
+    /**
+     * Add an object or, if the state already has an object with the same
+     * type and ID, replace it. Deleted objects are removed.
+     */
+    void update(osmium::OSMObject const &object);
+
+    /// Call func(string, count) for all keys (or tags) in use.
+    template <typename TFunc>
+    void for_each_count(TFunc &&func) const
+    {
+        for (std::size_t i = 0; i < m_strings.size(); ++i) {
+            if (m_counts[i] > 0) {
+                func(m_strings[i], m_counts[i]);
+            }
+        }
+    }
+
+    /// Write all with at least min_count uses sorted by count.
+    void output(std::ostream *out, std::size_t min_count) const;
+
+    /**
+     * Replace the state with the state read from the file.
+     *
+     * @throws std::runtime_error if the file can't be read or is invalid.
+     */
+    void read(std::string const &file_name);
+
+    /**
+     * Write the state to the file. It is written with
+     * write_file_atomically(), so an existing file is only replaced if the
+     * new one is complete.
+     *
+     * @throws std::runtime_error if the file can't be written.
+     */
+    void write(std::string const &file_name) const;
+
+}; // class TagStatsState
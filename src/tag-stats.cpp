@@ -21,38 +21,116 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
 
+#include "change-file.hpp"
+#include "input-reader.hpp"
+#include "partial-state.hpp"
+#include "run-stats.hpp"
+#include "tag-stats-analysis.hpp"
+#include "tag-stats-state.hpp"
+
 #include <osmium/io/any_input.hpp>
 
 #include <lyra.hpp>
 
-#include <algorithm>
-#include <cstddef>
 #include <exception>
 #include <iostream>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
+/**
+ * Count keys (or tags) exactly, write the statistics, and save the counts
+ * together with the keys (or tags) of all objects in the state file. If
+ * there are change files, the state is read from the state file instead
+ * and updated with the last version of each object in the changes.
+ */
+static void run_with_state(std::string const &input_filename,
+                           std::vector<std::string> const &change_filenames,
+                           std::string const &state_filename,
+                           tag_stats_options const &options,
+                           input_options const &input, RunStats *stats)
+{
+    TagStatsState state{options};
+
+    if (change_filenames.empty()) {
+        stats->phase("process");
+        stats->add_input_file(input_filename);
+        auto const file = make_input_file(input_filename, input);
+        InputReader reader{file, osmium::osm_entity_bits::nwr, input};
+        while (auto const buffer = stats->read(&reader)) {
+            for (auto const &object : buffer.select<osmium::OSMObject>()) {
+                state.update(object);
+            }
+        }
+        reader.close();
+    } else {
+        stats->add_input_file(state_filename);
+        stats->phase("read-state");
+        state.read(state_filename);
+
+        stats->phase("process");
+        for (auto const &filename : change_filenames) {
+            stats->add_input_file(filename);
+            read_change_file(filename, osmium::osm_entity_bits::nwr, input,
+                             stats, [&](osmium::OSMObject const &object) {
+                                 state.update(object);
+                             });
+        }
+    }
+
+    stats->phase("write");
+    state.output(&std::cout, options.min_count);
+    state.write(state_filename);
+    stats->add_output_file(state_filename);
+}
+
 int main(int argc, char *argv[])
 {
     try {
         std::string input_filename;
-        std::size_t max_tags = 10000; // essentially all
-        std::size_t min_count = 100;
-        bool with_values = false;
+        std::string stats_filename;
+        std::string state_filename;
+        std::vector<std::string> change_filenames;
+        std::string shard;
+        std::string partial_filename;
+        input_options input;
+        tag_stats_options options;
         bool help = false;
 
         // clang-format off
         auto const cli
-            = lyra::opt(max_tags, "N")
+            = lyra::opt(options.max_tags, "N")
                 ["-m"]["--max-tags"]
                 ("count tags only on objects with no more than this many tags (default: all)")
-            | lyra::opt(min_count, "N")
+            | lyra::opt(options.min_count, "N")
                 ["-c"]["--min-count"]
-                ("min count to output (default: " + std::to_string(min_count) + ")")
-            | lyra::opt(with_values)
+                ("min count to output (default: " + std::to_string(options.min_count) + ")")
+            | lyra::opt(options.with_values)
                 ["-v"]["--with-values"]
                 ("also count values")
+            | lyra::opt(state_filename, "FILE")
+                ["-s"]["--state"]
+                ("write exact counts and the keys of all objects to state FILE")
+            | lyra::opt(change_filenames, "OSC-FILE")
+                ["-a"]["--apply-changes"]
+                ("update state FILE with changes instead of reading input (can be given several times)")
+            | lyra::opt(input.sample, "RATE")
+                ["--sample"]
+                ("only read this fraction of the PBF blobs and estimate results (default: 1)")
+            | lyra::opt(shard, "I/N")
+                ["--shard"]
+                ("only read every N-th PBF blob starting with blob I (counting from 0, needs --partial-out)")
+            | lyra::opt(partial_filename, "FILE")
+                ["--partial-out"]
+                ("write partial results to FILE for odmt-merge instead of the statistics")
+            | lyra::opt(input.format, "FORMAT")
+                ["--input-format"]
+                ("format of input file (needed for STDIN)")
+            | lyra::opt(input.mmap)
+                ["--mmap"]
+                ("memory map PBF input file")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
             | lyra::help(help)
             | lyra::arg(input_filename, "FILENAME")
                 ("input file");
@@ -69,43 +147,86 @@ int main(int argc, char *argv[])
             return 0;
         }
 
-        if (input_filename.empty()) {
+        if (!change_filenames.empty()) {
+            if (state_filename.empty()) {
+                std::cerr << "Option --apply-changes needs --state.\n";
+                return 1;
+            }
+            if (!input_filename.empty()) {
+                std::cerr << "Use either an input file or --apply-changes.\n";
+                return 1;
+            }
+        } else if (input_filename.empty()) {
             std::cerr << "Missing input filename. Try '-h'.\n";
             return 1;
         }
 
-        osmium::io::File input_file{input_filename};
+        if (!state_filename.empty() && input.sample < 1.0) {
+            std::cerr << "Option --state can't be used with --sample.\n";
+            return 1;
+        }
+
+        if (!partial_filename.empty()) {
+            if (input.sample < 1.0) {
+                std::cerr
+                    << "Option --partial-out can't be used with --sample.\n";
+                return 1;
+            }
+            if (!state_filename.empty()) {
+                std::cerr
+                    << "Option --partial-out can't be used with --state.\n";
+                return 1;
+            }
+        }
+
+        if (!shard.empty()) {
+            if (partial_filename.empty()) {
+                std::cerr << "Option --shard needs --partial-out.\n";
+                return 1;
+            }
+            parse_shard(shard, &input);
+        }
 
-        std::unordered_map<std::string, std::size_t> dict;
+        RunStats stats{"odmt-tag-stats"};
 
-        osmium::io::Reader reader{input_file};
-        while (auto const buffer = reader.read()) {
+        if (!state_filename.empty()) {
+            run_with_state(input_filename, change_filenames, state_filename,
+                           options, input, &stats);
+            stats.write_json(stats_filename);
+            return 0;
+        }
+
+        stats.add_input_file(input_filename);
+
+        auto const input_file = make_input_file(input_filename, input);
+
+        TagStatsAnalysis analysis{options, &std::cout};
+
+        analysis.set_sample_rate(input.sample);
+        InputReader reader{input_file, analysis.entities(), input};
+        stats.phase("process");
+        while (auto const buffer = stats.read(&reader)) {
             for (auto const &object : buffer.select<osmium::OSMObject>()) {
-                if (object.tags().size() <= max_tags) {
-                    for (auto const &tag : object.tags()) {
-                        if (with_values) {
-                            dict[tag.key() + std::string{"="} + tag.value()]++;
-                        } else {
-                            dict[tag.key()]++;
-                        }
-                    }
-                }
+                analysis.object(object);
             }
+            analysis.next_block();
         }
         reader.close();
 
-        using si = std::pair<std::string, std::size_t>;
-        std::vector<si> common_keys;
-        std::copy_if(
-            dict.cbegin(), dict.cend(), std::back_inserter(common_keys),
-            [&min_count](auto const &p) { return p.second >= min_count; });
-
-        std::sort(common_keys.begin(), common_keys.end(),
-                  [](si const &a, si const &b) { return a.second > b.second; });
-
-        for (auto const &p : common_keys) {
-            std::cout << p.second << ' ' << p.first << '\n';
+        stats.phase("write");
+        if (partial_filename.empty()) {
+            analysis.finish();
+            stats.add_output_files(analysis.output_files());
+        } else {
+            write_partial_file(
+                partial_filename,
+                make_partial_header("odmt-tag-stats",
+                                    analysis.partial_options(),
+                                    input_filename, input),
+                [&](std::ostream &out) { analysis.write_partial(out); });
+            stats.add_output_file(partial_filename);
         }
+        stats.write_json(stats_filename);
     } catch (std::exception const &e) {
         std::cerr << "ERROR: " << e.what() << "\n";
         return 1;
@@ -0,0 +1,571 @@
+#include "topology-state.hpp"
+
+#include "serialize.hpp"
+
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/way.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char const *const state_magic = "odmt-topology-state";
+static constexpr int const state_version = 3;
+
+// Mapped files are grown in steps of at least this size.
+static constexpr std::size_t const grow_size = 1024UL * 1024UL;
+
+// Lists are buffered in memory until there is this much data.
+static constexpr std::size_t const max_buffer_size = 1024UL * 1024UL;
+
+static std::string meta_file_name(std::string const &directory)
+{
+    return directory + "/topology-state";
+}
+
+static int open_flags(open_mode mode) noexcept
+{
+    switch (mode) {
+    case open_mode::read:
+        return O_RDONLY;
+    case open_mode::update:
+        return O_RDWR;
+    case open_mode::create:
+        break;
+    }
+    return O_RDWR | O_CREAT | O_TRUNC; // NOLINT(hicpp-signed-bitwise)
+}
+
+MappedFile::MappedFile(std::string name, open_mode mode)
+: m_name(std::move(name)), m_fd(::open(m_name.c_str(), open_flags(mode), 0644)),
+  m_writable(mode != open_mode::read)
+{
+    if (m_fd < 0) {
+        throw std::runtime_error{"Could not open file '" + m_name + "'"};
+    }
+
+    struct stat s = {};
+    if (::fstat(m_fd, &s) != 0) {
+        ::close(m_fd);
+        throw std::runtime_error{"Could not stat file '" + m_name + "'"};
+    }
+
+    if (s.st_size > 0) {
+        auto const size = static_cast<std::size_t>(s.st_size);
+        int const prot = m_writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *map = ::mmap(nullptr, size, prot, MAP_SHARED, m_fd, 0);
+        if (map == MAP_FAILED) { // NOLINT
+            ::close(m_fd);
+            throw std::runtime_error{"Could not memory map file '" + m_name +
+                                     "'"};
+        }
+        m_data = static_cast<char *>(map);
+        m_size = size;
+    }
+}
+
+MappedFile::~MappedFile() noexcept
+{
+    if (m_data) {
+        ::munmap(m_data, m_size);
+    }
+    ::close(m_fd);
+}
+
+void MappedFile::reserve(std::size_t size)
+{
+    if (size <= m_size) {
+        return;
+    }
+
+    if (!m_writable) {
+        throw std::runtime_error{"File '" + m_name + "' is read-only"};
+    }
+
+    auto new_size = std::max(size, m_size + m_size / 2);
+    new_size = (new_size + grow_size - 1) / grow_size * grow_size;
+
+    if (m_data) {
+        ::munmap(m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    if (::ftruncate(m_fd, static_cast<off_t>(new_size)) != 0) {
+        throw std::runtime_error{"Could not resize file '" + m_name + "'"};
+    }
+
+    void *map = ::mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       m_fd, 0);
+    if (map == MAP_FAILED) { // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+        throw std::runtime_error{"Could not memory map file '" + m_name +
+                                 "'"};
+    }
+    m_data = static_cast<char *>(map);
+    m_size = new_size;
+}
+
+void MappedFile::sync()
+{
+    if (m_data && ::msync(m_data, m_size, MS_SYNC) != 0) {
+        throw std::runtime_error{"Error writing file '" + m_name + "'"};
+    }
+}
+
+IdCounters::IdCounters(std::string const &file_name, open_mode mode)
+: m_file(file_name, mode), m_overflow_file_name(file_name + ".overflow")
+{
+    if (mode == open_mode::create) {
+        return;
+    }
+
+    read_file(m_overflow_file_name, [&](std::istream &in) {
+        auto const size = read_varint(in);
+        for (std::uint64_t i = 0; i < size; ++i) {
+            auto const id = read_varint(in);
+            m_overflow[id] = static_cast<std::uint32_t>(read_varint(in));
+        }
+    });
+}
+
+std::uint32_t IdCounters::get(osmium::unsigned_object_id_type id) const
+{
+    if (id >= m_file.size()) {
+        return 0;
+    }
+
+    auto const count = static_cast<std::uint8_t>(m_file.data()[id]);
+    if (count == overflow) {
+        return m_overflow.at(id);
+    }
+    return count;
+}
+
+std::uint32_t IdCounters::increment(osmium::unsigned_object_id_type id)
+{
+    m_file.reserve(static_cast<std::size_t>(id) + 1);
+    auto &byte = m_file.data()[id];
+    auto const count = static_cast<std::uint8_t>(byte);
+
+    if (count == overflow) {
+        return ++m_overflow[id];
+    }
+
+    if (count + 1 == overflow) {
+        m_overflow[id] = overflow;
+    }
+    byte = static_cast<char>(count + 1);
+    return count + 1U;
+}
+
+std::uint32_t IdCounters::decrement(osmium::unsigned_object_id_type id)
+{
+    auto const current = get(id);
+    if (current == 0) {
+        throw std::runtime_error{"Topology state is inconsistent"};
+    }
+
+    auto const count = current - 1;
+    if (count >= overflow) {
+        m_overflow[id] = count;
+    } else {
+        m_overflow.erase(id);
+        m_file.data()[id] = static_cast<char>(count);
+    }
+    return count;
+}
+
+void IdCounters::save()
+{
+    m_file.sync();
+
+    write_file_atomically(m_overflow_file_name, [&](std::ostream &out) {
+        write_varint(out, m_overflow.size());
+        for (auto const &entry : m_overflow) {
+            write_varint(out, entry.first);
+            write_varint(out, entry.second);
+        }
+    });
+}
+
+// Lists are stored as their size in bytes (4 bytes, little endian),
+// followed by the number of IDs and the zigzag encoded differences
+// between the IDs, all as varints.
+
+static std::string encode_list(std::vector<std::uint64_t> const &list)
+{
+    std::string data(4, '\0');
+    write_varint(&data, list.size());
+    std::uint64_t last = 0;
+    for (auto const id : list) {
+        auto const delta = static_cast<std::int64_t>(id - last);
+        write_varint(&data, (static_cast<std::uint64_t>(delta) << 1U) ^
+                                static_cast<std::uint64_t>(delta >> 63));
+        last = id;
+    }
+
+    auto const size = data.size() - 4;
+    for (std::size_t i = 0; i < 4; ++i) {
+        data[i] = static_cast<char>((size >> (8U * i)) & 0xffU);
+    }
+    return data;
+}
+
+static std::vector<std::uint64_t> decode_list(char const *data,
+                                              char const *end)
+{
+    auto const count = read_varint(&data, end);
+    std::vector<std::uint64_t> list;
+    std::uint64_t last = 0;
+    for (std::uint64_t i = 0; i < count; ++i) {
+        auto const value = read_varint(&data, end);
+        last += (value >> 1U) ^ (~(value & 1U) + 1U);
+        list.push_back(last);
+    }
+    return list;
+}
+
+IdListStore::IdListStore(std::string const &file_name, open_mode mode)
+: m_index(file_name + ".index", mode), m_data_file_name(file_name + ".data"),
+  m_data_fd(::open(m_data_file_name.c_str(), open_flags(mode), 0644))
+{
+    if (m_data_fd < 0) {
+        throw std::runtime_error{"Could not open file '" + m_data_file_name +
+                                 "'"};
+    }
+
+    struct stat s = {};
+    if (::fstat(m_data_fd, &s) != 0) {
+        ::close(m_data_fd);
+        throw std::runtime_error{"Could not stat file '" + m_data_file_name +
+                                 "'"};
+    }
+    m_data_size = static_cast<std::uint64_t>(s.st_size);
+}
+
+IdListStore::~IdListStore() noexcept { ::close(m_data_fd); }
+
+void IdListStore::write_buffer()
+{
+    std::size_t done = 0;
+    while (done < m_buffer.size()) {
+        auto const n =
+            ::pwrite(m_data_fd, m_buffer.data() + done, m_buffer.size() - done,
+                     static_cast<off_t>(m_data_size + done));
+        if (n <= 0) {
+            throw std::runtime_error{"Error writing file '" +
+                                     m_data_file_name + "'"};
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    m_data_size += m_buffer.size();
+    m_buffer.clear();
+}
+
+bool IdListStore::has(osmium::unsigned_object_id_type id) const
+{
+    auto const *index = reinterpret_cast<std::uint64_t const *>(m_index.data());
+    return (id + 1) * sizeof(std::uint64_t) <= m_index.size() &&
+           index[id] != 0;
+}
+
+IdListStore::id_list
+IdListStore::get(osmium::unsigned_object_id_type id) const
+{
+    if (!has(id)) {
+        return {};
+    }
+
+    auto const *index = reinterpret_cast<std::uint64_t const *>(m_index.data());
+    auto const offset = index[id] - 1;
+
+    // The list might still be in the buffer.
+    if (offset >= m_data_size) {
+        char const *data = m_buffer.data() + (offset - m_data_size);
+        std::uint32_t size = 0;
+        for (std::size_t i = 0; i < 4; ++i) {
+            size |= static_cast<std::uint32_t>(
+                        static_cast<std::uint8_t>(data[i]))
+                    << (8U * i);
+        }
+        return decode_list(data + 4, data + 4 + size);
+    }
+
+    std::string data(4, '\0');
+    if (::pread(m_data_fd, &data[0], 4, static_cast<off_t>(offset)) != 4) {
+        throw std::runtime_error{"Error reading file '" + m_data_file_name +
+                                 "'"};
+    }
+    std::uint32_t size = 0;
+    for (std::size_t i = 0; i < 4; ++i) {
+        size |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(data[i]))
+                << (8U * i);
+    }
+
+    data.resize(size);
+    if (::pread(m_data_fd, &data[0], size, static_cast<off_t>(offset + 4)) !=
+        static_cast<ssize_t>(size)) {
+        throw std::runtime_error{"Error reading file '" + m_data_file_name +
+                                 "'"};
+    }
+    return decode_list(data.data(), data.data() + data.size());
+}
+
+void IdListStore::set(osmium::unsigned_object_id_type id, id_list const &list)
+{
+    m_index.reserve((static_cast<std::size_t>(id) + 1) *
+                    sizeof(std::uint64_t));
+    auto *index = reinterpret_cast<std::uint64_t *>(m_index.data());
+    index[id] = m_data_size + m_buffer.size() + 1;
+
+    m_buffer += encode_list(list);
+    if (m_buffer.size() > max_buffer_size) {
+        write_buffer();
+    }
+}
+
+void IdListStore::remove(osmium::unsigned_object_id_type id)
+{
+    if (has(id)) {
+        reinterpret_cast<std::uint64_t *>(m_index.data())[id] = 0;
+    }
+}
+
+void IdListStore::save()
+{
+    write_buffer();
+    if (::fsync(m_data_fd) != 0) {
+        throw std::runtime_error{"Error writing file '" + m_data_file_name +
+                                 "'"};
+    }
+    m_index.sync();
+}
+
+DirectoryLock::~DirectoryLock() noexcept
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+void DirectoryLock::lock(std::string const &directory, bool exclusive)
+{
+    assert(m_fd < 0);
+    m_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (m_fd < 0) {
+        throw std::runtime_error{"Could not open directory '" + directory +
+                                 "'"};
+    }
+    // NOLINTNEXTLINE(hicpp-signed-bitwise)
+    if (::flock(m_fd, (exclusive ? LOCK_EX : LOCK_SH) | LOCK_NB) != 0) {
+        throw std::runtime_error{"Directory '" + directory +
+                                 "' is in use by another program"};
+    }
+}
+
+/**
+ * Make sure the directory exists and lock it. When creating a new state,
+ * remove the meta file of an old one (the other files are truncated when
+ * they are opened), otherwise check that there is a state.
+ */
+static std::string prepare_directory(std::string directory, open_mode mode,
+                                     DirectoryLock *lock)
+{
+    if (mode == open_mode::create) {
+        if (::mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+            throw std::runtime_error{"Could not create directory '" +
+                                     directory + "'"};
+        }
+        lock->lock(directory, true);
+        for (auto const *name :
+             {"topology-state", "node-ways.overflow",
+              "node-relations.overflow"}) {
+            std::remove((directory + "/" + name).c_str());
+        }
+        return directory;
+    }
+
+    if (::access(meta_file_name(directory).c_str(), R_OK) != 0) {
+        throw std::runtime_error{"No topology state in directory '" +
+                                 directory + "'"};
+    }
+    lock->lock(directory, mode == open_mode::update);
+    return directory;
+}
+
+TopologyState::TopologyState(std::string directory, open_mode mode)
+: m_directory(prepare_directory(std::move(directory), mode, &m_lock)),
+  m_mode(mode), m_way_counts(m_directory + "/node-ways", mode),
+  m_relation_counts(m_directory + "/node-relations", mode),
+  m_way_nodes(m_directory + "/way-nodes", mode),
+  m_relation_nodes(m_directory + "/relation-nodes", mode)
+{
+    if (mode == open_mode::create) {
+        return;
+    }
+
+    std::ifstream in{meta_file_name(m_directory)};
+    std::string magic;
+    int version = 0;
+    std::string status;
+    in >> magic >> version >> status >> m_ways >> m_relations >>
+        m_nodes_in_way >> m_nodes_in_multiple_ways >> m_nodes_in_relation;
+    if (!in || magic != state_magic || version != state_version) {
+        throw std::runtime_error{"Invalid topology state in directory '" +
+                                 m_directory + "'"};
+    }
+    if (status != "complete") {
+        throw std::runtime_error{
+            "Topology state in directory '" + m_directory +
+            "' is incomplete, an update was interrupted (create it again)"};
+    }
+}
+
+void TopologyState::write_meta(bool complete)
+{
+    write_file_atomically(meta_file_name(m_directory), [&](std::ostream &out) {
+        out << state_magic << ' ' << state_version << ' '
+            << (complete ? "complete" : "changing") << ' ' << m_ways << ' '
+            << m_relations << ' ' << m_nodes_in_way << ' '
+            << m_nodes_in_multiple_ways << ' ' << m_nodes_in_relation
+            << '\n';
+    });
+}
+
+void TopologyState::update_way(osmium::OSMObject const &object)
+{
+    auto const id = object.positive_id();
+    bool const existed = m_way_nodes.has(id);
+
+    for (auto const node : m_way_nodes.get(id)) {
+        auto const count = m_way_counts.decrement(node);
+        if (count == 0) {
+            --m_nodes_in_way;
+        } else if (count == 1) {
+            --m_nodes_in_multiple_ways;
+        }
+    }
+
+    if (!object.visible()) {
+        if (existed) {
+            m_way_nodes.remove(id);
+            --m_ways;
+        }
+        return;
+    }
+
+    // The first node of a closed way is the same as the last and only
+    // counts once.
+    std::vector<osmium::unsigned_object_id_type> nodes;
+    auto const &way = static_cast<osmium::Way const &>(object);
+    if (!way.nodes().empty()) {
+        auto const *it = way.nodes().begin();
+        if (way.is_closed()) {
+            ++it;
+        }
+        for (; it != way.nodes().end(); ++it) {
+            nodes.push_back(it->positive_ref());
+        }
+    }
+
+    for (auto const node : nodes) {
+        auto const count = m_way_counts.increment(node);
+        if (count == 1) {
+            ++m_nodes_in_way;
+        } else if (count == 2) {
+            ++m_nodes_in_multiple_ways;
+        }
+    }
+
+    m_way_nodes.set(id, nodes);
+    if (!existed) {
+        ++m_ways;
+    }
+}
+
+void TopologyState::update_relation(osmium::OSMObject const &object)
+{
+    auto const id = object.positive_id();
+    bool const existed = m_relation_nodes.has(id);
+
+    for (auto const node : m_relation_nodes.get(id)) {
+        if (m_relation_counts.decrement(node) == 0) {
+            --m_nodes_in_relation;
+        }
+    }
+
+    if (!object.visible()) {
+        if (existed) {
+            m_relation_nodes.remove(id);
+            --m_relations;
+        }
+        return;
+    }
+
+    std::vector<osmium::unsigned_object_id_type> nodes;
+    for (auto const &member :
+         static_cast<osmium::Relation const &>(object).members()) {
+        if (member.type() == osmium::item_type::node) {
+            nodes.push_back(member.positive_ref());
+        }
+    }
+
+    for (auto const node : nodes) {
+        if (m_relation_counts.increment(node) == 1) {
+            ++m_nodes_in_relation;
+        }
+    }
+
+    m_relation_nodes.set(id, nodes);
+    if (!existed) {
+        ++m_relations;
+    }
+}
+
+void TopologyState::update(osmium::OSMObject const &object)
+{
+    if (m_mode == open_mode::read) {
+        throw std::runtime_error{"Topology state in directory '" +
+                                 m_directory + "' is read-only"};
+    }
+
+    // The files are changed in place, so mark the state as incomplete
+    // until it is saved.
+    if (!m_changing) {
+        write_meta(false);
+        m_changing = true;
+    }
+
+    if (object.type() == osmium::item_type::way) {
+        update_way(object);
+    } else if (object.type() == osmium::item_type::relation) {
+        update_relation(object);
+    }
+}
+
+void TopologyState::save()
+{
+    if (m_mode == open_mode::read) {
+        throw std::runtime_error{"Topology state in directory '" +
+                                 m_directory + "' is read-only"};
+    }
+
+    m_way_counts.save();
+    m_relation_counts.save();
+    m_way_nodes.save();
+    m_relation_nodes.save();
+
+    // The state is only complete again when everything else is on disk.
+    write_meta(true);
+    m_changing = false;
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// How the files of a topology state are opened.
+enum class open_mode
+{
+    read,   // read only, the files must exist
+    update, // read and write, the files must exist
+    create  // read and write, existing files are truncated
+};
+
+/**
+ * A file memory mapped for reading and writing (or only for reading). It
+ * is grown as needed, the new parts are zero. On most file systems they
+ * don't take up any space until something is written to them.
+ */
+class MappedFile
+{
+
+    std::string m_name;
+    int m_fd;
+    char *m_data = nullptr;
+    std::size_t m_size = 0;
+    bool m_writable;
+
+public:
+    /// @throws std::runtime_error if the file can't be opened.
+    MappedFile(std::string name, open_mode mode);
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    MappedFile(MappedFile &&) = delete;
+    MappedFile &operator=(MappedFile &&) = delete;
+
+    ~MappedFile() noexcept;
+
+    [[nodiscard]] char *data() noexcept { return m_data; }
+
+    [[nodiscard]] char const *data() const noexcept { return m_data; }
+
+    [[nodiscard]] std::size_t size() const noexcept { return m_size; }
+
+    /// Make sure the file is at least this large. Needs a writable file.
+    void reserve(std::size_t size);
+
+    /// Write changes in the mapping to disk.
+    void sync();
+
+}; // class MappedFile
+
+/**
+ * A counter for each ID stored in one byte per ID in a memory mapped
+ * file. The few counts too large for a byte are kept in a hash map and
+ * stored in a separate file by save().
+ */
+class IdCounters
+{
+
+    static constexpr std::uint8_t const overflow = 255;
+
+    MappedFile m_file;
+    std::string m_overflow_file_name;
+    std::unordered_map<osmium::unsigned_object_id_type, std::uint32_t>
+        m_overflow;
+
+public:
+    IdCounters(std::string const &file_name, open_mode mode);
+
+    [[nodiscard]] std::uint32_t get(osmium::unsigned_object_id_type id) const;
+
+    /// Increment the counter, returns the new value.
+    std::uint32_t increment(osmium::unsigned_object_id_type id);
+
+    /// Decrement the counter (which must not be 0), returns the new value.
+    std::uint32_t decrement(osmium::unsigned_object_id_type id);
+
+    void save();
+
+}; // class IdCounters
+
+/**
+ * Stores a list of IDs (for instance the node IDs of a way) for each ID.
+ * Lists are appended to a data file, a memory mapped index file contains
+ * the position of the list for each ID. When a list is changed, the new
+ * list is appended, the space of the old one is not reused.
+ */
+class IdListStore
+{
+
+    using id_list = std::vector<osmium::unsigned_object_id_type>;
+
+    MappedFile m_index;
+    std::string m_data_file_name;
+    int m_data_fd;
+    std::uint64_t m_data_size = 0; // size of the data file on disk
+    std::string m_buffer;          // data not yet written to disk
+
+    void write_buffer();
+
+public:
+    IdListStore(std::string const &file_name, open_mode mode);
+
+    IdListStore(IdListStore const &) = delete;
+    IdListStore &operator=(IdListStore const &) = delete;
+
+    IdListStore(IdListStore &&) = delete;
+    IdListStore &operator=(IdListStore &&) = delete;
+
+    ~IdListStore() noexcept;
+
+    /// Is there a list for this ID?
+    [[nodiscard]] bool has(osmium::unsigned_object_id_type id) const;
+
+    /// Get the list for this ID. Returns an empty list if there is none.
+    [[nodiscard]] id_list get(osmium::unsigned_object_id_type id) const;
+
+    void set(osmium::unsigned_object_id_type id, id_list const &list);
+
+    void remove(osmium::unsigned_object_id_type id);
+
+    void save();
+
+}; // class IdListStore
+
+/**
+ * An advisory lock on a directory (see flock(2)). It is released when the
+ * object is destroyed.
+ */
+class DirectoryLock
+{
+
+    int m_fd = -1;
+
+public:
+    DirectoryLock() noexcept = default;
+
+    DirectoryLock(DirectoryLock const &) = delete;
+    DirectoryLock &operator=(DirectoryLock const &) = delete;
+
+    DirectoryLock(DirectoryLock &&) = delete;
+    DirectoryLock &operator=(DirectoryLock &&) = delete;
+
+    ~DirectoryLock() noexcept;
+
+    /**
+     * Take a shared or exclusive lock without waiting.
+     *
+     * @throws std::runtime_error if someone else holds a conflicting lock.
+     */
+    void lock(std::string const &directory, bool exclusive);
+
+}; // class DirectoryLock
+
+/**
+ * The topology of the nodes: In how many ways and relations each node is.
+ * The node lists of all ways and the node members of all relations are
+ * stored, too, so the state can be updated from change files. For each
+ * changed way the counters of its old nodes are decremented and those of
+ * its new nodes incremented, relations work the same.
+ *
+ * The state lives in a directory. The counters are memory mapped files
+ * with one byte per node ID. Closed ways count only once for their first
+ * and last node, like in odmt-way-nodes.
+ *
+ * Most files are changed in place. Before the first change the state is
+ * marked as incomplete in the meta file, save() marks it as complete
+ * again. An incomplete state (after an interrupted update) can't be
+ * opened.
+ *
+ * Programs only reading the state open it read-only with a shared lock on
+ * the directory, programs changing it take an exclusive lock. So the state
+ * can't be updated while it is read.
+ */
+class TopologyState
+{
+
+    DirectoryLock m_lock;
+    std::string m_directory;
+    open_mode m_mode;
+
+    IdCounters m_way_counts;
+    IdCounters m_relation_counts;
+    IdListStore m_way_nodes;
+    IdListStore m_relation_nodes;
+
+    std::uint64_t m_ways = 0;
+    std::uint64_t m_relations = 0;
+    std::uint64_t m_nodes_in_way = 0;
+    std::uint64_t m_nodes_in_multiple_ways = 0;
+    std::uint64_t m_nodes_in_relation = 0;
+
+    // Has the state been changed since it was opened or saved?
+    bool m_changing = false;
+
+    void write_meta(bool complete);
+
+    void update_way(osmium::OSMObject const &object);
+
+    void update_relation(osmium::OSMObject const &object);
+
+public:
+    /**
+     * Open the state in the directory. With open_mode::create a new empty
+     * state is created, any old state in the directory is removed.
+     *
+     * @throws std::runtime_error if the state doesn't exist, is invalid,
+     *         is incomplete, or is locked by another program.
+     */
+    TopologyState(std::string directory, open_mode mode);
+
+    /**
+     * Add a way or relation or, if it is already in the state, replace it.
+     * Deleted objects are removed. Nodes are ignored.
+     *
+     * @throws std::runtime_error if the state was opened read-only.
+     */
+    void update(osmium::OSMObject const &object);
+
+    /// Write all changes to disk.
+    void save();
+
+    [[nodiscard]] std::uint64_t ways() const noexcept { return m_ways; }
+
+    [[nodiscard]] std::uint64_t relations() const noexcept
+    {
+        return m_relations;
+    }
+
+    /// The number of node IDs referenced from ways.
+    [[nodiscard]] std::uint64_t nodes_in_way() const noexcept
+    {
+        return m_nodes_in_way;
+    }
+
+    [[nodiscard]] std::uint64_t nodes_in_multiple_ways() const noexcept
+    {
+        return m_nodes_in_multiple_ways;
+    }
+
+    [[nodiscard]] std::uint64_t nodes_in_relation() const noexcept
+    {
+        return m_nodes_in_relation;
+    }
+
+    [[nodiscard]] bool in_way(osmium::unsigned_object_id_type id) const
+    {
+        return m_way_counts.get(id) > 0;
+    }
+
+    [[nodiscard]] bool
+    in_multiple_ways(osmium::unsigned_object_id_type id) const
+    {
+        return m_way_counts.get(id) > 1;
+    }
+
+    [[nodiscard]] bool in_relation(osmium::unsigned_object_id_type id) const
+    {
+        return m_relation_counts.get(id) > 0;
+    }
+
+}; // class TopologyState
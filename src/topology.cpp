@@ -0,0 +1,148 @@
+/*
+
+OSM Data Model Tools
+
+topology
+
+Copyright (C) 2018-2022  Jochen Topf <jochen@topf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "change-file.hpp"
+#include "input-reader.hpp"
+#include "run-stats.hpp"
+#include "topology-state.hpp"
+
+#include <osmium/io/any_input.hpp>
+
+#include <lyra.hpp>
+
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    try {
+        std::string input_filename;
+        std::string stats_filename;
+        std::string state_directory;
+        std::vector<std::string> change_filenames;
+        input_options input;
+        bool help = false;
+
+        // clang-format off
+        auto const cli
+            = lyra::opt(state_directory, "DIR")
+                ["-s"]["--state"]
+                ("directory with the topology state")
+            | lyra::opt(change_filenames, "OSC-FILE")
+                ["-a"]["--apply-changes"]
+                ("update state with changes instead of reading input (can be given several times)")
+            | lyra::opt(input.format, "FORMAT")
+                ["--input-format"]
+                ("format of input file (needed for STDIN)")
+            | lyra::opt(input.mmap)
+                ["--mmap"]
+                ("memory map PBF input file")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
+            | lyra::help(help)
+            | lyra::arg(input_filename, "FILENAME")
+                ("input file");
+        // clang-format on
+
+        auto const result = cli.parse(lyra::args(argc, argv));
+        if (!result) {
+            std::cerr << "Error in command line: " << result.message() << '\n';
+            return 1;
+        }
+
+        if (help) {
+            std::cout << cli
+                      << "\nCreate or update the node topology state.\n";
+            return 0;
+        }
+
+        if (state_directory.empty()) {
+            std::cerr << "Missing state directory. Try '-h'.\n";
+            return 1;
+        }
+
+        if (!change_filenames.empty()) {
+            if (!input_filename.empty()) {
+                std::cerr << "Use either an input file or --apply-changes.\n";
+                return 1;
+            }
+        } else if (input_filename.empty()) {
+            std::cerr << "Missing input filename. Try '-h'.\n";
+            return 1;
+        }
+
+        RunStats stats{"odmt-topology"};
+
+        bool const create = change_filenames.empty();
+
+        TopologyState state{state_directory,
+                            create ? open_mode::create : open_mode::update};
+
+        stats.phase("process");
+        if (create) {
+            stats.add_input_file(input_filename);
+            auto const file = make_input_file(input_filename, input);
+            InputReader reader{file,
+                               osmium::osm_entity_bits::way |
+                                   osmium::osm_entity_bits::relation,
+                               input};
+            while (auto const buffer = stats.read(&reader)) {
+                for (auto const &object : buffer.select<osmium::OSMObject>()) {
+                    state.update(object);
+                }
+            }
+            reader.close();
+        }
+
+        for (auto const &filename : change_filenames) {
+            stats.add_input_file(filename);
+            read_change_file(filename,
+                             osmium::osm_entity_bits::way |
+                                 osmium::osm_entity_bits::relation,
+                             input, &stats,
+                             [&](osmium::OSMObject const &object) {
+                                 state.update(object);
+                             });
+        }
+
+        stats.phase("write");
+        state.save();
+
+        std::cout << "ways: " << state.ways()
+                  << "\nrelations: " << state.relations()
+                  << "\nnodes in way: " << state.nodes_in_way()
+                  << "\nnodes in multiple ways: "
+                  << state.nodes_in_multiple_ways()
+                  << "\nnodes in relation: " << state.nodes_in_relation()
+                  << '\n';
+
+        stats.write_json(stats_filename);
+    } catch (std::exception const &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
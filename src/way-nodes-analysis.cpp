@@ -0,0 +1,308 @@
+#include "way-nodes-analysis.hpp"
+
+#include "partial-state.hpp"
+#include "serialize.hpp"
+
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/way.hpp>
+
+#include <cassert>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+
+static std::string percent(SampledFraction const &fraction, double rate,
+                           char const *text)
+{
+    return " (" + format_percent(fraction, rate) + " of " + text + ")";
+}
+
+// The ID sets in a partial file, in this order.
+enum partial_set : std::size_t
+{
+    set_nodes,
+    set_tagged_nodes,
+    set_in_way,
+    set_in_multiple_ways,
+    set_in_relation,
+    num_partial_sets
+};
+
+static std::uint64_t varint_size(std::uint64_t value) noexcept
+{
+    std::uint64_t size = 1;
+    for (; value >= 0x80U; value >>= 7U) {
+        ++size;
+    }
+    return size;
+}
+
+/**
+ * Write the set with write_id_set() preceded by its size in bytes, so
+ * that readers can skip it.
+ */
+static void write_id_run(std::ostream &out,
+                         WayNodesAnalysis::id_set const &set)
+{
+    std::uint64_t bytes = varint_size(set.size());
+    std::uint64_t last = 0;
+    for (auto const id : set) {
+        bytes += varint_size(id - last);
+        last = id;
+    }
+    write_varint(out, bytes);
+    write_id_set(out, set);
+}
+
+/**
+ * Reads the sorted IDs of one set from a partial file with its own stream,
+ * so that the sets of several files can be read side by side.
+ */
+class IdRunReader
+{
+
+    std::ifstream m_in;
+    std::uint64_t m_remaining;
+    std::uint64_t m_id = 0;
+    bool m_empty = false;
+
+public:
+    IdRunReader(std::string const &file_name, std::streamoff offset)
+    : m_in(file_name, std::ios::binary)
+    {
+        m_in.seekg(offset);
+        if (!m_in) {
+            throw std::runtime_error{"Error reading file '" + file_name +
+                                     "'"};
+        }
+        m_remaining = read_varint(m_in);
+        pop();
+    }
+
+    [[nodiscard]] bool empty() const noexcept { return m_empty; }
+
+    [[nodiscard]] std::uint64_t front() const noexcept { return m_id; }
+
+    void pop()
+    {
+        if (m_remaining == 0) {
+            m_empty = true;
+            return;
+        }
+        m_id += read_varint(m_in);
+        --m_remaining;
+    }
+
+}; // class IdRunReader
+
+/**
+ * Merges the sorted IDs of the same set from all partial files.
+ */
+class IdRunMerger
+{
+
+    using entry = std::pair<std::uint64_t, std::size_t>;
+
+    std::vector<std::unique_ptr<IdRunReader>> m_readers;
+    std::priority_queue<entry, std::vector<entry>, std::greater<>> m_queue;
+
+    void push(std::size_t n)
+    {
+        if (!m_readers[n]->empty()) {
+            m_queue.emplace(m_readers[n]->front(), n);
+        }
+    }
+
+public:
+    void add(std::string const &file_name, std::streamoff offset)
+    {
+        m_readers.push_back(
+            std::make_unique<IdRunReader>(file_name, offset));
+        push(m_readers.size() - 1);
+    }
+
+    [[nodiscard]] bool empty() const noexcept { return m_queue.empty(); }
+
+    [[nodiscard]] std::uint64_t front() const noexcept
+    {
+        return m_queue.top().first;
+    }
+
+    /**
+     * Skip all IDs smaller than id and return in how many files id is.
+     * Must be called with ascending IDs.
+     */
+    std::size_t count(std::uint64_t id)
+    {
+        std::size_t n = 0;
+        while (!m_queue.empty() && m_queue.top().first <= id) {
+            auto const reader = m_queue.top().second;
+            if (m_queue.top().first == id) {
+                ++n;
+            }
+            m_queue.pop();
+            m_readers[reader]->pop();
+            push(reader);
+        }
+        return n;
+    }
+
+}; // class IdRunMerger
+
+WayNodesAnalysis::WayNodesAnalysis(std::ostream *out,
+                                   TopologyState const *topology)
+: m_out(out), m_topology(topology)
+{
+    assert(out);
+}
+
+void WayNodesAnalysis::object(osmium::OSMObject const &object)
+{
+    if (object.type() == osmium::item_type::node) {
+        if (m_topology || m_ways_complete) {
+            count_node(object.positive_id(), !object.tags().empty(), block());
+            return;
+        }
+        if (m_node_blocks.empty() || m_node_blocks.back().second != block()) {
+            m_node_blocks.emplace_back(object.positive_id(), block());
+        }
+        m_node_ids.set(object.positive_id());
+        if (!object.tags().empty()) {
+            m_tagged_node_ids.set(object.positive_id());
+        }
+    } else if (object.type() == osmium::item_type::way) {
+        ++m_count_ways;
+        auto const &way = static_cast<osmium::Way const &>(object);
+        if (way.nodes().empty()) {
+            return;
+        }
+        auto const *it = way.nodes().begin();
+        if (way.is_closed()) {
+            ++it;
+        }
+        for (; it != way.nodes().end(); ++it) {
+            if (m_in_way.get(it->positive_ref())) {
+                m_in_multiple_ways.set(it->positive_ref());
+            } else {
+                m_in_way.set(it->positive_ref());
+            }
+        }
+    } else if (object.type() == osmium::item_type::relation) {
+        ++m_count_relations;
+        for (auto const &member :
+             static_cast<osmium::Relation const &>(object).members()) {
+            if (member.type() == osmium::item_type::node) {
+                m_in_relation.set(member.positive_ref());
+            }
+        }
+    }
+}
+
+void WayNodesAnalysis::count_node(osmium::unsigned_object_id_type id,
+                                  bool tagged, std::size_t block)
+{
+    count_node(tagged, in_way(id),
+               m_topology ? m_topology->in_multiple_ways(id)
+                          : m_in_multiple_ways.get(id),
+               m_topology ? m_topology->in_relation(id) : m_in_relation.get(id),
+               block);
+}
+
+void WayNodesAnalysis::count_node(bool tagged, bool in_way,
+                                  bool in_multiple_ways, bool in_relation,
+                                  std::size_t block)
+{
+    m_nodes.count(block);
+    m_nodes_with_tags.count(block, tagged);
+    m_nodes_in_way.count(block, in_way);
+    m_nodes_with_tags_in_way.count(block, tagged && in_way);
+    if (tagged) {
+        m_tagged_nodes_in_way.count(block, in_way);
+    }
+    m_nodes_in_multiple_ways.count(block, in_multiple_ways);
+    m_nodes_in_relation.count(block, in_relation);
+}
+
+void WayNodesAnalysis::finish()
+{
+    // Node IDs are sorted in the input, so the block of a node can be
+    // found by walking along the blocks in parallel.
+    auto block = m_node_blocks.cbegin();
+    for (auto const id : m_node_ids) {
+        while (std::next(block) != m_node_blocks.cend() &&
+               std::next(block)->first <= id) {
+            ++block;
+        }
+        count_node(id, m_tagged_node_ids.get(id), block->second);
+    }
+
+    if (m_topology) {
+        m_count_ways = m_topology->ways();
+        m_count_relations = m_topology->relations();
+    }
+
+    auto const rate = sample_rate();
+    *m_out << "nodes: " << format_count(m_nodes, rate)
+           << "\nways: " << m_count_ways
+           << "\nrelations: " << m_count_relations
+           << "\nnodes with tags: " << format_part(m_nodes_with_tags, rate)
+           << percent(m_nodes_with_tags, rate, "all nodes")
+           << "\nnodes in way: " << format_part(m_nodes_in_way, rate)
+           << percent(m_nodes_in_way, rate, "all nodes")
+           << "\nnodes with tags in way: "
+           << format_part(m_nodes_with_tags_in_way, rate)
+           << percent(m_nodes_with_tags_in_way, rate, "all nodes")
+           << percent(m_tagged_nodes_in_way, rate, "tagged nodes")
+           << "\nnodes in multiple ways: "
+           << format_part(m_nodes_in_multiple_ways, rate)
+           << percent(m_nodes_in_multiple_ways, rate, "all nodes")
+           << "\nnodes in relation: " << format_part(m_nodes_in_relation, rate)
+           << percent(m_nodes_in_relation, rate, "all nodes") << '\n';
+}
+
+void WayNodesAnalysis::write_partial(std::ostream &out) const
+{
+    assert(!m_topology && !m_ways_complete);
+    write_varint(out, m_count_ways);
+    write_varint(out, m_count_relations);
+    for (auto const *set : {&m_node_ids, &m_tagged_node_ids, &m_in_way,
+                            &m_in_multiple_ways, &m_in_relation}) {
+        write_id_run(out, *set);
+    }
+}
+
+void WayNodesAnalysis::merge_partial(std::vector<std::string> const &file_names)
+{
+    assert(!m_topology && !m_ways_complete);
+
+    std::vector<IdRunMerger> sets(num_partial_sets);
+    for (auto const &file_name : file_names) {
+        auto in = open_partial_file(file_name);
+        m_count_ways += read_varint(in);
+        m_count_relations += read_varint(in);
+        for (auto &set : sets) {
+            auto const bytes = read_varint(in);
+            set.add(file_name, in.tellg());
+            in.seekg(static_cast<std::streamoff>(bytes), std::ios::cur);
+        }
+        if (!in || in.peek() != std::char_traits<char>::eof()) {
+            throw std::runtime_error{"Error reading file '" + file_name +
+                                     "'"};
+        }
+    }
+
+    // Nodes are counted like in a run with the ways before the nodes.
+    auto &nodes = sets[set_nodes];
+    while (!nodes.empty()) {
+        auto const id = nodes.front();
+        nodes.count(id);
+        auto const in_ways = sets[set_in_way].count(id);
+        count_node(sets[set_tagged_nodes].count(id) > 0, in_ways > 0,
+                   in_ways > 1 || sets[set_in_multiple_ways].count(id) > 0,
+                   sets[set_in_relation].count(id) > 0, block());
+    }
+}
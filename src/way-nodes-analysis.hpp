@@ -0,0 +1,122 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "sample.hpp"
+#include "topology-state.hpp"
+
+#include <osmium/index/id_set.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Collects statistics about nodes and their use as way nodes and relation
+ * members. The statistics are written to the output stream in finish().
+ *
+ * If all ways and relations come before the nodes (the tool reads them in
+ * a first pass and calls ways_complete() before the nodes), the nodes are
+ * simply counted. Otherwise (in a single pass over the input like in
+ * odmt-all, or for partial results) the IDs of the nodes are remembered in
+ * sets and only counted in finish(). Then nodes with the same ID are only
+ * counted once.
+ *
+ * If only a sample of the input was read, this should be a sample of the
+ * blocks with nodes only, all ways and relations must be read. Then the
+ * node counts are estimates and are written with their errors.
+ *
+ * If a topology state (see odmt-topology) is given, the information about
+ * ways and relations is taken from it and only the nodes are read.
+ */
+class WayNodesAnalysis : public Analysis
+{
+
+public:
+    using id_set = osmium::index::IdSetDense<osmium::unsigned_object_id_type>;
+
+private:
+    id_set m_in_way;
+    id_set m_in_multiple_ways;
+    id_set m_in_relation;
+
+    // Nodes seen before all ways and relations were complete.
+    id_set m_node_ids;
+    id_set m_tagged_node_ids;
+
+    // The first node ID and the number of each block containing nodes in
+    // m_node_ids. Used to find out which block a node was in when sampling.
+    std::vector<std::pair<osmium::unsigned_object_id_type, std::size_t>>
+        m_node_blocks;
+
+    SampledCount m_nodes;
+    SampledFraction m_nodes_with_tags;
+    SampledFraction m_nodes_in_way;
+    SampledFraction m_nodes_with_tags_in_way;
+    SampledFraction m_tagged_nodes_in_way; // fraction of tagged nodes
+    SampledFraction m_nodes_in_multiple_ways;
+    SampledFraction m_nodes_in_relation;
+
+    bool m_ways_complete = false;
+
+    std::uint64_t m_count_ways = 0;
+    std::uint64_t m_count_relations = 0;
+
+    std::ostream *m_out;
+    TopologyState const *m_topology;
+
+    void count_node(osmium::unsigned_object_id_type id, bool tagged,
+                    std::size_t block);
+
+    void count_node(bool tagged, bool in_way, bool in_multiple_ways,
+                    bool in_relation, std::size_t block);
+
+public:
+    explicit WayNodesAnalysis(std::ostream *out,
+                              TopologyState const *topology = nullptr);
+
+    [[nodiscard]] osmium::osm_entity_bits::type
+    entities() const noexcept override
+    {
+        return m_topology ? osmium::osm_entity_bits::node
+                          : osmium::osm_entity_bits::nwr;
+    }
+
+    void object(osmium::OSMObject const &object) override;
+
+    /**
+     * Tell the analysis that all ways and relations have been seen, so
+     * nodes coming after this can be counted right away.
+     */
+    void ways_complete() noexcept { m_ways_complete = true; }
+
+    void finish() override;
+
+    /**
+     * Write the ID sets and counts for merging them with those of other
+     * shards. Each set is written as a sorted run of the IDs seen in this
+     * shard. Not available with a topology state or after ways_complete().
+     */
+    void write_partial(std::ostream &out) const;
+
+    /**
+     * Count the nodes from the partial files of all shards written by
+     * write_partial(). The sorted runs of all files are merged in a single
+     * streaming pass, the sets are never held in memory. A node in ways in
+     * different shards is in multiple ways. Call finish() afterwards.
+     *
+     * @throws std::runtime_error if a partial file is invalid.
+     */
+    void merge_partial(std::vector<std::string> const &file_names);
+
+    /// Is the node referenced from any way?
+    [[nodiscard]] bool in_way(osmium::unsigned_object_id_type id) const
+    {
+        return m_topology ? m_topology->in_way(id) : m_in_way.get(id);
+    }
+
+}; // class WayNodesAnalysis
@@ -21,30 +21,34 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
 
-#include <osmium/index/id_set.hpp>
+#include "input-reader.hpp"
+#include "output-options.hpp"
+#include "partial-state.hpp"
+#include "run-stats.hpp"
+#include "topology-state.hpp"
+#include "way-nodes-analysis.hpp"
+
 #include <osmium/io/any_input.hpp>
 #include <osmium/io/any_output.hpp>
 
 #include <lyra.hpp>
 
-#include <cstdlib>
 #include <exception>
 #include <iostream>
 #include <memory>
 #include <string>
 
-static std::string percent(std::uint64_t fraction, std::uint64_t all,
-                           char const *text) noexcept
-{
-    auto const p = fraction * 100 / all;
-    return " (" + std::to_string(p) + "% of " + text + ")";
-}
-
 int main(int argc, char *argv[])
 {
     try {
         std::string input_filename;
+        std::string stats_filename;
+        input_options input;
+        output_options output;
         std::string output_directory;
+        std::string topology_directory;
+        std::string shard;
+        std::string partial_filename;
         bool help = false;
 
         // clang-format off
@@ -52,6 +56,30 @@ int main(int argc, char *argv[])
             = lyra::opt(output_directory, "DIR")
                 ["-o"]["--output-dir"]
                 ("output directory")
+            | lyra::opt(topology_directory, "DIR")
+                ["-t"]["--topology"]
+                ("use topology state in DIR (see odmt-topology) instead of reading ways and relations")
+            | lyra::opt(input.sample, "RATE")
+                ["--sample"]
+                ("only read this fraction of the PBF blobs and estimate results (default: 1)")
+            | lyra::opt(shard, "I/N")
+                ["--shard"]
+                ("only read every N-th PBF blob starting with blob I (counting from 0, needs --partial-out)")
+            | lyra::opt(partial_filename, "FILE")
+                ["--partial-out"]
+                ("write partial results to FILE for odmt-merge instead of the statistics")
+            | lyra::opt(input.format, "FORMAT")
+                ["--input-format"]
+                ("format of input file (needed for STDIN)")
+            | lyra::opt(input.mmap)
+                ["--mmap"]
+                ("memory map PBF input file")
+            | lyra::opt(output.compression, "COMPRESSION")
+                ["--output-compression"]
+                ("compression of PBF output files (none, lz4, zlib[:LEVEL])")
+            | lyra::opt(stats_filename, "FILE")
+                ["--stats-json"]
+                ("write statistics about this run to FILE as JSON")
             | lyra::help(help)
             | lyra::arg(input_filename, "FILENAME")
                 ("input file");
@@ -73,112 +101,115 @@ int main(int argc, char *argv[])
             return 1;
         }
 
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> in_way;
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type>
-            in_multiple_ways;
-        osmium::index::IdSetDense<osmium::unsigned_object_id_type> in_relation;
-
-        osmium::io::File input_file{input_filename};
-
-        std::uint64_t count_ways = 0;
-        std::uint64_t count_relations = 0;
-
-        osmium::io::Reader reader1{input_file,
-                                   osmium::osm_entity_bits::way |
-                                       osmium::osm_entity_bits::relation};
-        while (auto const buffer = reader1.read()) {
-            for (auto const &object : buffer.select<osmium::OSMObject>()) {
-                if (object.type() == osmium::item_type::way) {
-                    ++count_ways;
-                    auto const &way = static_cast<osmium::Way const &>(object);
-                    if (way.nodes().empty()) {
-                        continue;
-                    }
-                    auto const *it = way.nodes().begin();
-                    if (way.is_closed()) {
-                        ++it;
-                    }
-                    for (; it != way.nodes().end(); ++it) {
-                        if (in_way.get(it->positive_ref())) {
-                            in_multiple_ways.set(it->positive_ref());
-                        } else {
-                            in_way.set(it->positive_ref());
-                        }
-                    }
-                } else {
-                    ++count_relations;
-                    for (auto const &member :
-                         static_cast<osmium::Relation const &>(object)
-                             .members()) {
-                        if (member.type() == osmium::item_type::node) {
-                            in_relation.set(member.positive_ref());
-                        }
-                    }
-                }
+        if (is_stdin(input_filename) && !output_directory.empty()) {
+            std::cerr << "Can not use --output-dir when reading from STDIN, "
+                         "the input would have to be read twice.\n";
+            return 1;
+        }
+
+        if (!partial_filename.empty()) {
+            if (input.sample < 1.0) {
+                std::cerr
+                    << "Option --partial-out can't be used with --sample.\n";
+                return 1;
+            }
+            if (!output_directory.empty() || !topology_directory.empty()) {
+                std::cerr << "Option --partial-out can't be used with "
+                             "--output-dir or --topology.\n";
+                return 1;
+            }
+        }
+
+        if (!shard.empty()) {
+            if (partial_filename.empty()) {
+                std::cerr << "Option --shard needs --partial-out.\n";
+                return 1;
             }
+            parse_shard(shard, &input);
         }
-        reader1.close();
 
-        std::uint64_t count_nodes = 0;
-        std::uint64_t count_nodes_with_tags = 0;
-        std::uint64_t count_nodes_in_way = 0;
-        std::uint64_t count_nodes_with_tags_in_way = 0;
-        std::uint64_t count_nodes_in_multiple_ways = 0;
-        std::uint64_t count_nodes_in_relation = 0;
+        RunStats stats{"odmt-way-nodes"};
+        stats.add_input_file(input_filename);
 
-        std::unique_ptr<osmium::io::Writer> writer_nodes_with_tags_in_way;
-        if (!output_directory.empty()) {
-            writer_nodes_with_tags_in_way =
-                std::make_unique<osmium::io::Writer>(
-                    output_directory + "/nodes_with_tags_in_way.osm.pbf");
+        auto const input_file = make_input_file(input_filename, input);
+
+        std::unique_ptr<TopologyState> topology;
+        if (!topology_directory.empty()) {
+            topology = std::make_unique<TopologyState>(topology_directory,
+                                                       open_mode::read);
         }
 
-        osmium::io::Reader reader2{input_file, osmium::osm_entity_bits::node};
-        while (auto const buffer = reader2.read()) {
-            for (auto const &node : buffer.select<osmium::Node>()) {
-                ++count_nodes;
-                if (!node.tags().empty()) {
-                    ++count_nodes_with_tags;
-                }
-                if (in_way.get(node.positive_id())) {
-                    ++count_nodes_in_way;
-                    if (!node.tags().empty()) {
-                        ++count_nodes_with_tags_in_way;
-                        if (writer_nodes_with_tags_in_way) {
-                            (*writer_nodes_with_tags_in_way)(node);
-                        }
-                    }
-                    if (in_multiple_ways.get(node.positive_id())) {
-                        ++count_nodes_in_multiple_ways;
-                    }
-                }
-                if (in_relation.get(node.positive_id())) {
-                    ++count_nodes_in_relation;
+        WayNodesAnalysis analysis{&std::cout, topology.get()};
+
+        // Only nodes are sampled, we need all ways and relations to know
+        // in which ways and relations the sampled nodes are.
+        input.sample_entities = osmium::osm_entity_bits::node;
+        analysis.set_sample_rate(input.sample);
+
+        auto const read = [&](osmium::osm_entity_bits::type entities,
+                              auto const &func) {
+            InputReader reader{input_file, entities, input};
+            while (auto const buffer = stats.read(&reader)) {
+                for (auto const &object : buffer.select<osmium::OSMObject>()) {
+                    func(object);
                 }
+                analysis.next_block();
             }
+            reader.close();
+        };
+
+        stats.phase("process");
+
+        std::unique_ptr<osmium::io::Writer> writer;
+        if (!output_directory.empty()) {
+            std::string const output_filename{
+                output_directory + "/nodes_with_tags_in_way.osm.pbf"};
+            stats.add_output_file(output_filename);
+            writer = std::make_unique<osmium::io::Writer>(
+                make_output_file(output_filename, output));
+        }
+
+        auto const process = [&](osmium::OSMObject const &object) {
+            analysis.object(object);
+            if (writer && object.type() == osmium::item_type::node &&
+                !object.tags().empty() &&
+                analysis.in_way(object.positive_id())) {
+                (*writer)(object);
+            }
+        };
+
+        // Read all ways and relations first, so that the nodes can be
+        // counted (and written out) when they are read in the second pass.
+        // With a topology state the nodes are all we need. STDIN can only
+        // be read once and partial files need the node IDs, in those cases
+        // all objects are read in one pass and the node IDs are remembered.
+        if (topology || is_stdin(input_filename) || !partial_filename.empty()) {
+            read(analysis.entities(), process);
+        } else {
+            read(osmium::osm_entity_bits::way |
+                     osmium::osm_entity_bits::relation,
+                 process);
+            analysis.ways_complete();
+            read(osmium::osm_entity_bits::node, process);
+        }
+
+        if (writer) {
+            writer->close();
         }
 
-        if (writer_nodes_with_tags_in_way) {
-            writer_nodes_with_tags_in_way->close();
+        stats.phase("write");
+
+        if (partial_filename.empty()) {
+            analysis.finish();
+        } else {
+            write_partial_file(
+                partial_filename,
+                make_partial_header("odmt-way-nodes", {}, input_filename,
+                                    input),
+                [&](std::ostream &out) { analysis.write_partial(out); });
+            stats.add_output_file(partial_filename);
         }
-        reader2.close();
-
-        std::cout
-            << "nodes: " << count_nodes << "\nways: " << count_ways
-            << "\nrelations: " << count_relations
-            << "\nnodes with tags: " << count_nodes_with_tags
-            << percent(count_nodes_with_tags, count_nodes, "all nodes")
-            << "\nnodes in way: " << count_nodes_in_way
-            << percent(count_nodes_in_way, count_nodes, "all nodes")
-            << "\nnodes with tags in way: " << count_nodes_with_tags_in_way
-            << percent(count_nodes_with_tags_in_way, count_nodes, "all nodes")
-            << percent(count_nodes_with_tags_in_way, count_nodes_with_tags,
-                       "tagged nodes")
-            << "\nnodes in multiple ways: " << count_nodes_in_multiple_ways
-            << percent(count_nodes_in_multiple_ways, count_nodes, "all nodes")
-            << "\nnodes in relation: " << count_nodes_in_relation
-            << percent(count_nodes_in_relation, count_nodes, "all nodes")
-            << '\n';
+        stats.write_json(stats_filename);
 
     } catch (std::exception const &e) {
         std::cerr << "ERROR: " << e.what() << "\n";
@@ -0,0 +1,26 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/all.sh SOURCE_DIR
+#
+#  Check that odmt-all creates the same reports as the single tools.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+
+for input in "$SRCDIR"/test/line-or-polygon/*.opl; do
+    output="all/"$(basename -s .opl "$input")
+    mkdir -p "$output/single"
+    ../src/odmt-all -o "$output" "$input"
+    ../src/odmt-line-or-polygon -o "$output/single" "$input" >"$output/single/line-or-polygon.txt"
+    ../src/odmt-tag-stats "$input" >"$output/single/tag-stats.txt"
+    ../src/odmt-way-nodes "$input" >"$output/single/way-nodes.txt"
+    for report in line-or-polygon tag-stats way-nodes; do
+        diff -u "$output/single/$report.txt" "$output/$report.txt"
+    done
+done
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,21 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/bench.sh SOURCE_DIR
+#
+#  Run the benchmarks on a tiny data set to make sure they work.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+mkdir -p bench
+
+../src/odmt-bench -d bench -s 2000 -i 1
+
+# generated data must be the same every time
+cp bench/synthetic-2000-1.osm.pbf bench/first.osm.pbf
+../src/odmt-bench -d bench -s 2000 -g
+cmp bench/first.osm.pbf bench/synthetic-2000-1.osm.pbf
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,76 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/checkpoint.sh SOURCE_DIR
+#
+#  Check that programs killed at random points and restarted with the same
+#  checkpoint directory create the same output as an uninterrupted run.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+rm -fr checkpoint
+mkdir -p checkpoint
+
+../src/odmt-bench -d checkpoint -s 200000 -g
+INPUT=checkpoint/synthetic-200000-1.osm.pbf
+
+# run_until_done OUTPUT_DIR PATTERN PROGRAM [OPTIONS...]
+#
+# Run the program with a checkpoint after every blob, killing it after a
+# short time. Restart it with a bit more time until it finishes. The
+# messages of all attempts must match the extended regex PATTERN, so that
+# the test fails if the program was never resumed in the interesting parts.
+run_until_done() {
+    local output="$1"
+    local pattern="$2"
+    shift 2
+    rm -fr "$output" "$output.checkpoint" "$output.log"
+    mkdir -p "$output"
+    local limit=1
+    until timeout -s KILL "$((limit / 10)).$((limit % 10))" "$@" -o "$output" \
+            --checkpoint-dir "$output.checkpoint" --checkpoint-interval 0 \
+            "$INPUT" >"$output.txt" 2>>"$output.log"; do
+        limit=$((limit + 1))
+        if [ "$limit" -gt 50 ]; then
+            "$@" -o "$output" --checkpoint-dir "$output.checkpoint" \
+                "$INPUT" >"$output.txt" 2>>"$output.log"
+            break
+        fi
+    done
+
+    grep -Eq "$pattern" "$output.log"
+
+    # All checkpoint files are removed after a complete run.
+    if ls "$output.checkpoint" | grep -q .; then
+        exit 1
+    fi
+}
+
+# Resumed after reading part of the input or in a later step.
+RESUMED='Resuming from checkpoint in step ([1-9][0-9]*|0 at offset [1-9][0-9]*)'
+
+mkdir -p checkpoint/plain
+../src/odmt-mark-topo-nodes -o checkpoint/plain "$INPUT"
+run_until_done checkpoint/mark-topo-nodes "$RESUMED" ../src/odmt-mark-topo-nodes
+cmp checkpoint/plain/with-marked-topo-nodes.osm.pbf \
+    checkpoint/mark-topo-nodes/with-marked-topo-nodes.osm.pbf
+
+# Small runs, so that there are sorted runs in most checkpoints.
+for mode in "" --one-pass --locations; do
+    mkdir -p "checkpoint/plain$mode"
+    ../src/odmt-duplicate-segments -o "checkpoint/plain$mode" -w 2 \
+        --run-size 1000 $mode "$INPUT" >"checkpoint/plain$mode.txt" 2>/dev/null
+    run_until_done "checkpoint/duplicate-segments$mode" \
+        "Loaded [1-9][0-9]* sorted runs from checkpoint" \
+        ../src/odmt-duplicate-segments -w 2 --run-size 1000 $mode
+    grep -Eq "$RESUMED" "checkpoint/duplicate-segments$mode.log"
+    diff -u "checkpoint/plain$mode.txt" "checkpoint/duplicate-segments$mode.txt"
+    for file in ids way-ids.csv; do
+        diff -u "checkpoint/plain$mode/$file" \
+            "checkpoint/duplicate-segments$mode/$file"
+    done
+done
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,66 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/duplicate-segments.sh SOURCE_DIR
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+
+mkdir -p duplicate-segments
+
+# check NAME OUTPUT_SUFFIX [OPTIONS...]
+check() {
+    local name="$1"
+    local output="duplicate-segments/$name-$2"
+    shift 2
+    mkdir -p "$output"
+    ../src/odmt-duplicate-segments -o "$output" "$@" \
+        "$SRCDIR/test/duplicate-segments/$name.opl" >"$output.result" \
+        2>"$output.log"
+    local expected="$SRCDIR/test/duplicate-segments/$name"
+    diff -u "$expected.expected" "$output.result"
+    diff -u "$expected.ids.expected" "$output/ids"
+    if [ -f "$output/way-ids.csv" ]; then
+        diff -u "$expected.way-ids.expected" "$output/way-ids.csv"
+        ../src/odmt-remove-tags -e "$SRCDIR/test/remove-tags/filter" \
+            -o "$output/duplicate-ways.opl" "$output/duplicate-ways.osm.pbf" \
+            >/dev/null
+        diff -u "$expected.ways.expected" "$output/duplicate-ways.opl"
+    fi
+}
+
+# The runs are merged into the same result as sorting in memory.
+for run_size in "" 2; do
+    for mode in "" one-pass; do
+        for way_ids in "" way-ids; do
+            options=(-t 2)
+            suffix="two-pass"
+            if [ -n "$mode" ]; then
+                options+=("--$mode")
+                suffix="$mode"
+            fi
+            if [ -n "$way_ids" ]; then
+                options+=(-w 2)
+                suffix="$suffix-$way_ids"
+            fi
+            if [ -n "$run_size" ]; then
+                options+=(--run-size "$run_size")
+                suffix="$suffix-runs"
+            fi
+            check segments "$suffix" "${options[@]}"
+            if [ -n "$run_size" ]; then
+                grep -q 'Wrote [0-9]* sorted runs$' \
+                    "duplicate-segments/segments-$suffix.log"
+            fi
+        done
+    done
+done
+
+check locations locations --locations
+check locations locations-runs --locations --run-size 2
+grep -q 'Wrote [0-9]* sorted runs$' duplicate-segments/locations-locations-runs.log
+
+#-----------------------------------------------------------------------------
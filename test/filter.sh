@@ -0,0 +1,28 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/filter.sh SOURCE_DIR
+#
+#  Check that the compiled filter matches exactly the same tags as the
+#  osmium::TagsFilter built from the same rules.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+DATA="$SRCDIR/test/filter"
+
+mkdir -p filter
+
+../src/odmt-bench --check-filter "$DATA/rules" --check-tags "$DATA/tags.opl" \
+    >filter/rules.result
+tail -n 1 filter/rules.result | grep -q '^82 tags, [1-9][0-9]* matching, 0 differences$'
+
+# Also with all the built-in filter patterns.
+for rules in "$SRCDIR"/filter-patterns/*; do
+    ../src/odmt-bench --check-filter "$rules" --check-tags "$DATA/tags.opl" \
+        >"filter/$(basename "$rules").result"
+done
+
+#-----------------------------------------------------------------------------
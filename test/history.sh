@@ -0,0 +1,63 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/history.sh SOURCE_DIR
+#
+#  Check that the snapshots from a history file give the same results as
+#  running the programs on the snapshots themselves.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+DATA="$SRCDIR/test/history"
+
+rm -fr history
+mkdir -p history/out history/out-lp
+
+../src/odmt-history -o history/out --output-compression none \
+    -t 2013-01-01T00:00:00Z -t 2011-01-01T00:00:00Z "$DATA/history.opl" \
+    2>/dev/null
+
+diff -u - history/out/snapshots.csv <<'EOF2'
+timestamp,nodes,ways,relations
+2011-01-01T00:00:00Z,4,2,0
+2013-01-01T00:00:00Z,3,1,1
+EOF2
+
+for year in 2011 2013; do
+    snapshot="history/out/$year-01-01T00:00:00Z"
+    dir="history/$year"
+    mkdir -p "$dir"
+    ../src/odmt-tag-stats "$DATA/$year.opl" >"$dir/tag-stats.txt"
+    ../src/odmt-line-or-polygon -o "$dir" --output-compression none \
+        "$DATA/$year.opl" >"$dir/line-or-polygon.txt"
+    ../src/odmt-limits -o "$dir" --output-compression none "$DATA/$year.opl"
+    for file in "$dir"/*.txt "$dir"/*.csv "$dir"/*.osm.pbf; do
+        cmp "$file" "$snapshot/${file##*/}"
+    done
+done
+
+# only the ways are read for line-or-polygon, so only they are counted
+../src/odmt-history -o history/out-lp -a line-or-polygon \
+    -t 2013-01-01T00:00:00Z -t 2011-01-01T00:00:00Z "$DATA/history.opl" \
+    2>/dev/null
+diff -u - history/out-lp/snapshots.csv <<'EOF2'
+timestamp,ways
+2011-01-01T00:00:00Z,2
+2013-01-01T00:00:00Z,1
+EOF2
+
+# versions must be in order
+tac "$DATA/history.opl" >history/unsorted.opl
+if ../src/odmt-history -o history/out -t 2011-01-01T00:00:00Z \
+        history/unsorted.opl 2>/dev/null; then
+    exit 1
+fi
+
+if ../src/odmt-history -o history/out -t 2011 "$DATA/history.opl" 2>/dev/null; then
+    exit 1
+fi
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,47 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/index.sh SOURCE_DIR
+#
+#  Check that the programs create the same output with and without a blob
+#  index for the input file and with and without memory mapping the input.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+mkdir -p index/plain index/mmap index/indexed index/indexed-mmap
+
+../src/odmt-bench -d index -s 20000 -g
+INPUT=index/synthetic-20000-1.osm.pbf
+rm -f "$INPUT.odmt-index"
+
+# run OUTPUT_DIR [OPTIONS...]
+run() {
+    local output="$1"
+    shift
+    ../src/odmt-line-or-polygon "$@" -o "$output" "$INPUT" >"$output/line-or-polygon.txt"
+    ../src/odmt-duplicate-segments "$@" -o "$output" -w 2 "$INPUT" >"$output/duplicate-segments.txt"
+    ../src/odmt-way-nodes "$@" -o "$output" "$INPUT" >"$output/way-nodes.txt"
+    ../src/odmt-tag-stats "$@" "$INPUT" >"$output/tag-stats.txt"
+    mkdir -p "$output/all"
+    ../src/odmt-all "$@" -o "$output/all" -a line-or-polygon "$INPUT"
+}
+
+run index/plain
+run index/mmap --mmap
+
+../src/odmt-index "$INPUT" >index/index.txt
+test -f "$INPUT.odmt-index"
+
+run index/indexed
+run index/indexed-mmap --mmap
+
+for file in line-or-polygon.txt duplicate-segments.txt way-nodes.txt \
+            tag-stats.txt ids way-ids.csv all/line-or-polygon.txt; do
+    for dir in mmap indexed indexed-mmap; do
+        diff -u "index/plain/$file" "index/$dir/$file"
+    done
+done
+
+#-----------------------------------------------------------------------------
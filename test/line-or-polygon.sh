@@ -15,7 +15,9 @@ for input in "$SRCDIR"/test/line-or-polygon/*.opl; do
     output="line-or-polygon/"$(basename -s .opl "$input")
     ../src/odmt-line-or-polygon -e "$SRCDIR/filter-patterns" "$input" >"$output.result"
     expected="$SRCDIR/test/$output.expected"
-    echo diff -u "$expected" "$output.result"
+    diff -u "$expected" "$output.result"
+    ../src/odmt-line-or-polygon "$input" >"$output.builtin.result"
+    diff -u "$output.result" "$output.builtin.result"
 done
 
 #-----------------------------------------------------------------------------
@@ -0,0 +1,96 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/merge.sh SOURCE_DIR
+#
+#  Check that merging the partial results of all shards of the input with
+#  odmt-merge gives the same results as a run over the complete input.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+
+FILTER="$SRCDIR/test/remove-tags/filter"
+
+mkdir -p merge/full merge/merged
+
+# Large enough to have many blobs, so each shard gets some.
+../src/odmt-bench -d merge -s 200000 -g
+INPUT=merge/synthetic-200000-1.osm.pbf
+
+../src/odmt-tag-stats -c 1 -v "$INPUT" >merge/full/tag-stats.txt
+../src/odmt-limits -o merge/full "$INPUT"
+../src/odmt-way-nodes "$INPUT" >merge/full/way-nodes.txt
+
+for shard in 0 1 2; do
+    ../src/odmt-tag-stats -c 1 -v --shard "$shard/3" \
+        --partial-out "merge/tag-stats-$shard.partial" "$INPUT"
+    ../src/odmt-limits --shard "$shard/3" \
+        --partial-out "merge/limits-$shard.partial" "$INPUT"
+    ../src/odmt-way-nodes --shard "$shard/3" \
+        --partial-out "merge/way-nodes-$shard.partial" "$INPUT"
+done
+
+# The order of the partial files doesn't matter.
+../src/odmt-merge merge/tag-stats-2.partial merge/tag-stats-0.partial \
+    merge/tag-stats-1.partial >merge/merged/tag-stats.txt
+../src/odmt-merge -o merge/merged merge/limits-{0,1,2}.partial
+../src/odmt-merge merge/way-nodes-{0,1,2}.partial >merge/merged/way-nodes.txt
+
+diff -u merge/full/tag-stats.txt merge/merged/tag-stats.txt
+diff -u merge/full/way-nodes.txt merge/merged/way-nodes.txt
+
+# The sorted node ID runs of more shards, so that ways and multiple ways
+# are spread over them.
+for shard in 0 1 2 3 4; do
+    ../src/odmt-way-nodes --shard "$shard/5" \
+        --partial-out "merge/way-nodes-$shard-of-5.partial" "$INPUT"
+done
+../src/odmt-merge merge/way-nodes-{4,2,0,3,1}-of-5.partial \
+    >merge/merged/way-nodes-5.txt
+diff -u merge/full/way-nodes.txt merge/merged/way-nodes-5.txt
+for csv in merge/full/hist-*.csv; do
+    diff -u "$csv" "merge/merged/$(basename "$csv")"
+done
+
+# The PBF files are compared as OPL, the filter changes both the same way.
+for pbf in merge/full/*.osm.pbf; do
+    name=$(basename -s .osm.pbf "$pbf")
+    for dir in full merged; do
+        ../src/odmt-remove-tags -e "$FILTER" -o "merge/$dir/$name.opl" \
+            "merge/$dir/$name.osm.pbf"
+    done
+    cmp "merge/full/$name.opl" "merge/merged/$name.opl"
+done
+test -s merge/merged/value-length.opl
+
+# A missing shard, a shard given twice, or partial files of different
+# programs can't be merged.
+if ../src/odmt-merge merge/tag-stats-0.partial merge/tag-stats-1.partial; then
+    exit 1
+fi
+if ../src/odmt-merge merge/tag-stats-{0,1,1,2}.partial; then
+    exit 1
+fi
+if ../src/odmt-merge merge/tag-stats-0.partial merge/way-nodes-{1,2}.partial; then
+    exit 1
+fi
+
+# Invalid shards, --shard without --partial-out, sharding other files.
+for shard in 3/3 1 a/2; do
+    if ../src/odmt-tag-stats --shard "$shard" --partial-out merge/x.partial \
+            "$INPUT"; then
+        exit 1
+    fi
+done
+if ../src/odmt-tag-stats --shard 0/2 "$INPUT"; then
+    exit 1
+fi
+if ../src/odmt-tag-stats --shard 0/2 --partial-out merge/x.partial \
+        "$SRCDIR/test/duplicate-segments/segments.opl"; then
+    exit 1
+fi
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,60 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/output.sh SOURCE_DIR
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+
+mkdir -p output
+
+FILTER="$SRCDIR/test/remove-tags/filter"
+INPUT="$SRCDIR/test/remove-tags/input.opl"
+EXPECTED="$SRCDIR/test/remove-tags/input.expected"
+
+compressions="none zlib zlib:1 zlib:9"
+
+# lz4 is only there if the programs were built with it
+if ../src/odmt-remove-tags -e "$FILTER" -o output/lz4-check.osm.pbf \
+        --output-compression lz4 "$INPUT" 2>/dev/null; then
+    compressions="$compressions lz4"
+fi
+
+# write PBF with each compression, read it back (the filter doesn't change
+# anything the second time), the result must always be the same
+for compression in $compressions; do
+    pbf="output/$compression.osm.pbf"
+    ../src/odmt-remove-tags -e "$FILTER" -o "$pbf" \
+        --output-compression "$compression" "$INPUT"
+    ../src/odmt-remove-tags -e "$FILTER" -o "output/$compression.opl" "$pbf"
+    diff -u "$EXPECTED" "output/$compression.opl"
+done
+
+# invalid compressions
+for compression in foo zlib:0 zlib:10 none:1; do
+    if ../src/odmt-remove-tags -e "$FILTER" -o output/invalid.osm.pbf \
+            --output-compression "$compression" "$INPUT"; then
+        exit 1
+    fi
+done
+
+# one encoder thread and the smallest memory limit give the same output
+../src/odmt-bench -d output -s 200000 -g
+mkdir -p output/default output/small
+../src/odmt-line-or-polygon -o output/default \
+    output/synthetic-200000-1.osm.pbf >/dev/null
+../src/odmt-line-or-polygon -o output/small --output-threads 1 \
+    --output-memory 1 output/synthetic-200000-1.osm.pbf >/dev/null
+for pbf in output/default/lp-*.osm.pbf; do
+    name=$(basename -s .osm.pbf "$pbf")
+    for dir in default small; do
+        ../src/odmt-remove-tags -e "$FILTER" -o "output/$dir/$name.opl" \
+            "output/$dir/$name.osm.pbf"
+    done
+    cmp "output/default/$name.opl" "output/small/$name.opl"
+done
+
+#-----------------------------------------------------------------------------
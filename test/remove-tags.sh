@@ -0,0 +1,33 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/remove-tags.sh SOURCE_DIR
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+
+mkdir -p remove-tags
+
+for input in "$SRCDIR"/test/remove-tags/*.opl; do
+    output="remove-tags/"$(basename -s .opl "$input")
+    for threads in 1 4; do
+        ../src/odmt-remove-tags -e "$SRCDIR/test/remove-tags/filter" \
+            -t "$threads" -o "$output.$threads.result.opl" "$input"
+        diff -u "$SRCDIR/test/$output.expected" "$output.$threads.result.opl"
+    done
+done
+
+# several variants written in one pass
+for threads in 1 4; do
+    ../src/odmt-remove-tags -t "$threads" \
+        -e "$SRCDIR/test/remove-tags/filter" -o "remove-tags/all.$threads.result.opl" \
+        -e "$SRCDIR/test/remove-tags/filter-source" -o "remove-tags/source.$threads.result.opl" \
+        "$SRCDIR/test/remove-tags/input.opl"
+    diff -u "$SRCDIR/test/remove-tags/input.expected" "remove-tags/all.$threads.result.opl"
+    diff -u "$SRCDIR/test/remove-tags/input.source.expected" "remove-tags/source.$threads.result.opl"
+done
+
+#-----------------------------------------------------------------------------
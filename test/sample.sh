@@ -0,0 +1,55 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/sample.sh SOURCE_DIR
+#
+#  Check that the programs estimate their results from a sample of the
+#  input with --sample.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+
+mkdir -p sample/full sample/sampled
+
+# Large enough to have many blobs, so the sample isn't empty.
+../src/odmt-bench -d sample -s 400000 -g
+INPUT=sample/synthetic-400000-1.osm.pbf
+
+# run OUTPUT_DIR [OPTIONS...]
+run() {
+    local output="$1"
+    shift
+    ../src/odmt-tag-stats "$@" -c 1 "$INPUT" >"$output/tag-stats.txt"
+    ../src/odmt-limits "$@" -o "$output" "$INPUT"
+    ../src/odmt-line-or-polygon "$@" -o "$output" "$INPUT" >"$output/line-or-polygon.txt"
+    ../src/odmt-way-nodes "$@" "$INPUT" >"$output/way-nodes.txt"
+}
+
+run sample/full
+run sample/sampled --sample 0.5
+
+# Results without sampling don't have errors.
+if grep -q '±' sample/full/*.txt; then
+    exit 1
+fi
+grep -q '^0,[0-9]*$' sample/full/hist-tags-count.csv
+
+# Sampled results come with errors.
+grep -q '^[0-9]* ±[0-9]* ' sample/sampled/tag-stats.txt
+grep -q '^0,[0-9]*,[0-9]*$' sample/sampled/hist-tags-count.csv
+grep -q 'closed: *[0-9]* ±[0-9]*' sample/sampled/line-or-polygon.txt
+grep -q '^nodes: [0-9]* ±[0-9]*$' sample/sampled/way-nodes.txt
+
+# Ways and relations are not sampled in way-nodes.
+diff <(grep -E '^(ways|relations):' sample/full/way-nodes.txt) \
+     <(grep -E '^(ways|relations):' sample/sampled/way-nodes.txt)
+
+# Sampling needs a PBF file.
+if ../src/odmt-tag-stats --sample 0.5 "$SRCDIR/test/duplicate-segments/segments.opl"; then
+    exit 1
+fi
+
+#-----------------------------------------------------------------------------
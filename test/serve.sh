@@ -0,0 +1,103 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/serve.sh SOURCE_DIR
+#
+#  Check the answers of the query server with indexes built from an input
+#  file and with indexes loaded from the topology and tag stats states.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+INPUT="$SRCDIR/test/topology/new.opl"
+
+rm -fr serve
+mkdir -p serve
+
+SERVERS=()
+trap 'kill "${SERVERS[@]}" 2>/dev/null || true' EXIT
+
+# Start a server on the socket given as first argument and wait until it
+# is ready for queries.
+start_server() {
+    ../src/odmt-serve -s "$@" 2>"$1.err" &
+    SERVERS+=($!)
+    for _ in $(seq 100); do
+        if grep -q '^Ready' "$1.err"; then
+            return 0
+        fi
+        sleep 0.1
+    done
+    cat "$1.err"
+    return 1
+}
+
+start_server serve/input -v "$INPUT"
+
+../src/odmt-serve -c -s serve/input >serve/input.txt <<'EOF'
+node 1
+node 3
+node 4
+node 2
+way 10
+way 11
+way 13
+count highway
+count building=yes
+count amenity
+classify building=yes
+classify highway=residential,area=no
+classify name=A%20%B,area=yes
+classify area=maybe
+EOF
+
+diff -u - serve/input.txt <<'EOF'
+OK in-way=yes multiple-ways=no relation=yes
+OK in-way=yes multiple-ways=yes relation=no
+OK in-way=yes multiple-ways=yes relation=no
+OK in-way=no multiple-ways=no relation=no
+OK not-closed
+OK polygon
+OK missing
+OK 2
+OK 1
+OK 0
+OK polygon
+OK linestring
+OK polygon
+OK error
+EOF
+
+# queries can also be given on the command line
+../src/odmt-serve -c -s serve/input 'way 11' 'count highway' >serve/args.txt
+printf 'OK polygon\nOK 2\n' | diff -u - serve/args.txt
+
+# the same answers from the states
+../src/odmt-topology -s serve/topology "$INPUT" >/dev/null
+../src/odmt-tag-stats -v -s serve/tag-stats.state "$INPUT" >/dev/null
+start_server serve/states -t serve/topology --tag-stats-state serve/tag-stats.state
+
+../src/odmt-serve -c -s serve/states 'node 1' 'node 3' 'node 4' 'node 2' \
+    'count building=yes' >serve/states.txt
+head -n 4 serve/input.txt >serve/expected.txt
+echo 'OK 1' >>serve/expected.txt
+diff -u serve/expected.txt serve/states.txt
+
+# error answers make the client fail
+if ../src/odmt-serve -c -s serve/states 'way 11' >serve/error.txt; then
+    exit 1
+fi
+grep -q '^ERROR' serve/error.txt
+
+if ../src/odmt-serve -c -s serve/input 'foo 1' 'node x' >/dev/null; then
+    exit 1
+fi
+
+# there can only be one server on a socket
+if ../src/odmt-serve -s serve/input "$INPUT" 2>/dev/null; then
+    exit 1
+fi
+
+#-----------------------------------------------------------------------------
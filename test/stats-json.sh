@@ -0,0 +1,45 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/stats-json.sh SOURCE_DIR
+#
+#  Check that all programs write run statistics with --stats-json.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+
+INPUT="$SRCDIR/test/duplicate-segments/segments.opl"
+
+mkdir -p stats-json
+
+# check TOOL EXPECTED_WAYS [OPTIONS...]
+check() {
+    local tool="$1"
+    local ways="$2"
+    shift 2
+    local output="stats-json/$tool"
+    mkdir -p "$output"
+    ../src/odmt-$tool "$@" --stats-json "$output.json" "$INPUT" >/dev/null
+    grep -q "\"tool\": \"odmt-$tool\"" "$output.json"
+    grep -q "\"ways\": $ways," "$output.json"
+    grep -q "\"peak_rss_kb\": [1-9]" "$output.json"
+}
+
+check all 14 -o stats-json/all
+check characters 14 -o stats-json/characters
+check duplicate-segments 28 -o stats-json/duplicate-segments
+check limits 14 -o stats-json/limits
+check line-or-polygon 14 -o stats-json/line-or-polygon
+check mark-topo-nodes 28 -o stats-json/mark-topo-nodes
+check remove-tags 14 -e "$SRCDIR/filter-patterns/meta-tags" \
+    -o stats-json/remove-tags.osm.pbf
+check tag-stats 14
+check way-nodes 14
+
+grep -q '"sort": {' stats-json/duplicate-segments.json
+grep -q '"bytes_out": [1-9]' stats-json/limits.json
+
+#-----------------------------------------------------------------------------
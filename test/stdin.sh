@@ -0,0 +1,45 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/stdin.sh SOURCE_DIR
+#
+#  Check that programs can be chained with pipes.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+FILTER="$SRCDIR/test/remove-tags/filter"
+INPUT="$SRCDIR/test/tag-stats/new.opl"
+
+mkdir -p stdin
+
+# the same as with temporary files
+../src/odmt-remove-tags -e "$FILTER" -o stdin/removed.opl "$INPUT" >/dev/null
+../src/odmt-tag-stats -c 1 stdin/removed.opl >stdin/files.txt
+
+for format in opl pbf; do
+    ../src/odmt-remove-tags -e "$FILTER" -o - --output-format "$format" \
+        --output-compression none "$INPUT" 2>/dev/null |
+        ../src/odmt-tag-stats -c 1 --input-format "$format" - >"stdin/$format.txt"
+    diff -u stdin/files.txt "stdin/$format.txt"
+done
+
+# a format is needed for STDIN and STDOUT
+if ../src/odmt-tag-stats - <"$INPUT"; then
+    exit 1
+fi
+if ../src/odmt-remove-tags -e "$FILTER" -o - "$INPUT" >/dev/null; then
+    exit 1
+fi
+
+# programs reading the input twice refuse to read STDIN
+if ../src/odmt-mark-topo-nodes -o stdin --input-format opl - <"$INPUT"; then
+    exit 1
+fi
+if ../src/odmt-duplicate-segments -o stdin --input-format opl - <"$INPUT"; then
+    exit 1
+fi
+
+#-----------------------------------------------------------------------------
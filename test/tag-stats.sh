@@ -0,0 +1,38 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/tag-stats.sh SOURCE_DIR
+#
+#  Check that updating the tag stats state with a change file gives the
+#  same result as counting from scratch.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+DATA="$SRCDIR/test/tag-stats"
+
+mkdir -p tag-stats
+
+for options in "-c 1" "-c 1 -v"; do
+    suffix=${options// /}
+    ../src/odmt-tag-stats $options -s "tag-stats/state$suffix" "$DATA/old.opl" >/dev/null
+    ../src/odmt-tag-stats -c 1 -s "tag-stats/state$suffix" -a "$DATA/changes.osc" >"tag-stats/updated$suffix.txt"
+    ../src/odmt-tag-stats $options -s "tag-stats/new-state$suffix" "$DATA/new.opl" >"tag-stats/new$suffix.txt"
+    diff -u "tag-stats/new$suffix.txt" "tag-stats/updated$suffix.txt"
+
+    # Same counts as without state file.
+    ../src/odmt-tag-stats $options "$DATA/new.opl" | sort >"tag-stats/plain$suffix.txt"
+    sort "tag-stats/new$suffix.txt" | diff -u "tag-stats/plain$suffix.txt" -
+done
+
+# Versions in a change file can be out of order, the last version counts.
+../src/odmt-tag-stats -c 1 -v -s tag-stats/state-unordered "$DATA/old.opl" >/dev/null
+../src/odmt-tag-stats -c 1 -s tag-stats/state-unordered -a "$DATA/unordered.osc" >tag-stats/unordered.txt
+diff -u tag-stats/new-c1-v.txt tag-stats/unordered.txt
+
+grep -q '^2 name$' tag-stats/updated-c1.txt
+grep -q '^1 cuisine=pizza$' tag-stats/updated-c1-v.txt
+
+#-----------------------------------------------------------------------------
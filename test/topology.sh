@@ -0,0 +1,59 @@
+#!/bin/bash
+#-----------------------------------------------------------------------------
+#
+#  test/topology.sh SOURCE_DIR
+#
+#  Check that updating the topology state with a change file gives the
+#  same result as creating it from scratch and that the programs using the
+#  state give the same results as without it.
+#
+#-----------------------------------------------------------------------------
+
+set -euo pipefail
+
+SRCDIR="$1"
+DATA="$SRCDIR/test/topology"
+
+rm -fr topology
+mkdir -p topology/plain topology/with-state
+
+../src/odmt-topology -s topology/state "$DATA/old.opl" >/dev/null
+../src/odmt-topology -s topology/state -a "$DATA/changes.osc" >topology/updated.txt
+../src/odmt-topology -s topology/new-state "$DATA/new.opl" >topology/new.txt
+diff -u topology/new.txt topology/updated.txt
+
+# Versions in a change file can be out of order, the last version counts.
+../src/odmt-topology -s topology/unordered "$DATA/old.opl" >/dev/null
+../src/odmt-topology -s topology/unordered -a "$DATA/unordered.osc" >topology/unordered.txt
+diff -u topology/new.txt topology/unordered.txt
+
+grep -q '^ways: 3$' topology/updated.txt
+grep -q '^relations: 1$' topology/updated.txt
+grep -q '^nodes in way: 4$' topology/updated.txt
+grep -q '^nodes in multiple ways: 3$' topology/updated.txt
+grep -q '^nodes in relation: 2$' topology/updated.txt
+
+../src/odmt-way-nodes "$DATA/new.opl" >topology/plain/way-nodes.txt
+../src/odmt-way-nodes -t topology/state "$DATA/new.opl" >topology/with-state/way-nodes.txt
+diff -u topology/plain/way-nodes.txt topology/with-state/way-nodes.txt
+
+../src/odmt-mark-topo-nodes -o topology/plain "$DATA/new.opl"
+../src/odmt-mark-topo-nodes -o topology/with-state -t topology/state "$DATA/new.opl"
+cmp topology/plain/with-marked-topo-nodes.osm.pbf topology/with-state/with-marked-topo-nodes.osm.pbf
+
+# Updating a state that doesn't exist is an error.
+if ../src/odmt-topology -s topology/missing -a "$DATA/changes.osc" 2>/dev/null; then
+    exit 1
+fi
+
+# A state left behind by an interrupted update can't be used.
+../src/odmt-topology -s topology/interrupted "$DATA/old.opl" >/dev/null
+if ../src/odmt-topology -s topology/interrupted -a "$DATA/changes.osc" \
+    -a topology/missing.osc 2>/dev/null; then
+    exit 1
+fi
+if ../src/odmt-way-nodes -t topology/interrupted "$DATA/new.opl" 2>/dev/null; then
+    exit 1
+fi
+
+#-----------------------------------------------------------------------------